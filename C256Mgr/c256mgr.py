@@ -2,6 +2,7 @@ import intelhex
 import wdc
 import foenix
 import srec
+import xfer
 import configparser
 import re
 import sys
@@ -203,6 +204,19 @@ def send(port, filename):
     finally:
         c256.close()
 
+def send_xfer(port, filename, baudrate):
+    """Send a binary file to the RECEIVE command of Foenix/MCP over a serial port."""
+    with open(filename, "rb") as f:
+        data = f.read()
+
+    sender = xfer.XferSender()
+    try:
+        sender.open(port, int(baudrate))
+        sender.send(data)
+        print("Sent {} bytes.".format(len(data)))
+    finally:
+        sender.close()
+
 def get(port, address, length):
     """Read a block of data from the C256."""
     c256 = foenix.FoenixDebugPort()
@@ -278,6 +292,12 @@ parser.add_argument("--upload-wdc", metavar="BINARY FILE", dest="wdc_file",
 parser.add_argument("--upload-srec", metavar="SREC FILE", dest="srec_file",
                     help="Upload a Motorola SREC hex file.")
 
+parser.add_argument("--xfer", metavar="BINARY FILE", dest="xfer_file",
+                    help="Send a binary file to the RECEIVE command over a serial port (not the debug port).")
+
+parser.add_argument("--xfer-bps", metavar="BPS", dest="xfer_bps", default="115200",
+                    help="The speed to use with --xfer (must match the RECEIVE command).")
+
 options = parser.parse_args()
 
 try:
@@ -285,6 +305,9 @@ try:
         if options.hex_file:
             send(options.port, options.hex_file)
 
+        elif options.xfer_file:
+            send_xfer(options.port, options.xfer_file, options.xfer_bps)
+
         elif options.wdc_file:
             send_wdc(options.port, options.wdc_file)
 
@@ -0,0 +1,148 @@
+import serial
+import struct
+import sys
+import zlib
+
+XFER_MAGIC = 0xA5
+XFER_BLOCK_SIZE = 1024
+XFER_WINDOW = 8
+XFER_RETRIES = 10
+
+XFER_HELLO = ord('H')
+XFER_RESTART = ord('R')
+XFER_DATA = ord('D')
+XFER_DONE = ord('E')
+XFER_ABORT = ord('A')
+XFER_ACK = ord('K')
+XFER_NAK = ord('N')
+
+class XferSender:
+    """Send a binary image to the RECEIVE command of Foenix/MCP over a serial port.
+
+    The image goes out in blocks with a CRC32 each, up to XFER_WINDOW blocks ahead of the
+    last acknowledgement. The window is bigger than the target's receive buffer, so the
+    port uses RTS/CTS flow control (RECEIVE turns it on at the target's end). A NAK (or a
+    timeout) sends everything again from the first byte the target is missing. If the
+    target already holds the start of the image from an earlier transfer, only the rest
+    is sent.
+    """
+    connection = 0
+
+    def open(self, port, baudrate):
+        """Open the serial port to the target."""
+        self.connection = serial.Serial(port=port,
+            baudrate=baudrate,
+            bytesize=serial.EIGHTBITS,
+            parity=serial.PARITY_NONE,
+            stopbits=serial.STOPBITS_ONE,
+            rtscts=True,
+            timeout=2,
+            write_timeout=60)
+
+    def close(self):
+        """Close the serial port."""
+        self.connection.close()
+
+    def send_frame(self, frame_type, offset, data=b''):
+        """Send one frame to the target."""
+        body = struct.pack(">BHL", frame_type, len(data), offset) + data
+        crc = zlib.crc32(body) & 0xFFFFFFFF
+        self.connection.write(bytes([XFER_MAGIC]) + body + struct.pack(">L", crc))
+
+    def read_frame(self):
+        """Read one frame from the target. Returns (type, offset, data), or None on a timeout or a bad frame."""
+        while True:
+            b = self.connection.read(1)
+            if len(b) == 0:
+                return None
+            if b[0] == XFER_MAGIC:
+                break
+
+        header = self.connection.read(7)
+        if len(header) != 7:
+            return None
+
+        (frame_type, length, offset) = struct.unpack(">BHL", header)
+        rest = self.connection.read(length + 4)
+        if len(rest) != length + 4:
+            return None
+
+        data = rest[:length]
+        (crc,) = struct.unpack(">L", rest[length:])
+        if crc != (zlib.crc32(header + data) & 0xFFFFFFFF):
+            return None
+
+        return (frame_type, offset, data)
+
+    def restart(self):
+        """Have the target throw away what it holds. Returns the new starting offset (0)."""
+        for retry in range(XFER_RETRIES):
+            self.send_frame(XFER_RESTART, 0)
+            frame = self.read_frame()
+            if frame and frame[0] == XFER_ACK and frame[1] == 0:
+                return 0
+            if frame and frame[0] == XFER_ABORT:
+                raise Exception("The target gave up on the transfer.")
+        raise Exception("The target did not restart the transfer.")
+
+    def send(self, data):
+        """Send the image to the target."""
+        total = len(data)
+
+        # Find out how much of the image the target already has
+        acked = None
+        for retry in range(XFER_RETRIES):
+            self.send_frame(XFER_HELLO, total)
+            frame = self.read_frame()
+            if frame and frame[0] == XFER_ACK:
+                (acked, held_crc) = (frame[1], struct.unpack(">L", frame[2])[0])
+                break
+            if frame and frame[0] == XFER_ABORT:
+                raise Exception("The target refused the transfer.")
+        if acked is None:
+            raise Exception("The target is not answering. Is RECEIVE running?")
+
+        if acked > 0:
+            if acked <= total and (zlib.crc32(data[:acked]) & 0xFFFFFFFF) == held_crc:
+                print("Resuming at byte {}.".format(acked), flush=True)
+            else:
+                acked = self.restart()
+
+        next_offset = acked
+        retries = 0
+        while acked < total:
+            # Fill the window
+            while next_offset < total and next_offset - acked < XFER_WINDOW * XFER_BLOCK_SIZE:
+                block = data[next_offset:next_offset + XFER_BLOCK_SIZE]
+                self.send_frame(XFER_DATA, next_offset, block)
+                next_offset += len(block)
+
+            frame = self.read_frame()
+            if frame is None:
+                # Lost something: go back to the last byte acknowledged
+                retries += 1
+                if retries > XFER_RETRIES:
+                    raise Exception("Too many retries at byte {}.".format(acked))
+                next_offset = acked
+                continue
+
+            (frame_type, offset, _) = frame
+            if frame_type == XFER_ACK:
+                if offset > acked:
+                    acked = offset
+                    retries = 0
+                    sys.stdout.write("\r{} of {} bytes".format(acked, total))
+                    sys.stdout.flush()
+            elif frame_type == XFER_NAK:
+                acked = max(acked, offset)
+                next_offset = offset
+            elif frame_type == XFER_ABORT:
+                raise Exception("The target gave up on the transfer.")
+
+        print()
+        for retry in range(XFER_RETRIES):
+            self.send_frame(XFER_DONE, total)
+            frame = self.read_frame()
+            if frame and frame[0] == XFER_ACK and frame[1] == total:
+                return
+        raise Exception("The target did not confirm the end of the transfer.")
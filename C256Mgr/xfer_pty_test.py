@@ -0,0 +1,164 @@
+"""Test the --xfer sender against the host build of the RECEIVE side, over a pty.
+
+The target side is tests/xfer_host (build it with make in tests/), which runs src/xfer.c
+with its channel calls on the slave end of a pseudo-terminal. This script drives the
+XferSender on the master end and checks what the target ends up holding.
+
+python xfer_pty_test.py <path to xfer_host>
+"""
+
+import os
+import pty
+import random
+import select
+import subprocess
+import sys
+import tempfile
+import time
+import tty
+
+import xfer
+
+PAGE_SIZE = 4096    # The size of a page of the kernel's memory manager
+
+class PtyConnection:
+    """The part of serial.Serial that XferSender uses, on the master end of a pty.
+
+    damage is a list of frame numbers (counting every write) to corrupt, and drop a list
+    of frame numbers to leave out, to exercise the NAK and timeout paths.
+    """
+
+    def __init__(self, fd, timeout=2, damage=(), drop=()):
+        self.fd = fd
+        self.timeout = timeout
+        self.damage = set(damage)
+        self.drop = set(drop)
+        self.writes = 0
+
+    def write(self, data):
+        self.writes += 1
+        if self.writes in self.drop:
+            return len(data)
+        if self.writes in self.damage:
+            data = bytearray(data)
+            data[len(data) // 2] ^= 0xFF
+            data = bytes(data)
+        try:
+            os.write(self.fd, data)
+        except OSError:
+            # The target has gone
+            pass
+        return len(data)
+
+    def read(self, count):
+        data = b''
+        deadline = time.monotonic() + self.timeout
+        while len(data) < count:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                break
+            ready, _, _ = select.select([self.fd], [], [], remaining)
+            if not ready:
+                break
+            try:
+                data += os.read(self.fd, count - len(data))
+            except OSError:
+                # The target has gone
+                break
+        return data
+
+    def close(self):
+        pass
+
+class Target:
+    """Run xfer_host on the slave end of a new pty."""
+
+    def __init__(self, program, args):
+        (self.master, self.slave) = pty.openpty()
+        tty.setraw(self.slave)
+        tty.setraw(self.master)
+        # Keep the slave open here too, or the master reads EIO until the target opens it
+        self.process = subprocess.Popen([program, os.ttyname(self.slave)] + args,
+            stdout=subprocess.PIPE, universal_newlines=True)
+
+    def finish(self):
+        """Wait for the target to stop. Returns (result, received)."""
+        (out, _) = self.process.communicate(timeout=30)
+        os.close(self.slave)
+        os.close(self.master)
+        words = out.split()
+        return (int(words[1]), int(words[3]))
+
+def send(target, data, **faults):
+    """Send data to a target. Returns the exception the sender raised, if any."""
+    sender = xfer.XferSender()
+    sender.connection = PtyConnection(target.master, **faults)
+    try:
+        sender.send(data)
+    except Exception as e:
+        return e
+    return None
+
+def check(name, condition):
+    print("{}: {}".format(name, "ok" if condition else "FAILED"))
+    return condition
+
+def run(program):
+    workdir = tempfile.mkdtemp()
+    path = os.path.join(workdir, "image.bin")
+    dump = os.path.join(workdir, "ram.bin")
+    rng = random.Random(1)
+    image = bytes(rng.randrange(256) for i in range(20 * xfer.XFER_BLOCK_SIZE + 123))
+    ok = True
+
+    # A clean transfer to a file
+    target = Target(program, [path])
+    error = send(target, image)
+    (result, received) = target.finish()
+    ok &= check("file", error is None and result == 0 and received == len(image) and open(path, "rb").read() == image)
+
+    # Damaged and lost frames are sent again
+    os.remove(path)
+    target = Target(program, [path])
+    error = send(target, image, damage=[3, 9], drop=[14])
+    (result, received) = target.finish()
+    ok &= check("damaged frames", error is None and result == 0 and open(path, "rb").read() == image)
+
+    # The start of the image is already in the file: only the rest is sent
+    with open(path, "wb") as f:
+        f.write(image[:7 * xfer.XFER_BLOCK_SIZE])
+    target = Target(program, [path])
+    error = send(target, image)
+    (result, received) = target.finish()
+    ok &= check("resume", error is None and result == 0 and open(path, "rb").read() == image)
+
+    # Something else is in the file: the transfer starts over
+    with open(path, "wb") as f:
+        f.write(b'\0' * 5000)
+    target = Target(program, [path])
+    error = send(target, image)
+    (result, received) = target.finish()
+    ok &= check("restart", error is None and result == 0 and open(path, "rb").read() == image)
+
+    # A transfer into memory at the user RAMSTART, with COM1's buffer already taken
+    # (xfer_host gives it one page, like the UART driver)
+    pages = (len(image) + PAGE_SIZE - 1) // PAGE_SIZE
+    target = Target(program, ["@{}".format((pages + 1) * PAGE_SIZE), dump])
+    error = send(target, image)
+    (result, received) = target.finish()
+    ok &= check("memory at RAMSTART", error is None and result == 0 and open(dump, "rb").read() == image)
+
+    # An image too big for the free memory is refused before anything is written
+    target = Target(program, ["@{}".format(pages * PAGE_SIZE), dump])
+    error = send(target, image)
+    (result, received) = target.finish()
+    ok &= check("memory bounds", error is not None and result != 0 and received == 0)
+
+    return ok
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("USAGE: python xfer_pty_test.py <path to xfer_host>")
+        sys.exit(2)
+
+    sys.exit(0 if run(sys.argv[1]) else 1)
@@ -65,6 +65,7 @@ const t_cli_command g_cli_commands[] = {
     { "DISKFILL", "DISKFILL <drive #> <sector #> <byte value>", cmd_diskfill },
     { "DISKREAD", "DISKREAD <drive #> <sector #>", cmd_diskread },
     { "DUMP", "DUMP <addr> [<count>] : print a memory dump", mem_cmd_dump},
+    { "FORMAT", "FORMAT <drive #> [FAT | FAT32 | EXFAT] [<label>] : format a drive", cmd_format },
     { "GETJIFFIES", "GETJIFFIES : print the number of jiffies since bootup", cmd_getjiffies },
     { "GETTICKS", "GETTICKS : print number of ticks since reset", cmd_get_ticks },
     { "LABEL", "LABEL <drive#> <label> : set the label of a drive", cmd_label },
@@ -77,6 +78,7 @@ const t_cli_command g_cli_commands[] = {
     { "POKE16", "POKE16 <addr> <value> : write the 16-bit value to the address in memory", mem_cmd_poke16 },
     { "POKE32", "POKE32 <addr> <value> : write the 32-bit value to the address in memory", mem_cmd_poke32 },
     { "PWD", "PWD : prints the current directory", cmd_pwd },
+    { "RECEIVE", "RECEIVE <path> | @<address> [<bps>] : receive a binary image over COM1", cmd_receive },
     { "REN", "REN <old path> <new path> : rename a file or directory", cmd_rename },
     { "RUN", "RUN <path> : execute a binary file",  cmd_run },
     { "SET", "SET <name> <value> : set the value of a setting", cli_cmd_set },
@@ -130,38 +132,54 @@ short cmd_cls(short channel, int argc, const char * argv[]) {
     return 0;
 }
 
+/*
+ * Point one piece of a vectored write at a string
+ */
+static void cli_iov_string(p_chan_iovec iov, const char * text) {
+    iov->buffer = (uint8_t *)text;
+    iov->size = strlen(text);
+}
+
 /*
  * Display information about the system
+ *
+ * The labels and the values live in separate buffers, and all of them go out in a single writev.
  */
 short cmd_sysinfo(short channel, int argc, const char * argv[]) {
     t_sys_info info;
-    char buffer[80];
+    t_chan_iovec iov[16];
+    char memory[12];
+    char fpga_date[12];
+    char fpga_model[12];
+    char fpga_version[12];
+    char mcp_version[20];
 
     sys_get_info(&info);
 
-    sprintf(buffer, "System information:\nModel: %s", info.model_name);
-    sys_chan_write(channel, buffer, strlen(buffer));
-
-    sprintf(buffer, "\nCPU: %s", info.cpu_name);
-    sys_chan_write(channel, buffer, strlen(buffer));
-
-    sprintf(buffer, "\nSystem Memory: 0x%lX", info.system_ram_size);
-    sys_chan_write(channel, buffer, strlen(buffer));
-
-    sprintf(buffer, "\nPCB version: %s", (char*)&info.pcb_version);
-    sys_chan_write(channel, buffer, strlen(buffer));
-
-    sprintf(buffer, "\nFPGA Date: %08lX", info.fpga_date);
-    sys_chan_write(channel, buffer, strlen(buffer));
-
-    sprintf(buffer, "\nFPGA Model: %08lX", info.fpga_model);
-    sys_chan_write(channel, buffer, strlen(buffer));
-
-    sprintf(buffer, "\nFPGA Version: %04X.%04X", info.fpga_version, info.fpga_subver);
-    sys_chan_write(channel, buffer, strlen(buffer));
-
-    sprintf(buffer, "\nMCP version: v%02u.%02u.%04u\n", info.mcp_version, info.mcp_rev, info.mcp_build);
-    sys_chan_write(channel, buffer, strlen(buffer));
+    sprintf(memory, "0x%lX", info.system_ram_size);
+    sprintf(fpga_date, "%08lX", info.fpga_date);
+    sprintf(fpga_model, "%08lX", info.fpga_model);
+    sprintf(fpga_version, "%04X.%04X", info.fpga_version, info.fpga_subver);
+    sprintf(mcp_version, "v%02u.%02u.%04u\n", info.mcp_version, info.mcp_rev, info.mcp_build);
+
+    cli_iov_string(&iov[0], "System information:\nModel: ");
+    cli_iov_string(&iov[1], info.model_name);
+    cli_iov_string(&iov[2], "\nCPU: ");
+    cli_iov_string(&iov[3], info.cpu_name);
+    cli_iov_string(&iov[4], "\nSystem Memory: ");
+    cli_iov_string(&iov[5], memory);
+    cli_iov_string(&iov[6], "\nPCB version: ");
+    cli_iov_string(&iov[7], (char*)&info.pcb_version);
+    cli_iov_string(&iov[8], "\nFPGA Date: ");
+    cli_iov_string(&iov[9], fpga_date);
+    cli_iov_string(&iov[10], "\nFPGA Model: ");
+    cli_iov_string(&iov[11], fpga_model);
+    cli_iov_string(&iov[12], "\nFPGA Version: ");
+    cli_iov_string(&iov[13], fpga_version);
+    cli_iov_string(&iov[14], "\nMCP version: ");
+    cli_iov_string(&iov[15], mcp_version);
+
+    sys_chan_writev(channel, iov, 16);
 
     return 0;
 }
@@ -8,12 +8,21 @@
 #include "simpleio.h"
 #include "cli.h"
 #include "proc.h"
+#include "uart_reg.h"
+#include "xfer.h"
 #include "cli/dos_cmds.h"
 #include "dev/block.h"
 #include "dev/fsys.h"
 #include "dev/kbd_mo.h"
+#include "dev/uart.h"
 #include "fatfs/ff.h"
 
+#define DIR_BATCH_SIZE  1024    /* Size of the buffer for reading directory entries in DIR */
+#define DIR_BATCH_ENTRIES 64    /* Most directory entries to read at once in DIR */
+
+/* The batch of directory entries DIR is working through (too big for the 1KB supervisor stack) */
+static unsigned char dir_records[DIR_BATCH_SIZE];
+
 /*
  * Read a sector off a drive
  *
@@ -289,7 +298,7 @@ short cmd_rename(short screen, int argc, const char * argv[]) {
 short cmd_dir(short screen, int argc, const char * argv[]) {
     short result;
     char buffer[80];
-    t_file_info my_file;
+    unsigned long free_kb;
     char * path = "";
     char label[40];
 
@@ -306,31 +315,44 @@ short cmd_dir(short screen, int argc, const char * argv[]) {
         }
 
         while (1) {
-            short result = fsys_readdir(dir, &my_file);
-            if ((result == 0) && (my_file.name[0] != 0)) {
+            /* Read as many entries as will fit in one call */
+            short count = fsys_readdir_batch(dir, dir_records, DIR_BATCH_SIZE, DIR_BATCH_ENTRIES, FSYS_RECORD_ALL);
+            unsigned char * record = dir_records;
+            short i;
+
+            if (count <= 0) {
+                break;
+            }
+
+            for (i = 0; i < count; i++, record += *(unsigned short *)record) {
+                p_dir_record_attr attr = (p_dir_record_attr)(record + sizeof(unsigned short));
+                char * name = (char *)(record + sizeof(unsigned short) + sizeof(t_dir_record_attr));
 
-                if ((my_file.attributes & AM_HID) == 0) {
-                    if (my_file.attributes & AM_DIR) {
-                        sprintf(buffer, "%s/\n", my_file.name);
+                if ((attr->attributes & AM_HID) == 0) {
+                    if (attr->attributes & AM_DIR) {
+                        sprintf(buffer, "%s/\n", name);
                         chan_write(screen, buffer, strlen(buffer));
 
                     } else {
-                        if (my_file.size < 1024) {
-                            sprintf(buffer, "%-20.20s %d\n", my_file.name, (int)my_file.size);
-                        } else if (my_file.size < 1024*1024) {
-                            sprintf(buffer, "%-20.20s %d KB\n", my_file.name, (int)my_file.size / 1024);
+                        if (attr->size < 1024) {
+                            sprintf(buffer, "%-20.20s %d\n", name, (int)attr->size);
+                        } else if (attr->size < 1024*1024) {
+                            sprintf(buffer, "%-20.20s %d KB\n", name, (int)attr->size / 1024);
                         } else {
-                            sprintf(buffer, "%-29.20s %d MB\n", my_file.name, (int)my_file.size / (1024*1024));
+                            sprintf(buffer, "%-29.20s %d MB\n", name, (int)attr->size / (1024*1024));
                         }
                         chan_write(screen, buffer, strlen(buffer));
                     }
                 }
-            } else {
-                break;
             }
         }
 
         fsys_closedir(dir);
+
+        if (fsys_get_free(path, &free_kb, 0) == 0) {
+            sprintf(buffer, "%lu KB free\n", free_kb);
+            chan_write(screen, buffer, strlen(buffer));
+        }
     } else {
         err_print(screen, "Unable to open directory", dir);
         return dir;
@@ -407,6 +429,105 @@ short cmd_load(short screen, int argc, const char * argv[]) {
     }
 }
 
+/*
+ * Map a speed in bits-per-second to the UART code for it
+ *
+ * Returns:
+ * the UART_* code, 0 if the speed is not supported
+ */
+static unsigned short cmd_bps_code(long bps) {
+    switch (bps) {
+        case 300: return UART_300;
+        case 1200: return UART_1200;
+        case 2400: return UART_2400;
+        case 4800: return UART_4800;
+        case 9600: return UART_9600;
+        case 19200: return UART_19200;
+        case 38400: return UART_38400;
+        case 57600: return UART_57600;
+        case 115200: return UART_115200;
+        default: return 0;
+    }
+}
+
+/*
+ * Receive a binary image over COM1 (sent with c256mgr.py --xfer)
+ *
+ * Hardware flow control is on for the transfer, so the cable must carry RTS and CTS.
+ *
+ * RECEIVE <path> | @<address> [<bps>]
+ */
+short cmd_receive(short screen, int argc, const char * argv[]) {
+    const char * path = 0;
+    uint8_t * address = 0;
+    unsigned long received = 0;
+    unsigned short bps_code = UART_115200;
+    uint8_t bps_bytes[2];
+    uint8_t flow;
+    char message[80];
+    short log_sink;
+    short channel;
+    short result;
+
+    if (argc < 2) {
+        print(screen, "USAGE: RECEIVE <path> | @<address> [<bps>]\n");
+        return -1;
+    }
+
+    if (argv[1][0] == '@') {
+        address = (uint8_t *)cli_eval_number(&argv[1][1]);
+    } else {
+        path = argv[1];
+    }
+
+    if (argc > 2) {
+        bps_code = cmd_bps_code(cli_eval_number(argv[2]));
+        if (bps_code == 0) {
+            print(screen, "Unsupported speed.\n");
+            return -1;
+        }
+    }
+
+    /* The serial log sink shares COM1: send the log to the console until the transfer is over */
+    log_sink = log_getsink();
+    if (log_sink == LOG_SINK_COM1) {
+        log_setsink(LOG_SINK_CHANNEL);
+    }
+
+    channel = chan_open(CDEV_COM1, 0, 0);
+    if (channel < 0) {
+        err_print(screen, "Unable to open COM1", channel);
+        log_setsink(log_sink);
+        return -1;
+    }
+
+    bps_bytes[0] = (bps_code >> 8) & 0xff;
+    bps_bytes[1] = bps_code & 0xff;
+    chan_ioctrl(channel, UART_IOCTRL_BPS, bps_bytes, 2);
+
+    /* The host keeps up to XFER_WINDOW blocks in flight, more than the receive ring holds: have it wait on RTS */
+    flow = UART_FLOW_RTSCTS;
+    chan_ioctrl(channel, UART_IOCTRL_FLOW, &flow, 1);
+
+    print(screen, "Waiting for the host...\n");
+    result = xfer_receive(channel, path, address, &received);
+
+    flow = UART_FLOW_NONE;
+    chan_ioctrl(channel, UART_IOCTRL_FLOW, &flow, 1);
+    chan_close(channel);
+    log_setsink(log_sink);
+
+    if (result) {
+        sprintf(message, "Transfer stopped after %lu bytes", received);
+        err_print(screen, message, result);
+        return -1;
+    }
+
+    sprintf(message, "Received %lu bytes.\n", received);
+    print(screen, message);
+    return 0;
+}
+
 /*
  * Set the label of a drive
  *
@@ -431,19 +552,39 @@ short cmd_label(short screen, int argc, const char * argv[]) {
 /*
  * Format a drive
  *
- * FORMAT <drive #>
+ * FORMAT <drive #> [FAT | FAT32 | EXFAT] [<label>]
  */
 short cmd_format(short screen, int argc, const char * argv[]) {
     if (argc > 1) {
         short drive = cli_eval_number(argv[1]);
-        short result = fsys_mkfs(drive, "");
+        short format = FSYS_FORMAT_ANY;
+        char * label = "";
+        short result;
+
+        if (argc > 2) {
+            if (strcmp(argv[2], "FAT") == 0 || strcmp(argv[2], "fat") == 0) {
+                format = FSYS_FORMAT_FAT;
+            } else if (strcmp(argv[2], "FAT32") == 0 || strcmp(argv[2], "fat32") == 0) {
+                format = FSYS_FORMAT_FAT32;
+            } else if (strcmp(argv[2], "EXFAT") == 0 || strcmp(argv[2], "exfat") == 0) {
+                format = FSYS_FORMAT_EXFAT;
+            } else {
+                label = (char *)argv[2];
+            }
+        }
+
+        if ((argc > 3) && (format != FSYS_FORMAT_ANY)) {
+            label = (char *)argv[3];
+        }
+
+        result = fsys_mkfs(drive, label, format, 0);
         if (result != 0) {
             err_print(screen, "Unable to format volume", result);
             return -1;
         }
 
     } else {
-        print(screen, "USAGE: FORMAT <drive #>\n");
+        print(screen, "USAGE: FORMAT <drive #> [FAT | FAT32 | EXFAT] [<label>]\n");
         return -1;
     }
 }
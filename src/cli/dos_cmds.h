@@ -55,6 +55,13 @@ extern short cmd_type(short screen, int argc, const char * argv[]);
  */
 extern short cmd_load(short screen, int argc, const char * argv[]);
 
+/*
+ * Receive a binary image over COM1 into a file or memory
+ *
+ * RECEIVE <path> | @<address> [<bps>]
+ */
+extern short cmd_receive(short screen, int argc, const char * argv[]);
+
 /*
  * Read a sector off a drive
  *
@@ -80,7 +87,7 @@ extern short cmd_label(short screen, int argc, const char * argv[]);
 /*
  * Format a drive
  *
- * FORMAT <drive #>
+ * FORMAT <drive #> [FAT | FAT32 | EXFAT] [<label>]
  */
 extern short cmd_format(short screen, int argc, const char * argv[]);
 
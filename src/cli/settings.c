@@ -270,6 +270,125 @@ short cli_sof_get(short channel, char * buffer, short size) {
     return 0;
 }
 
+/*
+ * Text shadow setter -- SET SHADOW 1|0
+ */
+short cli_shadow_set(short channel, const char * value) {
+    char message[80];
+    short result;
+
+    if (strcmp(value, "1") == 0) {
+        result = text_set_shadow(0, 1);
+        if (result) {
+            sprintf(message, "Unable to turn on the text shadow: %s\n", err_message(result));
+        } else {
+            sprintf(message, "Text shadow enabled.\n");
+        }
+
+    } else if (strcmp(value, "0") == 0) {
+        text_set_shadow(0, 0);
+        sprintf(message, "Text shadow disabled.\n");
+
+    } else {
+        sprintf(message, "USAGE: SET SHADOW 0|1\n");
+    }
+
+    sys_chan_write(channel, message, strlen(message));
+    return 0;
+}
+
+/*
+ * Text shadow getter
+ */
+short cli_shadow_get(short channel, char * buffer, short size) {
+    sprintf(buffer, "%d", (text_get_shadow(0) > 0) ? 1 : 0);
+    return 0;
+}
+
+/*
+ * Log sink setter -- SET LOGSINK CONSOLE|COM1
+ */
+short cli_logsink_set(short channel, const char * value) {
+    char message[80];
+    short result;
+
+    if ((strcmp(value, "COM1") == 0) || (strcmp(value, "com1") == 0)) {
+        result = log_setsink(LOG_SINK_COM1);
+        if (result) {
+            sprintf(message, "Unable to log to COM1: %s\n", err_message(result));
+        } else {
+            sprintf(message, "Logging to COM1 at 115200 bps.\n");
+        }
+
+    } else if ((strcmp(value, "CONSOLE") == 0) || (strcmp(value, "console") == 0)) {
+        log_setsink(LOG_SINK_CHANNEL);
+        sprintf(message, "Logging to the console.\n");
+
+    } else {
+        sprintf(message, "USAGE: SET LOGSINK CONSOLE|COM1\n");
+    }
+
+    sys_chan_write(channel, message, strlen(message));
+    return 0;
+}
+
+/*
+ * Log sink getter
+ */
+short cli_logsink_get(short channel, char * value, short size) {
+    if (log_getsink() == LOG_SINK_COM1) {
+        sprintf(value, "COM1 (%lu records dropped)", log_dropped_count());
+    } else {
+        sprintf(value, "CONSOLE");
+    }
+
+    return 0;
+}
+
+/*
+ * Scrollback setter -- SET SCROLLBACK <lines>
+ */
+short cli_scrollback_set(short channel, const char * value) {
+    char message[80];
+    const char * digit;
+    short lines = 0;
+    short result;
+
+    /* Take only a plain decimal count in range */
+    for (digit = value; isdigit(*digit) && (lines <= TEXT_HISTORY_MAX); digit++) {
+        lines = lines * 10 + (*digit - '0');
+    }
+
+    if ((digit == value) || (*digit != 0) || (lines > TEXT_HISTORY_MAX)) {
+        sprintf(message, "USAGE: SET SCROLLBACK <lines> (0 to %d)\n", TEXT_HISTORY_MAX);
+
+    } else {
+        result = text_set_history(0, lines);
+        if (result) {
+            sprintf(message, "Unable to set the scrollback: %s\n", err_message(result));
+        } else {
+            sprintf(message, "Scrollback set to %d lines.\n", lines);
+        }
+    }
+
+    sys_chan_write(channel, message, strlen(message));
+    return 0;
+}
+
+/*
+ * Scrollback getter
+ */
+short cli_scrollback_get(short channel, char * buffer, short size) {
+    short lines = text_get_history(0);
+
+    if (lines < 0) {
+        return lines;
+    }
+
+    sprintf(buffer, "%d", lines);
+    return 0;
+}
+
 /*
  * RTC setter
  */
@@ -511,6 +630,9 @@ void cli_set_init() {
     // cli_set_register("SOF", "SOF 1|0 -- Enable or disable the Start of Frame interrupt", cli_sof_set, cli_sof_get);
     cli_set_register("FONT", "FONT <path> -- set a font for the display", cli_font_set, cli_font_get);
     cli_set_register("KEYBOARD", "KEYBOARD <path> -- set the keyboard layout", cli_layout_set, cli_layout_get);
+    cli_set_register("LOGSINK", "LOGSINK CONSOLE|COM1 -- print log messages, or queue them with timestamps for COM1", cli_logsink_set, cli_logsink_get);
+    cli_set_register("SCROLLBACK", "SCROLLBACK <lines> -- set the lines of history kept for SHIFT-PgUp (0 for none)", cli_scrollback_set, cli_scrollback_get);
+    cli_set_register("SHADOW", "SHADOW 1|0 -- Draw the screen in RAM and update it once a frame", cli_shadow_set, cli_shadow_get);
     cli_set_register("TIME", "TIME HH:MM:SS -- set the time in the realtime clock", cli_time_set, cli_time_get);
     cli_set_register("VOLUME", "VOLUME <0 - 255> -- set the master volume", cli_volume_set, cli_volume_get);
 }
@@ -18,6 +18,8 @@ void bdev_init_system() {
     for (i = 0; i < BDEV_DEVICES_MAX; i++) {
         g_block_devs[i].number = 0;
         g_block_devs[i].name = 0;
+        g_block_devs[i].read_blocks = 0;
+        g_block_devs[i].write_blocks = 0;
     }
 }
 
@@ -42,6 +44,8 @@ short bdev_register(p_dev_block device) {
         bdev->status = device->status;
         bdev->flush = device->flush;
         bdev->ioctrl = device->ioctrl;
+        bdev->read_blocks = device->read_blocks;
+        bdev->write_blocks = device->write_blocks;
         return 0;
     } else {
         return DEV_ERR_BADDEV;
@@ -121,6 +125,100 @@ short bdev_write(short dev, long lba, const unsigned char * buffer, short size)
     }
 }
 
+//
+// Read a run of consecutive blocks from the device
+//
+// Inputs:
+//  dev = the number of the device
+//  lba = the logical block address of the first block to read
+//  buffer = the buffer into which to copy the block data (must hold count * BDEV_BLOCK_SIZE bytes)
+//  count = the number of blocks to read (at most BDEV_BLOCKS_MAX)
+//
+// Returns:
+//  number of blocks read, any negative number is an error code
+//
+short bdev_read_blocks(short dev, unsigned long lba, unsigned char * buffer, short count) {
+    short i;
+    short result;
+
+    TRACE("bdev_read_blocks");
+
+    if ((count < 0) || (count > BDEV_BLOCKS_MAX)) {
+        return DEV_BOUNDS_ERR;
+    }
+
+    if (dev < BDEV_DEVICES_MAX) {
+        p_dev_block bdev = &g_block_devs[dev];
+        if (bdev->number == dev) {
+            if (bdev->read_blocks) {
+                // The driver can move the whole run in one transaction
+                return bdev->read_blocks(lba, buffer, count);
+            }
+
+            for (i = 0; i < count; i++) {
+                result = bdev->read((long)lba++, buffer, BDEV_BLOCK_SIZE);
+                if (result < 0) {
+                    return result;
+                }
+                buffer += BDEV_BLOCK_SIZE;
+            }
+            return count;
+
+        } else {
+            return DEV_ERR_BADDEV;
+        }
+    }
+
+    return DEV_ERR_BADDEV;
+}
+
+//
+// Write a run of consecutive blocks to the device
+//
+// Inputs:
+//  dev = the number of the device
+//  lba = the logical block address of the first block to write
+//  buffer = the buffer containing the data to write (count * BDEV_BLOCK_SIZE bytes)
+//  count = the number of blocks to write (at most BDEV_BLOCKS_MAX)
+//
+// Returns:
+//  number of blocks written, any negative number is an error code
+//
+short bdev_write_blocks(short dev, unsigned long lba, const unsigned char * buffer, short count) {
+    short i;
+    short result;
+
+    TRACE("bdev_write_blocks");
+
+    if ((count < 0) || (count > BDEV_BLOCKS_MAX)) {
+        return DEV_BOUNDS_ERR;
+    }
+
+    if (dev < BDEV_DEVICES_MAX) {
+        p_dev_block bdev = &g_block_devs[dev];
+        if (bdev->number == dev) {
+            if (bdev->write_blocks) {
+                // The driver can move the whole run in one transaction
+                return bdev->write_blocks(lba, buffer, count);
+            }
+
+            for (i = 0; i < count; i++) {
+                result = bdev->write((long)lba++, buffer, BDEV_BLOCK_SIZE);
+                if (result < 0) {
+                    return result;
+                }
+                buffer += BDEV_BLOCK_SIZE;
+            }
+            return count;
+
+        } else {
+            return DEV_ERR_BADDEV;
+        }
+    }
+
+    return DEV_ERR_BADDEV;
+}
+
 //
 // Return the status of the block device
 //
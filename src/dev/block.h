@@ -18,6 +18,9 @@
 #define BDEV_FDC 1
 #define BDEV_HDC 2
 
+#define BDEV_BLOCK_SIZE 512     // The size of a block, as seen by the file system
+#define BDEV_BLOCKS_MAX 128     // The most blocks a single bdev_read_blocks or bdev_write_blocks will move
+
 //
 // Structure defining a block device's functions
 //
@@ -31,6 +34,8 @@ typedef struct s_dev_block {
     FUNC_V_2_S status;      // short status() -- Get the status of the device
     FUNC_V_2_S flush;       // short flush() -- Ensure that any pending writes to teh device have been completed
     FUNC_SBS_2_S ioctrl;    // short ioctrl(short command, byte * buffer, short size)) -- Issue a control command to the device
+    FUNC_ULBS_2_S read_blocks;      // short read_blocks(unsigned long lba, byte * buffer, short count) -- Read consecutive blocks (optional)
+    FUNC_ULcBS_2_S write_blocks;    // short write_blocks(unsigned long lba, byte * buffer, short count) -- Write consecutive blocks (optional)
 } t_dev_block, *p_dev_block;
 
 //
@@ -82,6 +87,40 @@ extern short bdev_read(short dev, long lba, unsigned char * buffer, short size);
 //
 extern short bdev_write(short dev, long lba, const unsigned char * buffer, short size);
 
+//
+// Read a run of consecutive blocks from the device
+//
+// The LBA is unsigned, so the full 32 bits (2TB of 512 byte blocks) may be used.
+// If the driver does not provide read_blocks, the blocks are read one at a time.
+//
+// Inputs:
+//  dev = the number of the device
+//  lba = the logical block address of the first block to read
+//  buffer = the buffer into which to copy the block data (must hold count * BDEV_BLOCK_SIZE bytes)
+//  count = the number of blocks to read (at most BDEV_BLOCKS_MAX)
+//
+// Returns:
+//  number of blocks read, any negative number is an error code
+//
+extern short bdev_read_blocks(short dev, unsigned long lba, unsigned char * buffer, short count);
+
+//
+// Write a run of consecutive blocks to the device
+//
+// The LBA is unsigned, so the full 32 bits (2TB of 512 byte blocks) may be used.
+// If the driver does not provide write_blocks, the blocks are written one at a time.
+//
+// Inputs:
+//  dev = the number of the device
+//  lba = the logical block address of the first block to write
+//  buffer = the buffer containing the data to write (count * BDEV_BLOCK_SIZE bytes)
+//  count = the number of blocks to write (at most BDEV_BLOCKS_MAX)
+//
+// Returns:
+//  number of blocks written, any negative number is an error code
+//
+extern short bdev_write_blocks(short dev, unsigned long lba, const unsigned char * buffer, short count);
+
 //
 // Return the status of the block device
 //
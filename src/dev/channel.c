@@ -6,13 +6,23 @@
  * Examples include: console, serial port, an open file, etc.
  */
 
+#include <string.h>
+
 #include "dev/channel.h"
 #include "errors.h"
 #include "types.h"
 #include "log.h"
+#include "interrupt.h"
+#include "timers.h"
 
 t_dev_chan g_channel_devs[CDEV_DEVICES_MAX];
 t_channel g_channels[CHAN_MAX];
+t_chan_buffer g_chan_buffers[CHAN_BUFFERS_MAX];
+
+static short g_chan_free_head;                      // Slot of the first free channel (-1 if none)
+static short g_chan_next_free[CHAN_MAX];            // For each free slot, the slot of the next free channel (-1 at the end)
+static unsigned short g_chan_generation[CHAN_MAX];  // Current generation of each slot
+static short g_cdev_open[CDEV_DEVICES_MAX];         // Number of channels open on each device
 
 //
 // Initialize the channel driver system
@@ -26,12 +36,31 @@ void cdev_init_system() {
     for (i = 0; i < CDEV_DEVICES_MAX; i++) {
         g_channel_devs[i].number = 0;
         g_channel_devs[i].name = 0;
+        g_channel_devs[i].readv = 0;
+        g_channel_devs[i].writev = 0;
+        g_cdev_open[i] = 0;
     }
 
     // Clear out all the channel records
     for (i = 0; i < CHAN_MAX; i++) {
         g_channels[i].number = -1;
         g_channels[i].dev = -1;
+        g_channels[i].flags = 0;
+        g_channels[i].buffer = 0;
+        g_chan_generation[i] = 1;
+    }
+
+    // Chain the general purpose slots into the free list (the ones below CDEV_FILE are reserved)
+    g_chan_free_head = -1;
+    for (i = CHAN_MAX - 1; i >= CDEV_FILE; i--) {
+        g_chan_next_free[i] = g_chan_free_head;
+        g_chan_free_head = i;
+    }
+
+    // Mark all the channel buffers as free
+    for (i = 0; i < CHAN_BUFFERS_MAX; i++) {
+        g_chan_buffers[i].owner = -1;
+        g_chan_buffers[i].mode = CHAN_BUF_EMPTY;
     }
 }
 
@@ -60,6 +89,8 @@ short cdev_register(p_dev_chan device) {
         cdev->seek = device->seek;
         cdev->flush = device->flush;
         cdev->ioctrl = device->ioctrl;
+        cdev->readv = device->readv;
+        cdev->writev = device->writev;
         return 0;
     } else {
         return DEV_ERR_BADDEV;
@@ -76,24 +107,40 @@ short cdev_register(p_dev_chan device) {
  * A pointer to the free channel, 0 if none are available.
  */
 p_channel chan_alloc(short dev) {
-    int i;
+    p_channel chan;
+    short i;
 
     TRACE("chan_alloc");
 
+    if ((dev < 0) || (dev >= CDEV_DEVICES_MAX)) {
+        return 0;
+    }
+
     if ((dev == CDEV_CONSOLE) || (dev == CDEV_EVID)) {
         /* For CONSOLE and EVID, the channel is always the same number as the device */
-        g_channels[dev].number = dev;
-        g_channels[dev].dev = dev;
-        return &g_channels[dev];
-
-    } else {
-        for (i = CDEV_FILE; i < CHAN_MAX; i++) {
-            if (g_channels[i].number != i) {
-                g_channels[i].number = i;
-                g_channels[i].dev = dev;
-                return &g_channels[i];
-            }
+        chan = &g_channels[dev];
+        if (chan->number != dev) {
+            g_cdev_open[dev]++;
         }
+
+        chan->number = dev;
+        chan->dev = dev;
+        chan->flags = 0;
+        chan->buffer = 0;
+        return chan;
+
+    } else if (g_chan_free_head >= 0) {
+        /* Take the first slot off the free list */
+        i = g_chan_free_head;
+        g_chan_free_head = g_chan_next_free[i];
+
+        chan = &g_channels[i];
+        chan->number = (short)((g_chan_generation[i] << CHAN_INDEX_BITS) | i);
+        chan->dev = dev;
+        chan->flags = 0;
+        chan->buffer = 0;
+        g_cdev_open[dev]++;
+        return chan;
     }
 
     return 0;
@@ -106,10 +153,36 @@ p_channel chan_alloc(short dev) {
 // c = the number of the channel
 //
 // Returns:
-// a pointer to the channel record.
+// a pointer to the channel record, 0 if the channel is not open
 //
 p_channel chan_get_record(short c) {
-    return &g_channels[c];
+    short i;
+
+    if (c >= 0) {
+        i = CHAN_INDEX(c);
+        if ((i < CHAN_MAX) && (g_channels[i].number == c)) {
+            return &g_channels[i];
+        }
+    }
+
+    return 0;
+}
+
+//
+// Return the number of channels open on a device
+//
+// Inputs:
+// dev = the number of the device
+//
+// Returns:
+// the number of open channels, any negative number is an error code
+//
+short cdev_open_count(short dev) {
+    if ((dev >= 0) && (dev < CDEV_DEVICES_MAX)) {
+        return g_cdev_open[dev];
+    }
+
+    return DEV_ERR_BADDEV;
 }
 
 //
@@ -119,12 +192,254 @@ p_channel chan_get_record(short c) {
 // chan = a pointer to the channel record to return to the kernel
 //
 void chan_free(p_channel chan) {
+    short i;
+
     log_num(LOG_INFO, "chan_free: ", chan->number);
 
+    if (chan->number < 0) {
+        /* Already free */
+        return;
+    }
+
+    if (chan->buffer) {
+        /* Give the buffer back to the pool */
+        chan->buffer->owner = -1;
+        chan->buffer->mode = CHAN_BUF_EMPTY;
+        chan->buffer = 0;
+    }
+
+    if ((chan->dev >= 0) && (chan->dev < CDEV_DEVICES_MAX) && (g_cdev_open[chan->dev] > 0)) {
+        g_cdev_open[chan->dev]--;
+    }
+
+    i = (short)(chan - g_channels);
+    if (i >= CDEV_FILE) {
+        /* New generation, so the old number goes stale, then back on the free list */
+        if (++g_chan_generation[i] > CHAN_GEN_MAX) {
+            g_chan_generation[i] = 1;
+        }
+        g_chan_next_free[i] = g_chan_free_head;
+        g_chan_free_head = i;
+    }
+
     chan->number = -1;
     chan->dev = -1;
 }
 
+//
+// Give a channel a read/write buffer
+//
+// Inputs:
+// chan = a pointer to the channel record to buffer
+//
+// Returns:
+// 0 on success, ERR_OUT_OF_HANDLES if no buffer is free (the channel stays unbuffered)
+//
+short chan_buffer_attach(p_channel chan) {
+    int i;
+
+    if (chan->buffer) {
+        return 0;
+    }
+
+    for (i = 0; i < CHAN_BUFFERS_MAX; i++) {
+        if (g_chan_buffers[i].owner < 0) {
+            g_chan_buffers[i].owner = chan->number;
+            g_chan_buffers[i].mode = CHAN_BUF_EMPTY;
+            g_chan_buffers[i].head = 0;
+            g_chan_buffers[i].tail = 0;
+            chan->buffer = &g_chan_buffers[i];
+            return 0;
+        }
+    }
+
+    return ERR_OUT_OF_HANDLES;
+}
+
+//
+// Bring the device up to date with the channel's buffer
+//
+// Pending writes are sent to the device. Read-ahead that has not been consumed
+// is given back by seeking the device backwards, so that its position matches
+// what the caller has seen. Afterwards the buffer is empty.
+//
+// The device may take pending writes a piece at a time, so they are sent until
+// all of them are gone. If the device fails, the bytes it has not taken stay in
+// the buffer for the next attempt.
+//
+// Inputs:
+// chan = the channel
+// cdev = the channel's device
+//
+// Returns:
+// 0 on success, any negative number is an error code
+//
+static short chan_buffer_sync(p_channel chan, p_dev_chan cdev) {
+    p_chan_buffer buf = chan->buffer;
+    short result = 0;
+    short count;
+
+    count = buf->tail - buf->head;
+    if (count > 0) {
+        if (buf->mode == CHAN_BUF_WRITE) {
+            while (buf->head < buf->tail) {
+                result = cdev->write(chan, &buf->data[buf->head], buf->tail - buf->head);
+                if (result < 0) {
+                    return result;
+                } else if (result == 0) {
+                    return DEV_CANNOT_WRITE;
+                }
+                buf->head += result;
+            }
+            result = 0;
+
+        } else if ((buf->mode == CHAN_BUF_READ) && cdev->seek) {
+            result = cdev->seek(chan, -(long)count, CDEV_SEEK_RELATIVE);
+        }
+    }
+
+    buf->mode = CHAN_BUF_EMPTY;
+    buf->head = 0;
+    buf->tail = 0;
+    return result;
+}
+
+//
+// Read a byte through the channel's buffer, refilling it from the device if needed
+//
+// Returns:
+// the byte read, DEV_EOF at the end of the data, any other negative number is an error code
+//
+static short chan_buffer_getc(p_channel chan, p_dev_chan cdev) {
+    p_chan_buffer buf = chan->buffer;
+    short count;
+
+    if ((buf->mode != CHAN_BUF_READ) || (buf->head >= buf->tail)) {
+        if (buf->mode == CHAN_BUF_WRITE) {
+            count = chan_buffer_sync(chan, cdev);
+            if (count < 0) {
+                return count;
+            }
+        }
+
+        count = cdev->read(chan, buf->data, CHAN_BUFFER_SIZE);
+        if (count <= 0) {
+            buf->mode = CHAN_BUF_EMPTY;
+            buf->head = 0;
+            buf->tail = 0;
+            return (count == 0) ? DEV_EOF : count;
+        }
+
+        buf->mode = CHAN_BUF_READ;
+        buf->head = 0;
+        buf->tail = count;
+    }
+
+    return buf->data[buf->head++];
+}
+
+//
+// Read bytes through the channel's buffer
+//
+// Any read-ahead is handed over first, and the rest is read straight from the device.
+//
+// Returns:
+// number of bytes read, any negative number is an error code
+//
+static short chan_buffer_read(p_channel chan, p_dev_chan cdev, uint8_t * buffer, short size) {
+    p_chan_buffer buf = chan->buffer;
+    short count = 0;
+    short res;
+
+    if (buf->mode == CHAN_BUF_READ) {
+        count = buf->tail - buf->head;
+        if (count > size) {
+            count = size;
+        }
+        memcpy(buffer, &buf->data[buf->head], count);
+        buf->head += count;
+        if (count == size) {
+            return count;
+        }
+
+    } else if (buf->mode == CHAN_BUF_WRITE) {
+        res = chan_buffer_sync(chan, cdev);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    res = cdev->read(chan, buffer + count, size - count);
+    if (res < 0) {
+        return (count > 0) ? count : res;
+    }
+    return count + res;
+}
+
+//
+// Write bytes through the channel's buffer
+//
+// Small writes join the pending data, and anything as big as the buffer goes straight to the device.
+//
+// Returns:
+// number of bytes written, any negative number is an error code
+//
+static short chan_buffer_write(p_channel chan, p_dev_chan cdev, const uint8_t * buffer, short size) {
+    p_chan_buffer buf = chan->buffer;
+    short res;
+
+    if ((buf->mode == CHAN_BUF_WRITE) && (buf->tail + size <= CHAN_BUFFER_SIZE)) {
+        memcpy(&buf->data[buf->tail], buffer, size);
+        buf->tail += size;
+        return size;
+    }
+
+    res = chan_buffer_sync(chan, cdev);
+    if (res < 0) {
+        return res;
+    }
+
+    if (size < CHAN_BUFFER_SIZE) {
+        memcpy(buf->data, buffer, size);
+        buf->mode = CHAN_BUF_WRITE;
+        buf->tail = size;
+        return size;
+    }
+
+    return cdev->write(chan, buffer, size);
+}
+
+//
+// Write a byte through the channel's buffer, spilling it to the device when full
+//
+// Returns:
+// 0 on success, any negative number is an error code
+//
+static short chan_buffer_putc(p_channel chan, p_dev_chan cdev, uint8_t b) {
+    p_chan_buffer buf = chan->buffer;
+    short result;
+
+    if (buf->mode != CHAN_BUF_WRITE) {
+        if (buf->mode == CHAN_BUF_READ) {
+            result = chan_buffer_sync(chan, cdev);
+            if (result < 0) {
+                return result;
+            }
+        }
+        buf->mode = CHAN_BUF_WRITE;
+
+    } else if (buf->tail >= CHAN_BUFFER_SIZE) {
+        result = chan_buffer_sync(chan, cdev);
+        if (result < 0) {
+            return result;
+        }
+        buf->mode = CHAN_BUF_WRITE;
+    }
+
+    buf->data[buf->tail++] = b;
+    return 0;
+}
+
 //
 // Find the records for the channel and the channel's device, given the channel number
 //
@@ -137,8 +452,8 @@ void chan_free(p_channel chan) {
 //   0 on success, a negative number on error
 //
 short chan_get_records(short channel, p_channel * chan, p_dev_chan * cdev) {
-    if (channel < CHAN_MAX) {
-        *chan = &g_channels[channel];
+    if ((channel >= 0) && (CHAN_INDEX(channel) < CHAN_MAX)) {
+        *chan = &g_channels[CHAN_INDEX(channel)];
         if ((*chan)->number == channel) {
             if ((*chan)->dev < CDEV_DEVICES_MAX) {
                 *cdev = &g_channel_devs[(*chan)->dev];
@@ -149,8 +464,9 @@ short chan_get_records(short channel, p_channel * chan, p_dev_chan * cdev) {
             }
 
         } else {
+            /* The slot is free, or was reused since this number was handed out */
             log_num(LOG_ERROR, "chan_get_records 2: ", channel);
-            return DEV_ERR_BADDEV;
+            return ERR_BAD_HANDLE;
         }
 
     } else {
@@ -227,21 +543,37 @@ short chan_open(short dev, const uint8_t * path, short mode) {
 /*
  * Close a channel
  *
+ * The channel is freed even if flushing its buffer or closing the device fails.
+ *
  * Inputs:
  * chan = the number of the channel to close
  *
  * Returns:
- * nothing useful
+ * 0 on success, otherwise the first error from flushing the buffer or closing the device
  */
 short chan_close(short channel) {
     p_channel chan;
     p_dev_chan cdev;
+    short result = 0;
+    short res;
+
     if (chan_get_records(channel, &chan, &cdev) == 0) {
-        cdev->close(chan);
+        if (chan->buffer) {
+            result = chan_buffer_sync(chan, cdev);
+            if (result > 0) {
+                result = 0;
+            }
+        }
+
+        res = cdev->close(chan);
+        if ((result == 0) && (res < 0)) {
+            result = res;
+        }
+
         chan_free(chan);
     }
 
-    return 0;
+    return result;
 }
 
 //
@@ -265,6 +597,9 @@ short chan_read(short channel, uint8_t * buffer, short size) {
     res = chan_get_records(channel, &chan, &cdev);
     if (res == 0) {
         log2(LOG_DEBUG, "chan_read: ", cdev->name);
+        if (chan->buffer) {
+            return chan_buffer_read(chan, cdev, buffer, size);
+        }
         return cdev->read(chan, buffer, size);
     } else {
         log_num(LOG_DEBUG, "Couldn't get channel: ", res);
@@ -290,6 +625,24 @@ short chan_readline(short channel, uint8_t * buffer, short size) {
 
     res = chan_get_records(channel, &chan, &cdev);
     if (res == 0) {
+        if (chan->buffer) {
+            /* Assemble the line from the buffer, keeping the newline like f_gets does */
+            short count = 0;
+            while (count < size - 1) {
+                res = chan_buffer_getc(chan, cdev);
+                if (res == DEV_EOF) {
+                    break;
+                } else if (res < 0) {
+                    return res;
+                }
+                buffer[count++] = (uint8_t)res;
+                if (res == '\n') {
+                    break;
+                }
+            }
+            buffer[count] = 0;
+            return count;
+        }
         return cdev->readline(chan, buffer, size);
     } else {
         return res;
@@ -304,7 +657,7 @@ short chan_readline(short channel, uint8_t * buffer, short size) {
 //  channel = the number of the channel
 //
 // Returns:
-//  the value read (if negative, error)
+//  the value read, DEV_EOF at the end of the data (any other negative number is an error)
 //
 short chan_read_b(short channel) {
     p_channel chan;
@@ -313,6 +666,9 @@ short chan_read_b(short channel) {
 
     res = chan_get_records(channel, &chan, &cdev);
     if (res == 0) {
+        if (chan->buffer) {
+            return chan_buffer_getc(chan, cdev);
+        }
         return cdev->read_b(chan);
     } else {
         return res;
@@ -339,6 +695,9 @@ short chan_write(short channel, const uint8_t * buffer, short size) {
 
     res = chan_get_records(channel, &chan, &cdev);
     if (res == 0) {
+        if (chan->buffer) {
+            return chan_buffer_write(chan, cdev, buffer, size);
+        }
         return cdev->write(chan, buffer, size);
     } else {
         log_num(LOG_ERROR, "chan_write error: ", res);
@@ -366,6 +725,9 @@ short chan_write_b(short channel, uint8_t b) {
 
     res = chan_get_records(channel, &chan, &cdev);
     if (res == 0) {
+        if (chan->buffer) {
+            return chan_buffer_putc(chan, cdev, b);
+        }
         return cdev->write_b(chan, b);
     } else {
         return res;
@@ -373,6 +735,108 @@ short chan_write_b(short channel, uint8_t b) {
 }
 
 
+//
+// Read bytes from the channel into several buffers
+//
+// Inputs:
+//  channel = the number of the channel
+//  iov = array of buffers to fill
+//  count = the number of entries in iov
+//
+// Returns:
+//  total number of bytes read, any negative number is an error code
+//
+short chan_readv(short channel, p_chan_iovec iov, short count) {
+    p_channel chan;
+    p_dev_chan cdev;
+    short total = 0;
+    short res;
+    short i;
+
+    TRACE("chan_readv");
+
+    res = chan_get_records(channel, &chan, &cdev);
+    if (res != 0) {
+        return res;
+    }
+
+    if ((chan->buffer == 0) && cdev->readv) {
+        /* The device can do the whole thing itself */
+        return cdev->readv(chan, iov, count);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (chan->buffer) {
+            res = chan_buffer_read(chan, cdev, iov[i].buffer, iov[i].size);
+        } else {
+            res = cdev->read(chan, iov[i].buffer, iov[i].size);
+        }
+
+        if (res < 0) {
+            return (total > 0) ? total : res;
+        }
+
+        total += res;
+        if (res < iov[i].size) {
+            /* Ran out of data */
+            break;
+        }
+    }
+
+    return total;
+}
+
+//
+// Write bytes to the channel from several buffers
+//
+// Inputs:
+//  channel = the number of the channel
+//  iov = array of buffers to write
+//  count = the number of entries in iov
+//
+// Returns:
+//  total number of bytes written, any negative number is an error code
+//
+short chan_writev(short channel, p_chan_iovec iov, short count) {
+    p_channel chan;
+    p_dev_chan cdev;
+    short total = 0;
+    short res;
+    short i;
+
+    TRACE("chan_writev");
+
+    res = chan_get_records(channel, &chan, &cdev);
+    if (res != 0) {
+        return res;
+    }
+
+    if ((chan->buffer == 0) && cdev->writev) {
+        /* The device can do the whole thing itself */
+        return cdev->writev(chan, iov, count);
+    }
+
+    /* On a buffered channel, the pieces collect in the buffer and reach the device together */
+    for (i = 0; i < count; i++) {
+        if (chan->buffer) {
+            res = chan_buffer_write(chan, cdev, iov[i].buffer, iov[i].size);
+        } else {
+            res = cdev->write(chan, iov[i].buffer, iov[i].size);
+        }
+
+        if (res < 0) {
+            return (total > 0) ? total : res;
+        }
+
+        total += res;
+        if (res < iov[i].size) {
+            break;
+        }
+    }
+
+    return total;
+}
+
 //
 // Return the status of the channel device
 //
@@ -389,12 +853,82 @@ short chan_status(short channel) {
 
     res = chan_get_records(channel, &chan, &cdev);
     if (res == 0) {
-        return cdev->status(chan);
+        res = cdev->status(chan);
+        if ((res >= 0) && chan->buffer && (chan->buffer->mode == CHAN_BUF_READ) && (chan->buffer->head < chan->buffer->tail)) {
+            /* The device may be at its end, but the caller has not seen the read-ahead yet */
+            res = (res & ~CDEV_STAT_EOF) | CDEV_STAT_READABLE;
+        }
+        return res;
     } else {
         return res;
     }
 }
 
+//
+// Wait until at least one of a set of channels is ready
+//
+// Inputs:
+//  channel_set = array of channel numbers to watch (entries of -1 are ignored).
+//                On return, the channels that are not ready are replaced by -1.
+//  count = the number of entries in channel_set (at most CHAN_MAX)
+//  events = the status bits to wait for (CDEV_STAT_READABLE, CDEV_STAT_WRITABLE)
+//  timeout_jiffies = how long to wait: 0 to check once, negative to wait forever
+//
+// Returns:
+//  the number of ready channels (0 on timeout), any negative number is an error code
+//
+short chan_poll(short * channel_set, short count, short events, long timeout_jiffies) {
+    uint8_t is_ready[CHAN_MAX];
+    long target_jiffies = 0;
+    short ready;
+    short status;
+    short i;
+
+    TRACE("chan_poll");
+
+    if ((count < 0) || (count > CHAN_MAX)) {
+        return DEV_BOUNDS_ERR;
+    }
+
+    if (timeout_jiffies > 0) {
+        target_jiffies = timers_jiffies() + timeout_jiffies;
+    }
+
+    /* End of file and errors always count: a read would not block */
+    events |= CDEV_STAT_EOF | CDEV_STAT_ERROR;
+
+    while (1) {
+        ready = 0;
+        for (i = 0; i < count; i++) {
+            is_ready[i] = 0;
+            if (channel_set[i] >= 0) {
+                status = chan_status(channel_set[i]);
+                if ((status < 0) || (status & events)) {
+                    /* A bad channel counts as ready, so the caller finds out about it */
+                    is_ready[i] = 1;
+                    ready++;
+                }
+            }
+        }
+
+        if (ready > 0) {
+            for (i = 0; i < count; i++) {
+                if (!is_ready[i]) {
+                    channel_set[i] = -1;
+                }
+            }
+            return ready;
+        }
+
+        if ((timeout_jiffies == 0) || ((timeout_jiffies > 0) && (timers_jiffies() >= target_jiffies))) {
+            return 0;
+        }
+
+        /* Nothing yet: sleep until an interrupt (at worst the next SOF jiffy) might have changed things */
+        int_wait();
+    }
+}
+
 //
 // Ensure that any pending writes to teh device have been completed
 //
@@ -411,6 +945,12 @@ short chan_flush(short channel) {
 
     res = chan_get_records(channel, &chan, &cdev);
     if (res == 0) {
+        if (chan->buffer) {
+            res = chan_buffer_sync(chan, cdev);
+            if (res < 0) {
+                return res;
+            }
+        }
         return cdev->flush(chan);
     } else {
         return res;
@@ -436,6 +976,12 @@ short chan_seek(short channel, long position, short base) {
 
     res = chan_get_records(channel, &chan, &cdev);
     if (res == 0) {
+        if (chan->buffer) {
+            res = chan_buffer_sync(chan, cdev);
+            if (res < 0) {
+                return res;
+            }
+        }
         return cdev->seek(chan, position, base);
     } else {
         return res;
@@ -461,6 +1007,25 @@ short chan_ioctrl(short channel, short command, uint8_t * buffer, short size) {
 
     res = chan_get_records(channel, &chan, &cdev);
     if (res == 0) {
+        switch (command) {
+            case CHAN_IOCTRL_NONBLOCK_ON:
+                chan->flags |= CHAN_FLAG_NONBLOCK;
+                return 0;
+
+            case CHAN_IOCTRL_NONBLOCK_OFF:
+                chan->flags &= ~CHAN_FLAG_NONBLOCK;
+                return 0;
+
+            default:
+                break;
+        }
+
+        if (chan->buffer) {
+            res = chan_buffer_sync(chan, cdev);
+            if (res < 0) {
+                return res;
+            }
+        }
         return cdev->ioctrl(chan, command, buffer, size);
     } else {
         return res;
@@ -15,9 +15,36 @@
  * Preset channel device numbers
  */
 
-#define CDEV_DEVICES_MAX    8       // The maximum number of channel devices we will support
-#define CHAN_MAX            16      // The maximum number of open channels we will support
+#define CDEV_DEVICES_MAX    16      // The maximum number of channel devices we will support
+
+#ifndef CHAN_MAX
+#define CHAN_MAX            16      // The maximum number of open channels we will support (at most CHAN_INDEX_MASK + 1)
+#endif
+
+#ifndef CHAN_DATA_SIZE
 #define CHAN_DATA_SIZE      32      // The number of bytes in the channel's data area
+#endif
+
+/*
+ * Channel handles
+ *
+ * The low bits of a channel number select the slot in the channel table. The
+ * bits above hold the slot's generation, which changes every time the slot is
+ * freed, so a stale channel number is rejected without searching. The console
+ * and EVID channels are generation 0, so their numbers match their devices.
+ */
+
+#define CHAN_INDEX_BITS     6                               // Bits of the channel number used for the table slot
+#define CHAN_INDEX_MASK     ((1 << CHAN_INDEX_BITS) - 1)    // Mask for the table slot
+#define CHAN_GEN_MAX        (0x7fff >> CHAN_INDEX_BITS)     // Largest generation (keeps channel numbers positive)
+
+#define CHAN_INDEX(c)       ((c) & CHAN_INDEX_MASK)         // Get the table slot of a channel number
+
+#if CHAN_MAX > CHAN_INDEX_MASK + 1
+#error "CHAN_MAX is too large for CHAN_INDEX_BITS"
+#endif
+#define CHAN_BUFFERS_MAX    8       // The number of read/write buffers channels may borrow
+#define CHAN_BUFFER_SIZE    256     // The number of bytes in a channel read/write buffer
 
 #define CDEV_CONSOLE 0
 #define CDEV_EVID 1
@@ -26,6 +53,8 @@
 #define CDEV_LPT 4
 #define CDEV_MIDI 5
 #define CDEV_FILE 6
+#define CDEV_PIPE 7
+#define CDEV_MOUSE 8
 
 /*
  * Channel status bits
@@ -36,10 +65,47 @@
 #define CDEV_STAT_READABLE  0x04    // The channel has data to read (read will not block)
 #define CDEV_STAT_WRITABLE  0x08    // The channel can accept data (write will not block)
 
+/*
+ * Channel flags
+ */
+
+#define CHAN_FLAG_NONBLOCK  0x0001  // Reads and writes return DEV_WOULD_BLOCK instead of waiting
+
+/*
+ * Control commands handled by the channel layer for every device (see chan_ioctrl)
+ */
+
+#define CHAN_IOCTRL_NONBLOCK_ON     0x7F01  // Put the channel in non-blocking mode
+#define CHAN_IOCTRL_NONBLOCK_OFF    0x7F02  // Put the channel back in blocking mode
+
 #define CDEV_SEEK_START     0       /* Seek from the start of the file */
 #define CDEV_SEEK_RELATIVE  1       /* Seek from the current position */
 #define CDEV_SEEK_END       2       /* Seek from teh end of the file */
 
+/*
+ * What a channel's buffer is currently holding
+ */
+
+#define CHAN_BUF_EMPTY      0       // Nothing is buffered
+#define CHAN_BUF_READ       1       // The buffer holds bytes read ahead from the device
+#define CHAN_BUF_WRITE      2       // The buffer holds bytes not yet written to the device
+
+/*
+ * Structure defining a channel's read/write buffer
+ *
+ * A buffer holds either read-ahead data or pending writes, never both.
+ * Bytes between head and tail are the ones not yet consumed (reading)
+ * or not yet sent to the device (writing).
+ */
+
+typedef struct s_chan_buffer {
+    short owner;                    // The number of the channel using the buffer (-1 if free)
+    short mode;                     // What the buffer is holding (CHAN_BUF_EMPTY, CHAN_BUF_READ, CHAN_BUF_WRITE)
+    short head;                     // Index of the first byte not yet consumed
+    short tail;                     // Index just past the last byte in the buffer
+    uint8_t data[CHAN_BUFFER_SIZE]; // The buffered bytes
+} t_chan_buffer, *p_chan_buffer;
+
 /*
  * Structure defining a channel
  */
@@ -47,15 +113,27 @@
 typedef struct s_channel {
     short number;                   // The number of the channel
     short dev;                      // The number of the channel's device
+    short flags;                    // CHAN_FLAG_* settings for the channel
+    p_chan_buffer buffer;           // The channel's read/write buffer (0 if the channel is not buffered)
     uint8_t data[CHAN_DATA_SIZE];   // A block of state data that the channel code can use for its own purposes
 } t_channel, *p_channel;
 
+/*
+ * One piece of a vectored read or write (see chan_readv and chan_writev)
+ */
+
+typedef struct s_chan_iovec {
+    uint8_t * buffer;               // The bytes to write, or where to put the bytes read
+    short size;                     // The number of bytes in this piece
+} t_chan_iovec, *p_chan_iovec;
+
 typedef short (*FUNC_CBS_2_S)(p_channel, uint8_t *, short);
 typedef short (*FUNC_C_2_S)(p_channel);
 typedef short (*FUNC_CcBS_2_S)(p_channel, const uint8_t *, short);
 typedef short (*FUNC_CB_2_S)(p_channel, uint8_t);
 typedef short (*FUNC_CLS_2_S)(p_channel, long, short);
 typedef short (*FUNC_CSBS_2_S)(p_channel, short, uint8_t *, short);
+typedef short (*FUNC_CVS_2_S)(p_channel, p_chan_iovec, short);
 
 /*
  * Structure defining a channel device's functions
@@ -76,6 +154,11 @@ typedef struct s_dev_chan {
     FUNC_C_2_S flush;       // short flush(t_channel *) -- Ensure that any pending writes to teh device have been completed
     FUNC_CLS_2_S seek;      // short cdev_seek(t_channel *, long position, short base) -- attempt to move the "cursor" position in the channel
     FUNC_CSBS_2_S ioctrl;   // short ioctrl(t_channel *, short command, uint8_t * buffer, short size)) -- Issue a control command to the device
+
+    /* Added after the original layout: new entries go at the end, so the offsets above do not move */
+
+    FUNC_CVS_2_S readv;     // short readv(t_channel *, t_chan_iovec * iov, short count) -- Read into several buffers (optional)
+    FUNC_CVS_2_S writev;    // short writev(t_channel *, t_chan_iovec * iov, short count) -- Write from several buffers (optional)
 } t_dev_chan, *p_dev_chan;
 
 /*
@@ -94,10 +177,13 @@ extern short cdev_register(p_dev_chan device);
 /*
  * Get a free channel
  *
+ * Inputs:
+ * dev = the device to associate with the channel
+ *
  * Returns:
  * A pointer to the free channel, 0 if none are available.
  */
-extern p_channel chan_alloc();
+extern p_channel chan_alloc(short dev);
 
 /*
  * Return a channel to the pool of unused channels
@@ -107,6 +193,25 @@ extern p_channel chan_alloc();
  */
 extern void chan_free(p_channel chan);
 
+/*
+ * Give a channel a read/write buffer
+ *
+ * Once buffered, chan_read_b, chan_write_b, and chan_readline are served from
+ * the buffer, and the device's read and write routines are only called to fill
+ * or empty the buffer in bulk. Pending writes are sent to the device on
+ * chan_flush, chan_seek, chan_ioctrl, and chan_close. A device driver calls this
+ * from its open routine if its channels benefit from buffering. If the channel
+ * will be both read and written, the device must support relative seeks, so
+ * that read-ahead can be given back before writing.
+ *
+ * Inputs:
+ * chan = a pointer to the channel record to buffer
+ *
+ * Returns:
+ * 0 on success, ERR_OUT_OF_HANDLES if no buffer is free (the channel stays unbuffered)
+ */
+extern short chan_buffer_attach(p_channel chan);
+
 /*
  * Return a pointer to the channel record for a given channel handle.
  *
@@ -114,10 +219,21 @@ extern void chan_free(p_channel chan);
  * c = the number of the channel
  *
  * Returns:
- * a pointer to the channel record.
+ * a pointer to the channel record, 0 if the channel is not open
  */
 extern p_channel chan_get_record(short c);
 
+/*
+ * Return the number of channels open on a device
+ *
+ * Inputs:
+ * dev = the number of the device
+ *
+ * Returns:
+ * the number of open channels, any negative number is an error code
+ */
+extern short cdev_open_count(short dev);
+
 /*
  * Initialize the device
  *
@@ -145,11 +261,13 @@ extern short chan_open(short dev, const uint8_t * path, short mode);
 /*
  * Close a channel
  *
+ * The channel is freed even if flushing its buffer or closing the device fails.
+ *
  * Inputs:
  * chan = the number of the channel to close
  *
  * Returns:
- * nothing useful
+ * 0 on success, otherwise the first error from flushing the buffer or closing the device
  */
 extern short chan_close(short chan);
 
@@ -186,7 +304,7 @@ extern short chan_readline(short channel, uint8_t * buffer, short size);
  *  channel = the number of the channel
  *
  * Returns:
- *  the value read (if negative, error)
+ *  the value read, DEV_EOF at the end of the data (any other negative number is an error)
  */
 extern short chan_read_b(short channel);
 
@@ -215,6 +333,37 @@ extern short chan_write(short channel, const uint8_t * buffer, short size);
  */
 extern short chan_write_b(short channel, uint8_t b);
 
+/*
+ * Read bytes from the channel into several buffers
+ *
+ * The buffers are filled in order. Reading stops early if the device returns
+ * fewer bytes than a buffer asked for.
+ *
+ * Inputs:
+ *  channel = the number of the channel
+ *  iov = array of buffers to fill
+ *  count = the number of entries in iov
+ *
+ * Returns:
+ *  total number of bytes read, any negative number is an error code
+ */
+extern short chan_readv(short channel, p_chan_iovec iov, short count);
+
+/*
+ * Write bytes to the channel from several buffers
+ *
+ * The buffers are written in order, as if they were one.
+ *
+ * Inputs:
+ *  channel = the number of the channel
+ *  iov = array of buffers to write
+ *  count = the number of entries in iov
+ *
+ * Returns:
+ *  total number of bytes written, any negative number is an error code
+ */
+extern short chan_writev(short channel, p_chan_iovec iov, short count);
+
 /*
  * Return the status of the channel device
  *
@@ -226,6 +375,25 @@ extern short chan_write_b(short channel, uint8_t b);
  */
 extern short chan_status(short channel);
 
+/*
+ * Wait until at least one of a set of channels is ready
+ *
+ * A channel is ready if its status has any of the requested event bits, or if
+ * it is at end of file or in error (a read would not block). Between checks,
+ * the CPU sleeps until the next interrupt, so waiting does not burn the CPU.
+ *
+ * Inputs:
+ *  channel_set = array of channel numbers to watch (entries of -1 are ignored).
+ *                On return, the channels that are not ready are replaced by -1.
+ *  count = the number of entries in channel_set (at most CHAN_MAX)
+ *  events = the status bits to wait for (CDEV_STAT_READABLE, CDEV_STAT_WRITABLE)
+ *  timeout_jiffies = how long to wait: 0 to check once, negative to wait forever
+ *
+ * Returns:
+ *  the number of ready channels (0 on timeout), any negative number is an error code
+ */
+extern short chan_poll(short * channel_set, short count, short events, long timeout_jiffies);
+
 /*
  * Ensure that any pending writes to teh device have been completed
  *
@@ -254,6 +422,10 @@ extern short chan_seek(short channel, long position, short base);
 /*
  * Issue a control command to the device
  *
+ * The CHAN_IOCTRL_NONBLOCK_* commands are handled here for every device: in
+ * non-blocking mode, a read or write that would have to wait returns
+ * DEV_WOULD_BLOCK instead (or the count of bytes moved, if some could be).
+ *
  * Inputs:
  *  channel = the number of the channel
  *  command = the number of the command to send
@@ -5,11 +5,11 @@
  *
  */
 
-#include <ctype.h>
 #include <string.h>
 #include "log.h"
 #include "types.h"
 #include "constants.h"
+#include "errors.h"
 #include "dev/channel.h"
 #include "dev/console.h"
 #include "dev/ps2.h"
@@ -17,30 +17,69 @@
 #include "dev/text_screen_iii.h"
 #include "simpleio.h"
 
-#define ANSI_BUFFER_SIZE    16
+#if MODEL == MODEL_FOENIX_A2560K
+#include "dev/lpt.h"
+#endif
+
 #define MAX_ANSI_ARGS       10
 
 #define CON_CTRL_ANSI       0x80            /* Set to enable ANSI escape processing */
 #define CON_IOCTRL_ANSI_ON  0x01            /* IOCTRL Command: turn on ANSI terminal codes */
 #define CON_IOCTRL_ANSI_OFF 0x02            /* IOCTRL Command: turn off ANSI terminal codes */
 
-typedef void (*ansi_handler)(p_channel, short, short[]);
+/*
+ * States of the ANSI escape sequence parser
+ */
+#define ANSI_ST_GROUND      0               /* Not in an escape sequence: characters are printed */
+#define ANSI_ST_ESCAPE      1               /* Got an ESC */
+#define ANSI_ST_CSI_ENTRY   2               /* Got ESC [ */
+#define ANSI_ST_CSI_PARAM   3               /* Collecting the arguments of a control sequence */
+#define ANSI_ST_CSI_INTER   4               /* Got an intermediate byte in a control sequence */
+#define ANSI_ST_CSI_IGNORE  5               /* Malformed control sequence: skip to its final byte */
+#define ANSI_STATES         6
 
 /*
- * Structure to map an ANSI escape sequence pattern to a handler
+ * Classes of characters, as far as the parser is concerned
  */
-typedef struct s_ansi_seq {
-    char code;
-    ansi_handler handler;
-} t_ansi_seq, *p_ansi_seq;
+#define ANSI_CL_CONTROL     0               /* C0 control characters (except ESC) */
+#define ANSI_CL_ESC         1               /* ESC */
+#define ANSI_CL_INTER       2               /* Intermediate bytes: space to / */
+#define ANSI_CL_DIGIT       3               /* 0 to 9 */
+#define ANSI_CL_SEMI        4               /* ; (argument separator) */
+#define ANSI_CL_COLON       5               /* : (sub-argument separator, not supported) */
+#define ANSI_CL_PRIVATE     6               /* Private markers: < = > ? */
+#define ANSI_CL_BRACKET     7               /* [ */
+#define ANSI_CL_FINAL       8               /* Final bytes: @ to ~ (other than [) */
+#define ANSI_CL_DEL         9               /* DEL */
+#define ANSI_CL_HIGH        10              /* 0x80 - 0xFF (graphics characters) */
+#define ANSI_CLASSES        11
+
+/*
+ * Actions the parser takes on a character
+ */
+#define ANSI_AC_NONE        0               /* Ignore the character */
+#define ANSI_AC_PRINT       1               /* Send the character to the screen */
+#define ANSI_AC_CLEAR       2               /* Start a new control sequence */
+#define ANSI_AC_PARAM       3               /* Add the character to the arguments */
+#define ANSI_AC_PRIVATE     4               /* Record the private marker */
+#define ANSI_AC_DISPATCH    5               /* Run the handler for the final byte */
+
+/* A transition: the action in the high nybble, the next state in the low */
+#define ANSI_T(action, state)   (((action) << 4) | (state))
+
+typedef void (*ansi_handler)(p_channel, short, short[]);
 
 /*
  * Structure to track console state
+ *
+ * NOTE: this lives in the channel's data area, so it must fit in CHAN_DATA_SIZE bytes
  */
 typedef struct s_console_data {
     unsigned char control;              /* Control flags for the console: e.g. process ANSI codes */
-    unsigned char ansi_buffer_count;    /* Number of characters in the ANSI BUFFER */
-    char ansi_buffer[ANSI_BUFFER_SIZE]; /* Used to keep track of characters in the ANSI escape sequences */
+    unsigned char ansi_state;           /* State of the escape sequence parser (ANSI_ST_*) */
+    char ansi_private;                  /* Private marker of the current sequence (e.g. '?'), 0 if none */
+    unsigned char ansi_arg;             /* Index of the argument being collected */
+    short ansi_args[MAX_ANSI_ARGS];     /* The arguments of the current sequence */
     char key_buffer;                    /* Used to peek at keyboard input */
 } t_console_data, *p_console_data;
 
@@ -58,27 +97,136 @@ extern void ansi_el(p_channel chan, short arg_count, short args[]);
 extern void ansi_ich(p_channel chan, short arg_count, short args[]);
 extern void ansi_dch(p_channel chan, short arg_count, short args[]);
 extern void ansi_sgr(p_channel chan, short arg_count, short args[]);
+extern void ansi_decset(p_channel chan, short arg_count, short args[]);
+extern void ansi_decrst(p_channel chan, short arg_count, short args[]);
 static short con_flush(p_channel chan);
+extern short con_has_input(p_channel chan);
 
 /*
  * Console variables and constants
  */
 
 /*
- * ANSI escape sequences
+ * Parser transitions, indexed by the current state and the class of the character
  */
-const t_ansi_seq ansi_sequence[] = {
-    { '@', ansi_ich },
-    { 'A', ansi_cuu },
-    { 'B', ansi_cud },
-    { 'C', ansi_cuf },
-    { 'D', ansi_cub },
-    { 'J', ansi_ed },
-    { 'K', ansi_el },
-    { 'P', ansi_dch },
-    { 'H', ansi_cup },
-    { 'm', ansi_sgr },
-    { 0, 0 }
+static const unsigned char ansi_transitions[ANSI_STATES][ANSI_CLASSES] = {
+    /* ANSI_ST_GROUND */
+    {
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND),          /* Control */
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_ESCAPE),           /* ESC */
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND),          /* Intermediate */
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND),          /* Digit */
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND),          /* ; */
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND),          /* : */
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND),          /* Private marker */
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND),          /* [ */
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND),          /* Final */
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND),          /* DEL */
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND)           /* High */
+    },
+
+    /* ANSI_ST_ESCAPE */
+    {
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_ESCAPE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_ESCAPE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_ESCAPE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND),           /* ESC sequences other than CSI are ignored */
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_CLEAR, ANSI_ST_CSI_ENTRY),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_ESCAPE),
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_GROUND)
+    },
+
+    /* ANSI_ST_CSI_ENTRY */
+    {
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_CSI_ENTRY),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_ESCAPE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_INTER),
+        ANSI_T(ANSI_AC_PARAM, ANSI_ST_CSI_PARAM),
+        ANSI_T(ANSI_AC_PARAM, ANSI_ST_CSI_PARAM),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_PRIVATE, ANSI_ST_CSI_PARAM),
+        ANSI_T(ANSI_AC_DISPATCH, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_DISPATCH, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_ENTRY),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND)
+    },
+
+    /* ANSI_ST_CSI_PARAM */
+    {
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_CSI_PARAM),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_ESCAPE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_INTER),
+        ANSI_T(ANSI_AC_PARAM, ANSI_ST_CSI_PARAM),
+        ANSI_T(ANSI_AC_PARAM, ANSI_ST_CSI_PARAM),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),       /* Private markers only come first */
+        ANSI_T(ANSI_AC_DISPATCH, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_DISPATCH, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_PARAM),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND)
+    },
+
+    /* ANSI_ST_CSI_INTER: no sequences with intermediate bytes are supported */
+    {
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_CSI_INTER),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_ESCAPE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_INTER),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_INTER),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND)
+    },
+
+    /* ANSI_ST_CSI_IGNORE */
+    {
+        ANSI_T(ANSI_AC_PRINT, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_ESCAPE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_CSI_IGNORE),
+        ANSI_T(ANSI_AC_NONE, ANSI_ST_GROUND)
+    }
+};
+
+/*
+ * Handlers for control sequences, indexed by the final byte minus '@'
+ */
+static const ansi_handler ansi_csi_handlers[64] = {
+    ansi_ich, ansi_cuu, ansi_cud, ansi_cuf, ansi_cub, 0, 0, 0,          /* @ A B C D E F G */
+    ansi_cup, 0, ansi_ed, ansi_el, 0, 0, 0, 0,                          /* H I J K L M N O */
+    ansi_dch, 0, 0, 0, 0, 0, 0, 0,                                      /* P Q R S T U V W */
+    0, 0, 0, 0, 0, 0, 0, 0,                                             /* X Y Z [ \ ] ^ _ */
+    0, 0, 0, 0, 0, 0, ansi_cup, 0,                                      /* ` a b c d e f g */
+    0, 0, 0, 0, 0, ansi_sgr, 0, 0,                                      /* h i j k l m n o */
+    0, 0, 0, 0, 0, 0, 0, 0,                                             /* p q r s t u v w */
+    0, 0, 0, 0, 0, 0, 0, 0                                              /* x y z { | } ~ DEL */
+};
+
+/*
+ * Handlers for private (ESC [ ? ...) control sequences, indexed by the final byte minus '@'
+ */
+static const ansi_handler ansi_private_handlers[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0,                                             /* @ A B C D E F G */
+    0, 0, 0, 0, 0, 0, 0, 0,                                             /* H I J K L M N O */
+    0, 0, 0, 0, 0, 0, 0, 0,                                             /* P Q R S T U V W */
+    0, 0, 0, 0, 0, 0, 0, 0,                                             /* X Y Z [ \ ] ^ _ */
+    0, 0, 0, 0, 0, 0, 0, 0,                                             /* ` a b c d e f g */
+    ansi_decset, 0, 0, 0, ansi_decrst, 0, 0, 0,                         /* h i j k l m n o */
+    0, 0, 0, 0, 0, 0, 0, 0,                                             /* p q r s t u v w */
+    0, 0, 0, 0, 0, 0, 0, 0                                              /* x y z { | } ~ DEL */
 };
 
 /*
@@ -101,90 +249,92 @@ short ansi_start_code(char c) {
 }
 
 /*
- * Find the escape sequence pattern that matches what we've collected.
- *
- * If one is found, execute it.
- * If one is not found, just dump the ANSI buffer
+ * Return the parser's class for a character (ANSI_CL_*)
  */
-void ansi_match_pattern(p_channel chan, p_console_data con_data) {
-    char c;
-    short argc = 0;
-    short arg[MAX_ANSI_ARGS];
-    short i, j;
-
-    TRACE("ansi_match_pattern");
-
-    /* Clear out the argument list */
-    for (i = 0; i < MAX_ANSI_ARGS; i++) {
-        arg[i] = 0;
-    }
-
-    /* Make sure we have an escape sequence */
-    if ((con_data->ansi_buffer[0] != '\x1b') || (con_data->ansi_buffer[1] != '[')) {
-        /* If not, dump the buffer and return */
-        con_flush(chan);
-        return;
+static short ansi_class(unsigned char c) {
+    if (c < 0x20) {
+        return (c == 0x1b) ? ANSI_CL_ESC : ANSI_CL_CONTROL;
+    } else if (c < 0x30) {
+        return ANSI_CL_INTER;
+    } else if (c < 0x3a) {
+        return ANSI_CL_DIGIT;
+    } else if (c == ';') {
+        return ANSI_CL_SEMI;
+    } else if (c == ':') {
+        return ANSI_CL_COLON;
+    } else if (c < 0x40) {
+        return ANSI_CL_PRIVATE;
+    } else if (c == '[') {
+        return ANSI_CL_BRACKET;
+    } else if (c < 0x7f) {
+        return ANSI_CL_FINAL;
+    } else if (c == 0x7f) {
+        return ANSI_CL_DEL;
+    } else {
+        return ANSI_CL_HIGH;
     }
+}
 
-    /* Try to assemble the arguments */
-    for (i = 2, argc = 0; i < con_data->ansi_buffer_count - 1; i++) {
-        c = con_data->ansi_buffer[i];
-        if (isdigit(c)) {
-            /* If the character is a digit, add it to the current argument */
-            arg[argc] = arg[argc] * 10 + (c - '0');
+/*
+ * Feed a character to the ANSI escape sequence parser
+ *
+ * Printable characters and controls go to the screen, and control sequences
+ * are executed as soon as their final byte arrives.
+ */
+void ansi_process_c(p_channel chan, p_console_data con_data, char c) {
+    unsigned char transition = ansi_transitions[con_data->ansi_state][ansi_class((unsigned char)c)];
+    ansi_handler handler;
+    short i;
 
-        } else if (c == ';') {
-            /* If it's a semi-colon, start the next argument */
-            argc++;
-        }
-    }
+    con_data->ansi_state = transition & 0x0f;
 
-    argc++;
+    switch (transition >> 4) {
+        case ANSI_AC_PRINT:
+            text_put_raw(chan->dev, c);
+            break;
 
-    /* Get the last character... should be the code */
-    c = con_data->ansi_buffer[con_data->ansi_buffer_count - 1];
+        case ANSI_AC_CLEAR:
+            /* Starting a control sequence: forget the last one's arguments */
+            con_data->ansi_private = 0;
+            con_data->ansi_arg = 0;
+            for (i = 0; i < MAX_ANSI_ARGS; i++) {
+                con_data->ansi_args[i] = 0;
+            }
+            break;
 
-    /* Try to find the matching escape code */
-    for (i = 0; ansi_sequence[i].code != 0; i++) {
-        if (ansi_sequence[i].code == c) {
-            ansi_handler handler = ansi_sequence[i].handler;
-            if (handler != 0) {
-                /* If we found the handler... call it */
-                handler(chan, argc, arg);
-                return;
+        case ANSI_AC_PARAM:
+            if (c == ';') {
+                /* Start the next argument (extra ones are dropped) */
+                if (con_data->ansi_arg < MAX_ANSI_ARGS - 1) {
+                    con_data->ansi_arg++;
+                }
+            } else if (con_data->ansi_args[con_data->ansi_arg] < 3276) {
+                /* Add the digit to the current argument (stopping short of overflow) */
+                con_data->ansi_args[con_data->ansi_arg] = con_data->ansi_args[con_data->ansi_arg] * 10 + (c - '0');
             }
-        }
-    }
+            break;
 
-    /* We got to the end without a match... dump the buffer */
-    con_flush(chan);
-}
+        case ANSI_AC_PRIVATE:
+            con_data->ansi_private = c;
+            break;
 
-/*
- * Add a character to the ANSI buffer... and process when an escape sequence is found
- */
-void ansi_process_c(p_channel chan, p_console_data con_data, char c) {
-    TRACE("ansi_process_c");
-
-    if (c == '\x1B') {
-        /* Start the escape sequence */
-        con_data->ansi_buffer[0] = c;
-        con_data->ansi_buffer_count = 1;
-
-    } else if (con_data->ansi_buffer_count > 0) {
-        /* We're processing an escape sequence... add the character to the buffer */
-        con_data->ansi_buffer[con_data->ansi_buffer_count++] = c;
-
-        /* Check to see if we just wrote the trigger */
-        if (((c >= '@') && (c <= 'Z')) ||
-            ((c >= 'a') && (c <= 'z'))) {
-            ansi_match_pattern(chan, con_data);
-            con_data->ansi_buffer_count = 0;
-        }
+        case ANSI_AC_DISPATCH:
+            /* Find the handler for the final byte... unknown sequences are dropped */
+            if (con_data->ansi_private == '?') {
+                handler = ansi_private_handlers[c - '@'];
+            } else if (con_data->ansi_private == 0) {
+                handler = ansi_csi_handlers[c - '@'];
+            } else {
+                handler = 0;
+            }
 
-    } else {
-        /* Not working on a sequence... so just print it */
-        text_put_raw(chan->dev, c);
+            if (handler) {
+                handler(chan, con_data->ansi_arg + 1, con_data->ansi_args);
+            }
+            break;
+
+        default:
+            break;
     }
 }
 
@@ -324,7 +474,7 @@ void ansi_el(p_channel chan, short arg_count, short args[]) {
  * ANSI Handler: insert a character
  */
 void ansi_ich(p_channel chan, short arg_count, short args[]) {
-    unsigned short n = 2;
+    unsigned short n = 1;
 
     TRACE("ansi_ich");
 
@@ -332,6 +482,8 @@ void ansi_ich(p_channel chan, short arg_count, short args[]) {
         n = args[0];
     }
 
+    if (n == 0) n = 1;
+
     text_insert(chan->dev, n);
 }
 
@@ -339,7 +491,7 @@ void ansi_ich(p_channel chan, short arg_count, short args[]) {
  * ANSI Handler: delete a character
  */
 void ansi_dch(p_channel chan, short arg_count, short args[]) {
-    unsigned short n = 2;
+    unsigned short n = 1;
 
     TRACE("ansi_dch");
 
@@ -347,6 +499,8 @@ void ansi_dch(p_channel chan, short arg_count, short args[]) {
         n = args[0];
     }
 
+    if (n == 0) n = 1;
+
     text_delete(chan->dev, n);
 }
 
@@ -397,6 +551,36 @@ void ansi_sgr(p_channel chan, short argc, short args[]) {
     text_set_color(chan->dev, foreground, background);
 }
 
+/*
+ * Set a private mode (ESC [ ? n h)... only 25 (show the cursor) is supported
+ */
+void ansi_decset(p_channel chan, short argc, short args[]) {
+    short i;
+
+    TRACE("ansi_decset");
+
+    for (i = 0; i < argc; i++) {
+        if (args[i] == 25) {
+            text_set_cursor_visible(chan->dev, 1);
+        }
+    }
+}
+
+/*
+ * Reset a private mode (ESC [ ? n l)... only 25 (hide the cursor) is supported
+ */
+void ansi_decrst(p_channel chan, short argc, short args[]) {
+    short i;
+
+    TRACE("ansi_decrst");
+
+    for (i = 0; i < argc; i++) {
+        if (args[i] == 25) {
+            text_set_cursor_visible(chan->dev, 0);
+        }
+    }
+}
+
 //
 // Initialize the console... nothing needs to happen here
 //
@@ -425,9 +609,11 @@ short con_open(p_channel chan, const uint8_t * path, short mode) {
 
     con_data = (p_console_data)&(chan->data);
     con_data->control = CON_CTRL_ANSI;
-    con_data->ansi_buffer_count = 0;
-    for (i = 0; i < ANSI_BUFFER_SIZE; i++) {
-        con_data->ansi_buffer[i] = 0;
+    con_data->ansi_state = ANSI_ST_GROUND;
+    con_data->ansi_private = 0;
+    con_data->ansi_arg = 0;
+    for (i = 0; i < MAX_ANSI_ARGS; i++) {
+        con_data->ansi_args[i] = 0;
     }
     con_data->key_buffer = 0;
 
@@ -437,22 +623,14 @@ short con_open(p_channel chan, const uint8_t * path, short mode) {
 /*
  * Flush the output to the console...
  *
- * Really only does something if the console is set to process ANSI escape codes
+ * Output is not buffered, so this just drops any partial escape sequence
  *
  */
 static short con_flush(p_channel chan) {
-    int i;
     p_console_data con_data;
 
     con_data = (p_console_data)&(chan->data);
-    if (con_data->control & CON_CTRL_ANSI) {
-        for (i = 0; i < con_data->ansi_buffer_count; i++) {
-            text_put_raw(chan->dev, con_data->ansi_buffer[i]);
-            con_data->ansi_buffer[i] = 0;
-        }
-    }
-
-    con_data->ansi_buffer_count = 0;
+    con_data->ansi_state = ANSI_ST_GROUND;
     return 0;
 }
 
@@ -487,9 +665,9 @@ short con_write_b(p_channel chan, uint8_t b) {
 }
 
 /*
- * Attempt to read from the keyboard.
+ * Wait for a key from the keyboard and echo it to the screen
  */
-short con_read_b(p_channel chan) {
+static short con_wait_key(p_channel chan) {
     p_console_data con_data;
 
     /* Check to see if we need to process ANSI codes */
@@ -504,6 +682,9 @@ short con_read_b(p_channel chan) {
         } else {
 
 #if MODEL == MODEL_FOENIX_A2560K
+            /* Keep a spooled print job moving while we wait */
+            lpt_spool_service();
+
 #ifdef KBD_POLLED
             ps2_mouse_get_packet();
             c = kbdmo_getc_poll();
@@ -521,22 +702,42 @@ short con_read_b(p_channel chan) {
 
     } while (c == 0);
 
+    // A key press brings the screen back from the scrollback
+    text_history_page(chan->dev, TEXT_HISTORY_LIVE);
+
     // Echo the character to the screen
     con_write_b(chan, c);
 
     return (short)(c & 0x00ff);
 }
 
+/*
+ * Attempt to read from the keyboard.
+ *
+ * In non-blocking mode, returns DEV_WOULD_BLOCK if no key is waiting.
+ */
+short con_read_b(p_channel chan) {
+    if ((chan->flags & CHAN_FLAG_NONBLOCK) && !con_has_input(chan)) {
+        return DEV_WOULD_BLOCK;
+    }
+
+    return con_wait_key(chan);
+}
+
 
 //
 // Attempt to read a buffer's worth of bytes from the keyboard
 //
+// In non-blocking mode, returns the keys that were waiting (DEV_WOULD_BLOCK if none were)
+//
 short con_read(p_channel chan, uint8_t * buffer, short size) {
     int i;
 
     for (i = 0; i < size; i++) {
         short c = con_read_b(chan);
-        if (c < 0) {
+        if (c == DEV_WOULD_BLOCK) {
+            return (i > 0) ? i : c;
+        } else if (c < 0) {
             return c;
         } else if (c > 0) {
             buffer[i] = (uint8_t)(c & 0xff);
@@ -549,13 +750,14 @@ short con_read(p_channel chan, uint8_t * buffer, short size) {
 //
 // Attempt to read a line of text from the keyboard (stops at buffer size or newline)
 //
-// This routine also allows for some basic line editing
+// This routine also allows for some basic line editing. It always waits for the
+// end of the line, even if the channel is in non-blocking mode.
 //
 short con_readline(p_channel chan, uint8_t * buffer, short size) {
     int i = 0;
 
     while (i < size - 1) {
-        short c = con_read_b(chan);
+        short c = con_wait_key(chan);
         if (c < 0) {
             // Return the error, if we got one
             return c;
@@ -598,23 +800,40 @@ short con_readline(p_channel chan, uint8_t * buffer, short size) {
 //
 // Write a string of bytes to the console.
 //
-// Terminates writing bytes at a null.
+// Terminates writing bytes at a null. The screen never makes the caller wait,
+// so this is the same in blocking and non-blocking modes.
+//
+// Runs of printable characters outside of an escape sequence are handed to the
+// text driver in one go; everything else goes through con_write_b.
 //
 // Inputs:
 //  buffer = the string of bytes
 //  size = the number of bytes to write
 //
 short con_write(p_channel chan, const uint8_t * buffer, short size) {
-    int i;
+    p_console_data con_data;
+    short i = 0;
+    short end;
 
     TRACE("con_write");
 
-    for (i = 0; i < size; i++) {
-        char c = (char)buffer[i];
+    con_data = (p_console_data)&(chan->data);
+
+    while (i < size) {
+        uint8_t c = buffer[i];
         if (c == 0) {
             break;
+
+        } else if ((c >= ' ') && (((con_data->control & CON_CTRL_ANSI) == 0) || (con_data->ansi_state == ANSI_ST_GROUND))) {
+            /* Find the end of the run of printable characters */
+            for (end = i + 1; (end < size) && (buffer[end] >= ' '); end++) ;
+
+            text_put_run(chan->dev, (const char *)&buffer[i], end - i);
+            i = end;
+
         } else {
             con_write_b(chan, c);
+            i++;
         }
     }
 
@@ -635,6 +854,19 @@ short con_has_input(p_channel chan) {
     } else {
         /* Otherwise, peek at the keyboard to see if there is a valid key */
 
+    #ifndef KBD_POLLED
+        /* Interrupt driven: if nothing has come in, don't bother with the translation path */
+    #if MODEL == MODEL_FOENIX_A2560K
+        if (!kbdmo_input_pending()) {
+            return 0;
+        }
+    #else
+        if (!kbd_input_pending()) {
+            return 0;
+        }
+    #endif
+    #endif
+
     #if MODEL == MODEL_FOENIX_A2560K
     #ifdef KBD_POLLED
                 ps2_mouse_get_packet();
@@ -726,6 +958,8 @@ short con_install() {
     dev.seek = con_seek;
     dev.status = con_status;
     dev.ioctrl = con_ioctrl;
+    dev.readv = 0;
+    dev.writev = 0;
 
     result = cdev_register(&dev);
     if (result) {
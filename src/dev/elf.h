@@ -39,6 +39,46 @@ typedef enum {
 	PT_TLS
 } progtype_t;
 
+#define SHT_NULL	 0	    // Inactive section header
+#define SHT_PROGBITS 1	    // Program defined contents
+#define SHT_SYMTAB	 2	    // Symbol table
+#define SHT_STRTAB	 3	    // String table
+#define SHT_RELA	 4	    // Relocations with explicit addends
+#define SHT_NOBITS	 8	    // Occupies no space in the file (BSS)
+#define SHT_REL		 9	    // Relocations without explicit addends
+
+#define SHF_WRITE	 0x1	// Section is writable
+#define SHF_ALLOC	 0x2	// Section occupies memory when loaded
+#define SHF_EXECINSTR 0x4	// Section contains code
+
+#define SHN_UNDEF	 0	    // Undefined section
+#define SHN_ABS		 0xfff1	// Absolute symbol value
+#define SHN_COMMON	 0xfff2	// Common block (not allocated yet)
+
+#define STB_LOCAL	 0	    // Local symbol
+#define STB_GLOBAL	 1	    // Global symbol
+#define STB_WEAK	 2	    // Weak symbol
+
+#define ELF32_ST_BIND(i)	((i) >> 4)
+#define ELF32_R_SYM(i)		((i) >> 8)
+#define ELF32_R_TYPE(i)		((unsigned char)(i))
+
+#define DT_NULL		 0	    // End of the dynamic section
+#define DT_SYMTAB	 6	    // Address of the dynamic symbol table
+#define DT_RELA		 7	    // Address of the RELA relocations
+#define DT_RELASZ	 8	    // Total size of the RELA relocations
+#define DT_RELAENT	 9	    // Size of one RELA relocation
+#define DT_SYMENT	 11	    // Size of one symbol table entry
+
+#define R_68K_NONE	 0	    // No relocation
+#define R_68K_32	 1	    // Direct 32 bit
+#define R_68K_16	 2	    // Direct 16 bit
+#define R_68K_8		 3	    // Direct 8 bit
+#define R_68K_PC32	 4	    // PC relative 32 bit
+#define R_68K_PC16	 5	    // PC relative 16 bit
+#define R_68K_PC8	 6	    // PC relative 8 bit
+#define R_68K_RELATIVE 22	// Adjust by the load address
+
 typedef enum {
 	HDATA_NONE = 0,
 	HDATA_LITTLE,
@@ -83,4 +123,37 @@ typedef struct {
     unsigned long	align;
 } elf32_program_header;
 
+typedef struct {
+    unsigned long	name;
+    unsigned long	type;
+    unsigned long	flags;
+    unsigned long	addr;
+    unsigned long	offset;
+    unsigned long	size;
+    unsigned long	link;
+    unsigned long	info;
+    unsigned long	addralign;
+    unsigned long	entsize;
+} elf32_section_header;
+
+typedef struct {
+    unsigned long	name;
+    unsigned long	value;
+    unsigned long	size;
+    unsigned char	info;
+    unsigned char	other;
+    unsigned short	shndx;
+} elf32_symbol;
+
+typedef struct {
+    unsigned long	offset;
+    unsigned long	info;
+    long			addend;
+} elf32_rela;
+
+typedef struct {
+    long			tag;
+    unsigned long	val;
+} elf32_dyn;
+
 #endif
@@ -19,12 +19,27 @@
 #include "log.h"
 #include "syscalls.h"
 #include "simpleio.h"
+#include "memory.h"
+#include "proc.h"
+#include "timers.h"
 
 #define MAX_DRIVES      8       /* Maximum number of drives */
 #define MAX_DIRECTORIES 8       /* Maximum number of open directories */
 #define MAX_FILES       8       /* Maximum number of open files */
 #define MAX_LOADERS     10      /* Maximum number of file loaders */
 #define MAX_EXT         4
+#define FREEMAP_MAX     0x20000 /* Largest free cluster map we will build, in bytes (1M clusters) */
+#define FREEMAP_TAG     0x7f00  /* First memory tag for the free cluster maps (one per drive) */
+#define DIRCACHE_SIZE   64      /* Number of entries in the directory entry cache (must be a power of 2) */
+#define ELF_MAX_LOAD    16      /* Maximum number of PT_LOAD segments in an ELF file */
+#define ELF_READ_CHUNK  0x4000  /* Largest block to read from an ELF file in one chan_read */
+#define ELF_CHUNK_SIZE  384     /* Size of the buffer for streaming ELF symbols and relocations */
+#define ELF_TAG_SYMBOLS 0x7fff  /* Memory tag for the ELF loader's symbol table scratch space */
+
+#define ELF_RELOC_NONE  0       /* Relocation type is not supported */
+#define ELF_RELOC_ABS   1       /* Relocation value is S + A */
+#define ELF_RELOC_PC    2       /* Relocation value is S + A - P */
+#define ELF_RELOC_BASE  3       /* Relocation value is B + A */
 
 static const char *const elf_cpu_desc[] = {
 	"NONE","M32","SPARC","386","68K","88K","IAMCU","860","MIPS","S370",
@@ -38,6 +53,50 @@ static const char *const elf_cpu_desc[] = {
  * Types
  */
 
+typedef struct s_elf_reloc_kind {
+    unsigned char mode;                     /* How the value is computed (ELF_RELOC_*) */
+    unsigned char size;                     /* The size of the field to patch in bytes */
+} t_elf_reloc_kind;
+
+/* How to apply each m68k relocation type, indexed by the R_68K_* number */
+static const t_elf_reloc_kind elf_reloc_kinds[] = {
+    { ELF_RELOC_ABS, 0 },                   /* R_68K_NONE */
+    { ELF_RELOC_ABS, 4 },                   /* R_68K_32 */
+    { ELF_RELOC_ABS, 2 },                   /* R_68K_16 */
+    { ELF_RELOC_ABS, 1 },                   /* R_68K_8 */
+    { ELF_RELOC_PC, 4 },                    /* R_68K_PC32 */
+    { ELF_RELOC_PC, 2 },                    /* R_68K_PC16 */
+    { ELF_RELOC_PC, 1 },                    /* R_68K_PC8 */
+    { ELF_RELOC_NONE, 0 }, { ELF_RELOC_NONE, 0 }, { ELF_RELOC_NONE, 0 },    /* GOT relative */
+    { ELF_RELOC_NONE, 0 }, { ELF_RELOC_NONE, 0 }, { ELF_RELOC_NONE, 0 },
+    { ELF_RELOC_NONE, 0 }, { ELF_RELOC_NONE, 0 }, { ELF_RELOC_NONE, 0 },    /* PLT relative */
+    { ELF_RELOC_NONE, 0 }, { ELF_RELOC_NONE, 0 }, { ELF_RELOC_NONE, 0 },
+    { ELF_RELOC_NONE, 0 },                  /* R_68K_COPY */
+    { ELF_RELOC_ABS, 4 },                   /* R_68K_GLOB_DAT */
+    { ELF_RELOC_ABS, 4 },                   /* R_68K_JMP_SLOT */
+    { ELF_RELOC_BASE, 4 }                   /* R_68K_RELATIVE */
+};
+
+/*
+ * Where FatFs last found a name in a directory
+ */
+typedef struct s_dircache_entry {
+    FATFS * fs;                             /* The volume (0 if the entry is not in use) */
+    DWORD parent;                           /* The first cluster of the directory holding the entry */
+    DWORD hash;                             /* Hash of the upper case name */
+    DWORD ofs;                              /* Offset of the SFN entry in the directory */
+    DWORD lfn_ofs;                          /* Offset of the first LFN entry (0xFFFFFFFF if none) */
+    BYTE by_lfn;                            /* Was the entry matched by its LFN */
+} t_dircache_entry, *p_dircache_entry;
+
+/*
+ * Map of the free clusters on a FAT volume
+ */
+typedef struct s_freemap {
+    uint8_t * bits;                         /* One bit per cluster, 1 = free (0 if there is no map) */
+    DWORD clusters;                         /* The number of FAT entries covered by the map */
+} t_freemap, *p_freemap;
+
 typedef struct s_loader_record {
     unsigned char status;                   /* Is the loader registered or not */
     char extension[MAX_EXT];                /* The file extension for this file loader */
@@ -56,6 +115,9 @@ FIL g_file[MAX_FILES];                      /* The file descriptors */
 t_dev_chan g_file_dev;                      /* The descriptor to use for the file channels */
 t_loader_record g_file_loader[MAX_LOADERS]; /* Array of file types the loader will understand */
 char g_current_directory[MAX_PATH_LEN];		/* Our current working directory */
+static unsigned short g_load_tag = 0;      /* Memory tag for the pages of the file being loaded */
+t_dircache_entry g_dircache[DIRCACHE_SIZE];  /* The directory entry cache */
+t_freemap g_freemap[MAX_DRIVES];            /* The free cluster map for each logical drive */
 
 /**
  * Convert a FATFS FRESULT code to the Foenix kernel's internal error codes
@@ -75,6 +137,214 @@ short fatfs_to_foenix(FRESULT r) {
     }
 }
 
+/*
+ * Compute the hash of a name for the directory entry cache
+ *
+ * FAT names are not case sensitive, so the hash is over the upper case name.
+ *
+ * Inputs:
+ * name = the name (as an LFN working buffer from FatFs)
+ *
+ * Returns:
+ * the hash of the name
+ */
+static DWORD fsys_dircache_hash(const WCHAR * name) {
+    DWORD hash = 2166136261UL;      /* FNV-1a */
+
+    while (*name) {
+        hash ^= ff_wtoupper(*name++);
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+/*
+ * Find the slot in the directory entry cache for a name in a directory
+ */
+static p_dircache_entry fsys_dircache_slot(DWORD parent, DWORD hash) {
+    return &g_dircache[(hash ^ (parent * 31)) & (DIRCACHE_SIZE - 1)];
+}
+
+/*
+ * Look up where a name was last found in a directory (called by FatFs)
+ *
+ * FatFs checks the directory entry before using it, so a stale or colliding
+ * entry only costs a normal directory scan.
+ *
+ * Inputs:
+ * fs = the volume
+ * sclust = the first cluster of the directory
+ * name = the name to find
+ * ofs = pointer to the offset of the SFN entry (set on a hit)
+ * lfn_ofs = pointer to the offset of the first LFN entry (set on a hit)
+ * by_lfn = pointer to the flag for an LFN match (set on a hit)
+ *
+ * Returns:
+ * 1 if the name was found in the cache, 0 otherwise
+ */
+int ff_dircache_lookup(FATFS * fs, DWORD sclust, const WCHAR * name, DWORD * ofs, DWORD * lfn_ofs, BYTE * by_lfn) {
+    DWORD hash = fsys_dircache_hash(name);
+    p_dircache_entry entry = fsys_dircache_slot(sclust, hash);
+
+    if ((entry->fs == fs) && (entry->parent == sclust) && (entry->hash == hash)) {
+        *ofs = entry->ofs;
+        *lfn_ofs = entry->lfn_ofs;
+        *by_lfn = entry->by_lfn;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Record where a name was found in a directory (called by FatFs)
+ *
+ * Inputs:
+ * fs = the volume
+ * sclust = the first cluster of the directory
+ * name = the name that was found
+ * ofs = the offset of the SFN entry
+ * lfn_ofs = the offset of the first LFN entry (0xFFFFFFFF if none)
+ * by_lfn = 1 if the entry was matched by its LFN, 0 if by its SFN
+ */
+void ff_dircache_store(FATFS * fs, DWORD sclust, const WCHAR * name, DWORD ofs, DWORD lfn_ofs, BYTE by_lfn) {
+    DWORD hash = fsys_dircache_hash(name);
+    p_dircache_entry entry = fsys_dircache_slot(sclust, hash);
+
+    entry->fs = fs;
+    entry->parent = sclust;
+    entry->hash = hash;
+    entry->ofs = ofs;
+    entry->lfn_ofs = lfn_ofs;
+    entry->by_lfn = by_lfn;
+}
+
+/*
+ * Drop entries from the directory entry cache
+ *
+ * Inputs:
+ * fs = the volume to drop entries for (0 for all volumes)
+ */
+static void fsys_dircache_invalidate(FATFS * fs) {
+    short i;
+
+    for (i = 0; i < DIRCACHE_SIZE; i++) {
+        if ((fs == 0) || (g_dircache[i].fs == fs)) {
+            g_dircache[i].fs = 0;
+        }
+    }
+}
+
+/*
+ * Record a change to a FAT entry in the free cluster map (called by FatFs)
+ *
+ * Inputs:
+ * fs = the volume
+ * clst = the cluster whose FAT entry changed
+ * is_free = 1 if the cluster is now free, 0 if it is in use
+ */
+void ff_freemap_update(FATFS * fs, DWORD clst, int is_free) {
+    p_freemap map = &g_freemap[fs - g_drive];
+
+    if ((map->bits != 0) && (clst < map->clusters)) {
+        if (is_free) {
+            map->bits[clst >> 3] |= (1 << (clst & 7));
+        } else {
+            map->bits[clst >> 3] &= ~(1 << (clst & 7));
+        }
+    }
+}
+
+/*
+ * Find the first free cluster in a range of the free cluster map
+ *
+ * Runs of allocated clusters are skipped a long word or a byte at a time.
+ *
+ * Inputs:
+ * map = the free cluster map
+ * from = the first cluster to check
+ * to = the cluster after the last one to check
+ *
+ * Returns:
+ * the number of the free cluster, 0 if there is none in the range
+ */
+static DWORD fsys_freemap_scan(p_freemap map, DWORD from, DWORD to) {
+    DWORD c = from;
+
+    while (c < to) {
+        if ((c & 31) == 0) {
+            /* Skip long words with no free clusters (the map is page aligned) */
+            while ((c + 32 <= to) && (*(unsigned long *)(map->bits + (c >> 3)) == 0)) {
+                c += 32;
+            }
+        }
+
+        if ((c & 7) == 0) {
+            /* Skip bytes with no free clusters */
+            while ((c + 8 <= to) && (map->bits[c >> 3] == 0)) {
+                c += 8;
+            }
+        }
+
+        if (c >= to) {
+            break;
+        }
+
+        if (map->bits[c >> 3] & (1 << (c & 7))) {
+            return c;
+        }
+
+        c++;
+    }
+
+    return 0;
+}
+
+/*
+ * Find a free cluster using the free cluster map (called by FatFs)
+ *
+ * Inputs:
+ * fs = the volume
+ * scl = the cluster to start searching after (the search wraps around)
+ * ncl = pointer to the cluster number found (0 if there are no free clusters)
+ *
+ * Returns:
+ * 1 if the volume has a free cluster map, 0 if FatFs should scan the FAT itself
+ */
+int ff_freemap_find(FATFS * fs, DWORD scl, DWORD * ncl) {
+    p_freemap map = &g_freemap[fs - g_drive];
+    DWORD c;
+
+    if (map->bits == 0) {
+        return 0;
+    }
+
+    c = fsys_freemap_scan(map, scl + 1, map->clusters);
+    if (c == 0) {
+        c = fsys_freemap_scan(map, 2, (scl + 1 < map->clusters) ? scl + 1 : map->clusters);
+    }
+
+    *ncl = c;
+    return 1;
+}
+
+/*
+ * Throw away the free cluster map for a drive
+ *
+ * Inputs:
+ * drive = the number of the drive
+ */
+static void fsys_freemap_drop(short drive) {
+    p_freemap map = &g_freemap[drive];
+
+    if (map->bits) {
+        mem_free(MEM_OWN_KERNEL, (uint32_t)map->bits);
+        map->bits = 0;
+        map->clusters = 0;
+    }
+}
+
 /**
  * Attempt to open a file given the path to the file and the mode.
  *
@@ -115,6 +385,7 @@ short fsys_open(const char * path, short mode) {
         FRESULT result = f_open(&g_file[fd], path, mode);
         if (result == 0) {
             chan->data[0] = fd & 0xff;      /* file handle in the channel data block */
+            chan_buffer_attach(chan);       /* Buffer byte-at-a-time access, if a buffer is free */
             return chan->number;
         } else {
             /* There was an error... deallocate the channel and file descriptor */
@@ -142,17 +413,8 @@ short fsys_open(const char * path, short mode) {
  * 0 on success, negative number on failure
  */
 short fsys_close(short c) {
-    p_channel chan = 0;
-    short fd = 0;
-
-    chan = chan_get_record(c);          /* Get the channel record */
-    fd = chan->data[0];                 /* Get the file descriptor number */
-
-    f_close(&g_file[fd]);               /* Close the file in FATFS */
-    chan_free(chan);                    /* Return the channel to the pool */
-    g_fil_state[fd] = 0;                /* Return the file descriptor to the pool. */
-
-    return 0;
+    /* The channel layer writes out any buffered data and then calls fchan_close */
+    return chan_close(c);
 }
 
 /**
@@ -264,6 +526,96 @@ short fsys_readdir(short dir, p_file_info file) {
     }
 }
 
+/**
+ * Read a batch of entries from an open directory as compact records
+ *
+ * Entries are read until max_entries records have been filled, the end of
+ * the directory is reached, or there is no longer room in the buffer for a
+ * record of the largest possible size.
+ *
+ * Inputs:
+ * dir = the handle of the open directory
+ * buffer = the buffer to fill with the packed records
+ * size = the size of the buffer in bytes
+ * max_entries = the maximum number of records to return
+ * fields = which fields to include (FSYS_RECORD_NAME, FSYS_RECORD_ATTR, or both)
+ *
+ * Returns:
+ * the number of records returned (0 at the end of the directory), negative number on failure
+ */
+short fsys_readdir_batch(short dir, unsigned char * buffer, short size, short max_entries, short fields) {
+    FILINFO finfo;
+    FRESULT fres;
+    short count = 0;
+    short used = 0;
+    short worst = sizeof(unsigned short);
+
+    if ((dir < 0) || (dir >= MAX_DIRECTORIES) || (g_dir_state[dir] == 0)) {
+        return ERR_BAD_HANDLE;
+    }
+
+    fields &= FSYS_RECORD_ALL;
+    if (fields == 0) {
+        fields = FSYS_RECORD_ALL;
+    }
+
+    /* Work out how much room the largest possible record needs */
+    if (fields & FSYS_RECORD_ATTR) {
+        worst += sizeof(t_dir_record_attr);
+    }
+    if (fields & FSYS_RECORD_NAME) {
+        worst += MAX_PATH_LEN;
+    }
+
+    if (size < worst) {
+        return FSYS_ERR_INVALID_PARAMETER;
+    }
+
+    while ((count < max_entries) && (size - used >= worst)) {
+        unsigned char * record = buffer + used;
+        short length = sizeof(unsigned short);
+
+        fres = f_readdir(&g_directory[dir], &finfo);
+        if (fres != FR_OK) {
+            /* Report the error, unless we have records to return first */
+            if (count == 0) {
+                return fatfs_to_foenix(fres);
+            }
+            break;
+        }
+
+        if (finfo.fname[0] == 0) {
+            /* Reached the end of the directory */
+            break;
+        }
+
+        if (fields & FSYS_RECORD_ATTR) {
+            p_dir_record_attr attr = (p_dir_record_attr)(record + length);
+            attr->attributes = finfo.fattrib;
+            attr->reserved = 0;
+            attr->size = finfo.fsize;
+            attr->date = finfo.fdate;
+            attr->time = finfo.ftime;
+            length += sizeof(t_dir_record_attr);
+        }
+
+        if (fields & FSYS_RECORD_NAME) {
+            short name_length = strlen(finfo.fname) + 1;
+            memcpy(record + length, finfo.fname, name_length);
+            length += name_length;
+        }
+
+        /* Keep the records word aligned */
+        length = (length + 1) & ~1;
+        *(unsigned short *)record = length;
+
+        used += length;
+        count++;
+    }
+
+    return count;
+}
+
 /**
  * Open a directory given the path and search for the first file matching the pattern.
  *
@@ -374,6 +726,7 @@ short fsys_mkdir(const char * path) {
     TRACE("fsys_mkdir");
 
     result = f_mkdir(path);
+    fsys_dircache_invalidate(0);
     if (result == FR_OK) {
         return 0;
     } else {
@@ -395,6 +748,7 @@ short fsys_delete(const char * path) {
     FRESULT result;
 
     result = f_unlink(path);
+    fsys_dircache_invalidate(0);
     if (result == FR_OK) {
         return 0;
     } else {
@@ -417,6 +771,7 @@ short fsys_rename(const char * old_path, const char * new_path) {
     FRESULT fres;
 
     fres = f_rename(old_path, new_path);
+    fsys_dircache_invalidate(0);
     if (fres != 0) {
         return fatfs_to_foenix(fres);
     } else {
@@ -468,6 +823,22 @@ short fchan_init() {
     return 0;
 }
 
+/**
+ * Close the file behind a file channel
+ */
+short fchan_close(t_channel * chan) {
+    FRESULT result = FR_OK;
+    short fd;
+
+    fd = chan->data[0];                 /* Get the file descriptor number */
+    if (fd < MAX_FILES) {
+        result = f_close(&g_file[fd]);  /* Close the file in FATFS */
+        g_fil_state[fd] = 0;            /* Return the file descriptor to the pool. */
+    }
+
+    return fatfs_to_foenix(result);
+}
+
 /**
  * Channel driver routines for files.
  */
@@ -532,15 +903,19 @@ short fchan_readline(t_channel * chan, unsigned char * buffer, short size) {
 short fchan_read_b(t_channel * chan) {
     FRESULT result;
     FIL * file;
-    short total_read;
+    UINT total_read;
     char buffer[2];
 
     log(LOG_TRACE, "fchan_read");
 
     file = fchan_to_file(chan);
     if (file) {
-        result = f_read(file, buffer, 1, (UINT*)&total_read);
+        result = f_read(file, buffer, 1, &total_read);
         if (result == FR_OK) {
+            if (total_read == 0) {
+                /* Nothing left in the file */
+                return DEV_EOF;
+            }
             return (short)(buffer[0] & 0x00ff);
         } else {
             return fatfs_to_foenix(result);
@@ -607,10 +982,12 @@ short fchan_status(t_channel * chan) {
 
     file = fchan_to_file(chan);
     if (file) {
-        short status = 0;
+        short status = CDEV_STAT_WRITABLE;      /* Files never make the caller wait */
 
         if (f_eof(file)) {
             status |= CDEV_STAT_EOF;
+        } else {
+            status |= CDEV_STAT_READABLE;
         }
 
         if (f_error(file) != FR_OK) {
@@ -697,6 +1074,10 @@ short fsys_mount(short bdev) {
     drive[1] = ':';
     drive[2] = 0;
 
+    /* Whatever we knew about the old media is no longer valid */
+    fsys_dircache_invalidate(&g_drive[bdev]);
+    fsys_freemap_drop(bdev);
+
     fres = f_mount(&g_drive[bdev], drive, 0);
     if (fres != FR_OK) {
         DEBUG("Unable to mount drive:");
@@ -746,6 +1127,63 @@ short fsys_setlabel(short drive, const char * label) {
     }
 }
 
+/*
+ * Get the free space on the drive holding the path
+ *
+ * The first call for a FAT volume scans the FAT once to build a map of the
+ * free clusters, which FatFs then uses to allocate clusters. After that, the
+ * free count is kept up to date by FatFs and this call does not touch the disk.
+ *
+ * Inputs:
+ * path = path to the drive
+ * free_kb = pointer to the long to fill with the free space in KB
+ * total_kb = pointer to the long to fill with the size of the volume in KB (may be 0)
+ *
+ * Returns:
+ * 0 on success, negative number on failure
+ */
+short fsys_get_free(const char * path, unsigned long * free_kb, unsigned long * total_kb) {
+    FATFS * fs;
+    FRESULT fres;
+    DWORD clusters;
+    short drive;
+
+    fres = f_getfree(path, &clusters, &fs);
+    if (fres != FR_OK) {
+        return fatfs_to_foenix(fres);
+    }
+
+    drive = fs - g_drive;
+    if ((g_freemap[drive].bits == 0) && (fs->fs_type != FS_EXFAT)) {
+        /* No map yet: build one with a full FAT scan, if we can spare the memory */
+        unsigned long size = (fs->n_fatent + 7) / 8;
+        if (size <= FREEMAP_MAX) {
+            uint8_t * bits = (uint8_t *)mem_alloc_top(MEM_OWN_KERNEL, FREEMAP_TAG + drive, size);
+            if (bits) {
+                mem_fill_long(bits, 0, (size + 3) & ~3);
+                g_freemap[drive].bits = bits;
+                g_freemap[drive].clusters = fs->n_fatent;
+
+                /* Make FatFs count the free clusters itself, instead of trusting FSINFO */
+                fs->free_clst = 0xFFFFFFFF;
+                fres = f_getfree(path, &clusters, &fs);
+                if (fres != FR_OK) {
+                    fsys_freemap_drop(drive);
+                    return fatfs_to_foenix(fres);
+                }
+            }
+        }
+    }
+
+    /* Sectors are 512 bytes, so a KB is two sectors */
+    *free_kb = (fs->csize >= 2) ? clusters * (fs->csize / 2) : clusters / 2;
+    if (total_kb) {
+        *total_kb = (fs->csize >= 2) ? (fs->n_fatent - 2) * (fs->csize / 2) : (fs->n_fatent - 2) / 2;
+    }
+
+    return 0;
+}
+
 unsigned char workspace[FF_MAX_SS * 4];
 
 /*
@@ -753,22 +1191,85 @@ unsigned char workspace[FF_MAX_SS * 4];
  *
  * Inputs:
  * drive = drive number
- * label = the label to apply to the drive
+ * label = the label to apply to the drive (may be 0 or empty for no label)
+ * format = the file system to create (FSYS_FORMAT_ANY, FSYS_FORMAT_FAT, FSYS_FORMAT_FAT32, FSYS_FORMAT_EXFAT)
+ * cluster_size = the size of a cluster in bytes (0 to pick the default for the volume size)
+ *
+ * Returns:
+ * 0 on success, negative number on failure
  */
-short fsys_mkfs(short drive, char * label) {
+short fsys_mkfs(short drive, char * label, short format, unsigned long cluster_size) {
     char buffer[80];
+    MKFS_PARM opt;
     FRESULT fres;
 
+    switch (format) {
+        case FSYS_FORMAT_ANY:
+            opt.fmt = FM_ANY;
+            break;
+
+        case FSYS_FORMAT_FAT:
+            opt.fmt = FM_FAT;
+            break;
+
+        case FSYS_FORMAT_FAT32:
+            opt.fmt = FM_FAT32;
+            break;
+
+        case FSYS_FORMAT_EXFAT:
+            opt.fmt = FM_EXFAT;
+            break;
+
+        default:
+            return FSYS_ERR_INVALID_PARAMETER;
+    }
+
+    opt.n_fat = 0;                  /* Use FatFs's defaults for the rest */
+    opt.align = 0;
+    opt.n_root = 0;
+    opt.au_size = cluster_size;
+
     sprintf(buffer, "%d:", drive);
-    fres = f_mkfs(buffer, 0, workspace, FF_MAX_SS * 4);
+    fres = f_mkfs(buffer, &opt, workspace, FF_MAX_SS * 4);
+    fsys_dircache_invalidate(0);
+    fsys_freemap_drop(drive);
     if (fres != FR_OK) {
         log_num(LOG_ERROR, "fsys_mkfs: ", fres);
         return fatfs_to_foenix(fres);
-    } else {
-        return 0;
     }
+
+    if (label && label[0]) {
+        return fsys_setlabel(drive, label);
+    }
+
+    return 0;
 }
 
+/*
+ * Claim the memory a loader is about to write for the file being loaded
+ *
+ * Every loader must claim the memory it writes, so a file cannot land on the kernel
+ * or on memory that belongs to something else.
+ *
+ * Inputs:
+ * address = the address of the first byte to be written
+ * size = the number of bytes to be written
+ *
+ * Returns:
+ * 0 on success, ERR_MEMORY_IN_USE if the memory belongs to something else
+ */
+static short fsys_load_claim(unsigned long address, unsigned long size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    if (address + size < address) {
+        /* The block wraps around the end of the address space */
+        return ERR_MEMORY_IN_USE;
+    }
+
+    return mem_claim(MEM_OWN_USER, g_load_tag, address, address + size - 1);
+}
 
 /*
  * Default loader to be used if file extension does not match a known file format
@@ -795,6 +1296,11 @@ short fsys_default_loader(short chan, long destination, long * start) {
     *start = 0;
 
     while (1) {
+        n = fsys_load_claim((unsigned long)dest, DEFAULT_CHUNK_SIZE);
+        if (n != 0) {
+            break;
+        }
+
         n = sys_chan_read(chan, dest, DEFAULT_CHUNK_SIZE);
         if (n > 0) {
             /* If we transferred some bytes, keep going */
@@ -942,19 +1448,32 @@ short fsys_pgz_loader(short chan, long destination, long * start) {
                                     break;
                                 case 2:
                                     count = count | chunk[i] << 16;
-                                    if (!use_32bits && count == 0) {
-                                        *start = address;
+                                    if (!use_32bits) {
+                                        if (count == 0) {
+                                            *start = address;
+                                        } else {
+                                            result = fsys_load_claim(address, count);
+                                        }
                                     }
                                     log_num(LOG_INFO, "PGZ 24-bit count: ", count);
                                     break;
                                 case 3:
                                     count = count | chunk[i] << 24;
-                                    if (use_32bits && count == 0) {
-                                        *start = address;
+                                    if (use_32bits) {
+                                        if (count == 0) {
+                                            *start = address;
+                                        } else {
+                                            result = fsys_load_claim(address, count);
+                                        }
                                     }
                                     log_num(LOG_INFO, "PGZ 32-bit count: ", count);
                                     break;
                             }
+
+                            if (result != 0) {
+                                /* The segment would land on memory that is not ours */
+                                break;
+                            }
                         } else {
                             /* We're in the data bytes */
                             if (segment_idx - data_idx < count) {
@@ -984,74 +1503,734 @@ short fsys_pgz_loader(short chan, long destination, long * start) {
     return result;
 }
 
-short fsys_elf_loader(short chan, long destination, long * start) {
-    char log_buffer[100];
-	size_t numBytes, highMem = 0, progIndex = 0, lowMem = ~0;
-	elf32_header header;
-	elf32_program_header progHeader;
+/*
+ * Zero out a block of memory (e.g. the BSS portion of a segment)
+ *
+ * Any unaligned bytes at the start and end are cleared individually, and the rest
+ * is cleared with long word writes.
+ *
+ * Inputs:
+ * dest = the address of the first byte to clear
+ * count = the number of bytes to clear
+ */
+static void fsys_elf_zero(uint8_t * dest, unsigned long count) {
+    unsigned long longs;
 
-    chan_seek(chan, 0, 0);
-    numBytes = chan_read(chan, (uint8_t*)&header, sizeof(header));
+    /* Clear bytes until we're at an even address */
+    while ((count > 0) && ((unsigned long)dest & 1)) {
+        *dest++ = 0;
+        count--;
+    }
 
-	if (header.ident.magic[0] != 0x7F ||
-		header.ident.magic[1] != 'E' ||
-		header.ident.magic[2] != 'L' ||
-		header.ident.magic[3] != 'F') {
-			DEBUG("[!] Not an ELF file");
-			return ERR_BAD_BINARY;
-	}
+    /* Clear the bulk of the block with long words */
+    longs = count & ~3L;
+    if (longs > 0) {
+        mem_fill_long(dest, 0, longs);
+        dest += longs;
+        count -= longs;
+    }
 
-	if (header.machine != CPU_ARCH) {
-		sprintf((char*)&log_buffer, "[!] Incompatible CPU arch: expected %s, but found %s\n", (char*)elf_cpu_desc[CPU_ARCH], (char*)elf_cpu_desc[header.machine]);
-		DEBUG(log_buffer);
-        return ERR_BAD_BINARY;
-	}
+    /* Clear any remaining bytes */
+    while (count-- > 0) {
+        *dest++ = 0;
+    }
+}
+
+/*
+ * Read a block of data from a channel into memory
+ *
+ * chan_read is limited to a short count, so large segments are read in chunks.
+ *
+ * Inputs:
+ * chan = the channel to read from
+ * dest = the address to store the data
+ * count = the number of bytes to read
+ *
+ * Returns:
+ * 0 on success, negative number on error
+ */
+static short fsys_elf_read(short chan, uint8_t * dest, unsigned long count) {
+    while (count > 0) {
+        short chunk = (count > ELF_READ_CHUNK) ? ELF_READ_CHUNK : (short)count;
+        short n = chan_read(chan, dest, chunk);
+        if (n < 0) {
+            return n;
+        } else if (n == 0) {
+            /* Segment runs past the end of the file */
+            return ERR_BAD_BINARY;
+        }
+
+        dest += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
+/*
+ * Apply a single relocation to the loaded image
+ *
+ * The relocation type is looked up in elf_reloc_kinds to find out how the value
+ * is computed and how wide the field is, so adding a new type is just a table entry.
+ *
+ * Inputs:
+ * place = the address of the field to patch
+ * type = the ELF relocation type (R_68K_*)
+ * symbol = the resolved address of the symbol referenced by the relocation
+ * addend = the addend from the relocation
+ * base = the load bias of the image (for R_68K_RELATIVE)
+ *
+ * Returns:
+ * 0 on success, negative number on error
+ */
+static short fsys_elf_relocate(uint8_t * place, unsigned char type, unsigned long symbol, long addend, unsigned long base) {
+    const t_elf_reloc_kind * kind;
+    unsigned long value;
+    short i;
+
+    if (type >= sizeof(elf_reloc_kinds) / sizeof(t_elf_reloc_kind)) {
+        return ERR_BAD_BINARY;
+    }
+
+    kind = &elf_reloc_kinds[type];
+    switch (kind->mode) {
+        case ELF_RELOC_ABS:
+            value = symbol + addend;
+            break;
+
+        case ELF_RELOC_PC:
+            value = symbol + addend - (unsigned long)place;
+            break;
+
+        case ELF_RELOC_BASE:
+            value = base + addend;
+            break;
+
+        default:
+            log_num(LOG_DEBUG, "[!] Unsupported ELF relocation type: ", type);
+            return ERR_BAD_BINARY;
+    }
+
+    if (kind->size == 0) {
+        /* Nothing to patch (R_68K_NONE) */
+        return 0;
+    }
+
+    if (kind->size < 4) {
+        /* Make sure the value fits in the field */
+        long limit = 1L << (kind->size * 8 - 1);
+        if (((long)value < -limit) || ((kind->mode == ELF_RELOC_PC) ? ((long)value >= limit) : ((long)value >= 2 * limit))) {
+            DEBUG("[!] ELF relocation out of range");
+            return ERR_BAD_BINARY;
+        }
+    }
+
+    if ((kind->size > 1) && (((unsigned long)place & 1) == 0)) {
+        /* Aligned fields can be written directly */
+        if (kind->size == 4) {
+            *(unsigned long *)place = value;
+        } else {
+            *(unsigned short *)place = (unsigned short)value;
+        }
+
+    } else {
+        /* Otherwise, write it a byte at a time (big endian) */
+        for (i = kind->size - 1; i >= 0; i--) {
+            place[i] = (uint8_t)value;
+            value >>= 8;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Read a table of fixed size entries from the file in chunks
+ *
+ * Inputs:
+ * chan = the channel to read from
+ * offset = the file offset of the table
+ * entry_size = the size of an entry in bytes
+ * count = the number of entries to read
+ * chunk = the buffer to use (ELF_CHUNK_SIZE bytes)
+ * handler = function to call for each chunk (with the chunk, the index of the first entry, and the number of entries)
+ * context = pointer to pass through to the handler
+ *
+ * Returns:
+ * 0 on success, negative number on error
+ */
+static short fsys_elf_read_table(short chan, unsigned long offset, unsigned long entry_size, unsigned long count, uint8_t * chunk,
+                                 short (*handler)(void * context, uint8_t * chunk, unsigned long first, short n), void * context) {
+    unsigned long first = 0;
+    short per_chunk = ELF_CHUNK_SIZE / entry_size;
+    short result;
+
+    if (per_chunk == 0) {
+        return ERR_BAD_BINARY;
+    }
+
+    chan_seek(chan, offset, 0);
+    while (first < count) {
+        short n = (count - first > per_chunk) ? per_chunk : (short)(count - first);
+        result = fsys_elf_read(chan, chunk, n * entry_size);
+        if (result < 0) {
+            return result;
+        }
+
+        result = handler(context, chunk, first, n);
+        if (result < 0) {
+            return result;
+        }
+
+        first += n;
+    }
+
+    return 0;
+}
+
+/*
+ * State shared by the steps of loading a relocatable ELF object
+ */
+typedef struct s_elf_rel_state {
+    elf32_header * header;          /* The ELF header */
+    uint8_t * section_table;        /* The raw section header table */
+    unsigned long * section_addr;   /* Address each allocated section was loaded to (0 if not loaded) */
+    unsigned long * symbol_value;   /* The resolved address of each symbol */
+    unsigned long symbol_count;     /* The number of symbols in the symbol table */
+    short target;                   /* The section the current relocation table patches */
+} t_elf_rel_state, *p_elf_rel_state;
+
+static elf32_section_header * fsys_elf_section(p_elf_rel_state state, unsigned short index) {
+    return (elf32_section_header *)(state->section_table + (unsigned long)index * state->header->shentsize);
+}
+
+/*
+ * Resolve a chunk of symbols from the symbol table to absolute addresses
+ */
+static short fsys_elf_resolve_symbols(void * context, uint8_t * chunk, unsigned long first, short n) {
+    p_elf_rel_state state = (p_elf_rel_state)context;
+    elf32_symbol * symbol = (elf32_symbol *)chunk;
+    short i;
+
+    for (i = 0; i < n; i++, symbol++) {
+        unsigned long value = 0;
+
+        if (symbol->shndx == SHN_UNDEF) {
+            if ((first + i != 0) && (ELF32_ST_BIND(symbol->info) != STB_WEAK)) {
+                DEBUG("[!] Cannot load ELF: object has unresolved symbols");
+                return ERR_BAD_BINARY;
+            }
+
+        } else if (symbol->shndx == SHN_ABS) {
+            value = symbol->value;
+
+        } else if (symbol->shndx == SHN_COMMON) {
+            DEBUG("[!] Cannot load ELF: common symbols are not supported");
+            return ERR_BAD_BINARY;
+
+        } else if (symbol->shndx < state->header->shnum) {
+            value = state->section_addr[symbol->shndx] + symbol->value;
+        }
+
+        state->symbol_value[first + i] = value;
+    }
+
+    return 0;
+}
+
+/*
+ * Apply a chunk of relocations from a RELA section to the loaded image
+ */
+static short fsys_elf_apply_relocations(void * context, uint8_t * chunk, unsigned long first, short n) {
+    p_elf_rel_state state = (p_elf_rel_state)context;
+    elf32_rela * rela = (elf32_rela *)chunk;
+    unsigned long section_base = state->section_addr[state->target];
+    short i, result;
+
+    for (i = 0; i < n; i++, rela++) {
+        unsigned long symbol = ELF32_R_SYM(rela->info);
+        if (symbol >= state->symbol_count) {
+            return ERR_BAD_BINARY;
+        }
+
+        result = fsys_elf_relocate((uint8_t *)(section_base + rela->offset), ELF32_R_TYPE(rela->info), state->symbol_value[symbol], rela->addend, 0);
+        if (result < 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Load a relocatable (ET_REL) ELF object
+ *
+ * The allocated sections are packed into a single block (from mem_alloc, unless
+ * the caller provided a destination), the symbols are resolved against the
+ * sections' load addresses, and the RELA sections are applied.
+ *
+ * A relocatable object has no load address, so it has no real entry point either:
+ * linkers leave e_entry at 0 (or at an offset given with -e). The entry point is taken
+ * to be e_entry bytes into the first executable section in the section table, which is
+ * the startup code as long as it is linked first (as vlink and ld do with the startup
+ * object at the head of the command line). Objects built any other way should give
+ * the offset of their entry code in e_entry.
+ *
+ * Inputs:
+ * chan = the channel for the file (header already read)
+ * header = the ELF header
+ * destination = the address to load the image to (0 to allocate memory for it)
+ * start = pointer to the long variable to fill with the starting address
+ *
+ * Returns:
+ * 0 on success, negative number on error
+ */
+static short fsys_elf_load_rel(short chan, elf32_header * header, long destination, long * start) {
+    t_elf_rel_state state;
+    elf32_section_header * section;
+    uint8_t * chunk = 0;
+    unsigned long table_size, size = 0, base = 0, align, position;
+    short i, result = 0, symtab = -1, code = -1;
+
+    if ((header->shnum == 0) || (header->shentsize < sizeof(elf32_section_header))) {
+        DEBUG("[!] Cannot load ELF: no usable section headers");
+        return ERR_NOT_EXECUTABLE;
+    }
+
+    table_size = (unsigned long)header->shnum * header->shentsize;
+    if (table_size > ELF_READ_CHUNK) {
+        DEBUG("[!] Cannot load ELF: section header table too large");
+        return ERR_BAD_BINARY;
+    }
+
+    state.header = header;
+    state.symbol_value = 0;
+    state.symbol_count = 0;
+    state.section_table = (uint8_t *)malloc(table_size);
+    state.section_addr = (unsigned long *)malloc(header->shnum * sizeof(unsigned long));
+    chunk = (uint8_t *)malloc(ELF_CHUNK_SIZE);
+    if ((state.section_table == 0) || (state.section_addr == 0) || (chunk == 0)) {
+        result = ERR_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    /* Read the section header table in one go */
+    chan_seek(chan, header->shoff, 0);
+    result = fsys_elf_read(chan, state.section_table, table_size);
+    if (result < 0) {
+        goto done;
+    }
+
+    /* Lay out the allocated sections in one block */
+    for (i = 0; i < header->shnum; i++) {
+        section = fsys_elf_section(&state, i);
+        state.section_addr[i] = 0;
+        if ((section->flags & SHF_ALLOC) && (section->size > 0)) {
+            align = (section->addralign < 2) ? 2 : section->addralign;
+            size = (size + align - 1) & ~(align - 1);
+            state.section_addr[i] = size;
+            size += section->size;
+            if ((code < 0) && (section->flags & SHF_EXECINSTR)) {
+                code = i;
+            }
+        }
+
+        if (section->type == SHT_SYMTAB) {
+            symtab = i;
+        }
+    }
+
+    if (code < 0) {
+        DEBUG("[!] Cannot load ELF: object has no code");
+        result = ERR_NOT_EXECUTABLE;
+        goto done;
+    }
+
+    /* Get the memory for the image */
+    if (destination != 0) {
+        base = destination;
+        result = fsys_load_claim(base, size);
+        if (result != 0) {
+            goto done;
+        }
+    } else {
+        base = mem_alloc(MEM_OWN_USER, g_load_tag, size);
+        if (base == 0) {
+            result = ERR_OUT_OF_MEMORY;
+            goto done;
+        }
+    }
+    log_num(LOG_DEBUG, "fsys_elf_loader: relocating to: ", base);
+
+    /* Load the sections */
+    position = ~0;
+    for (i = 0; (i < header->shnum) && (result == 0); i++) {
+        section = fsys_elf_section(&state, i);
+        if ((section->flags & SHF_ALLOC) && (section->size > 0)) {
+            state.section_addr[i] += base;
+            if (section->type == SHT_NOBITS) {
+                fsys_elf_zero((uint8_t *)state.section_addr[i], section->size);
+            } else {
+                if (section->offset != position) {
+                    chan_seek(chan, section->offset, 0);
+                }
+                result = fsys_elf_read(chan, (uint8_t *)state.section_addr[i], section->size);
+                position = section->offset + section->size;
+            }
+        }
+    }
+
+    /* Resolve the symbols */
+    if ((result == 0) && (symtab >= 0)) {
+        section = fsys_elf_section(&state, symtab);
+        state.symbol_count = section->size / sizeof(elf32_symbol);
+        if (state.symbol_count > 0) {
+            state.symbol_value = (unsigned long *)mem_alloc_top(MEM_OWN_KERNEL, ELF_TAG_SYMBOLS, state.symbol_count * sizeof(unsigned long));
+            if (state.symbol_value == 0) {
+                result = ERR_OUT_OF_MEMORY;
+            } else {
+                result = fsys_elf_read_table(chan, section->offset, sizeof(elf32_symbol), state.symbol_count, chunk, fsys_elf_resolve_symbols, &state);
+            }
+        }
+    }
+
+    /* Apply the relocations to the allocated sections */
+    for (i = 0; (i < header->shnum) && (result == 0); i++) {
+        section = fsys_elf_section(&state, i);
+        if ((section->type == SHT_RELA) || (section->type == SHT_REL)) {
+            if ((section->info >= header->shnum) || (state.section_addr[section->info] == 0)) {
+                /* Relocations for a section we did not load (e.g. debug information) */
+                continue;
+            }
+
+            if ((section->type == SHT_REL) || (section->link != symtab)) {
+                DEBUG("[!] Cannot load ELF: unsupported relocation section");
+                result = ERR_NOT_EXECUTABLE;
+                break;
+            }
+
+            state.target = section->info;
+            result = fsys_elf_read_table(chan, section->offset, sizeof(elf32_rela), section->size / sizeof(elf32_rela), chunk, fsys_elf_apply_relocations, &state);
+        }
+    }
+
+    if (result == 0) {
+        *start = state.section_addr[code] + header->entry;
+    }
+
+done:
+    if (state.symbol_value) {
+        mem_free(MEM_OWN_KERNEL, (uint32_t)state.symbol_value);
+    }
+    if (chunk) {
+        free(chunk);
+    }
+    if (state.section_addr) {
+        free(state.section_addr);
+    }
+    if (state.section_table) {
+        free(state.section_table);
+    }
+
+    return result;
+}
+
+/*
+ * Apply the dynamic relocations of a position independent (ET_DYN) executable
+ *
+ * The dynamic section, relocations, and symbol table are all in loaded segments,
+ * so they are processed in place.
+ *
+ * Inputs:
+ * dynamic = pointer to the loaded dynamic section
+ * bias = the difference between the load address and the link address
+ *
+ * Returns:
+ * 0 on success, negative number on error
+ */
+static short fsys_elf_relocate_dynamic(elf32_dyn * dynamic, unsigned long bias) {
+    elf32_rela * rela = 0;
+    elf32_symbol * symbols = 0;
+    unsigned long rela_size = 0, rela_entry = sizeof(elf32_rela), count, i;
+    short result;
+
+    for (; dynamic->tag != DT_NULL; dynamic++) {
+        switch (dynamic->tag) {
+            case DT_RELA:
+                rela = (elf32_rela *)(dynamic->val + bias);
+                break;
+            case DT_RELASZ:
+                rela_size = dynamic->val;
+                break;
+            case DT_RELAENT:
+                rela_entry = dynamic->val;
+                break;
+            case DT_SYMTAB:
+                symbols = (elf32_symbol *)(dynamic->val + bias);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if ((rela == 0) || (rela_entry < sizeof(elf32_rela))) {
+        return 0;
+    }
+
+    count = rela_size / rela_entry;
+    for (i = 0; i < count; i++, rela = (elf32_rela *)((uint8_t *)rela + rela_entry)) {
+        unsigned long symbol = 0;
+        unsigned long index = ELF32_R_SYM(rela->info);
+
+        if (index != 0) {
+            if (symbols == 0) {
+                return ERR_BAD_BINARY;
+            } else if (symbols[index].shndx == SHN_ABS) {
+                symbol = symbols[index].value;
+            } else if (symbols[index].shndx != SHN_UNDEF) {
+                symbol = symbols[index].value + bias;
+            } else if (ELF32_ST_BIND(symbols[index].info) != STB_WEAK) {
+                DEBUG("[!] Cannot load ELF: executable has unresolved symbols");
+                return ERR_BAD_BINARY;
+            }
+        }
+
+        result = fsys_elf_relocate((uint8_t *)(rela->offset + bias), ELF32_R_TYPE(rela->info), symbol, rela->addend, bias);
+        if (result < 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Loader for ELF binaries
+ *
+ * Executables (ET_EXEC) are loaded to the addresses in their program headers.
+ * Position independent executables (ET_DYN) and relocatable objects (ET_REL)
+ * are loaded to memory from mem_alloc (or to destination, if it is not 0) and relocated.
+ *
+ * Inputs:
+ * chan = the channel for the file to load
+ * destination = the destination address for relocatable files (0 to allocate memory)
+ * start = pointer to the long variable to fill with the starting address
+ *
+ * Returns:
+ * 0 on success, negative number on error
+ */
+short fsys_elf_loader(short chan, long destination, long * start) {
+    char log_buffer[100];
+	size_t numBytes, highMem = 0, progIndex = 0, lowMem = ~0;
+	elf32_header header;
+	elf32_program_header * progHeader;
+    elf32_program_header * loadHeader[ELF_MAX_LOAD];
+    elf32_program_header * dynHeader = 0;
+    uint8_t * progTable = 0;
+    short loadCount = 0, i, j;
+    unsigned long tableSize, position, address, bias = 0, base = 0;
+    long jiffies_start, jiffies_phase;
+    short result = 0;
+
+    jiffies_start = timers_jiffies();
+
+    chan_seek(chan, 0, 0);
+    numBytes = chan_read(chan, (uint8_t*)&header, sizeof(header));
+    if (numBytes != sizeof(header)) {
+        DEBUG("[!] Could not read ELF header");
+        return ERR_BAD_BINARY;
+    }
+
+	if (header.ident.magic[0] != 0x7F ||
+		header.ident.magic[1] != 'E' ||
+		header.ident.magic[2] != 'L' ||
+		header.ident.magic[3] != 'F') {
+			DEBUG("[!] Not an ELF file");
+			return ERR_BAD_BINARY;
+	}
+
+	if (header.machine != CPU_ARCH) {
+		sprintf((char*)&log_buffer, "[!] Incompatible CPU arch: expected %s, but found %s\n", (char*)elf_cpu_desc[CPU_ARCH], (char*)elf_cpu_desc[header.machine]);
+		DEBUG(log_buffer);
+        return ERR_BAD_BINARY;
+	}
 
 	switch (header.type) {
 		case ET_REL:
 			// ELF type: relocatable"
-			break;
+            result = fsys_elf_load_rel(chan, &header, destination, start);
+            log_num(LOG_DEBUG, "fsys_elf_loader: total (jiffies): ", timers_jiffies() - jiffies_start);
+			return result;
 		case ET_EXEC:
 			// ELF type: executable"
 			break;
 		case ET_DYN:
-			DEBUG("[!] Cannot load ELF: loading shared objects is not supported");
-			return ERR_NOT_EXECUTABLE;
+			// ELF type: position independent executable"
+			break;
 		default:
 			DEBUG("[!] Cannot load ELF: invalid type flag (file probably corrupted)");
 			return ERR_NOT_EXECUTABLE;
 	}
 
-	while (progIndex < header.progNum) {
-		chan_seek(chan, progIndex * header.progSize + header.progOffset, 0);
-		numBytes = chan_read(chan, (uint8_t*)&progHeader, sizeof(progHeader));
-		switch (progHeader.type) {
+    if ((header.progNum == 0) || (header.progSize < sizeof(elf32_program_header))) {
+        DEBUG("[!] Cannot load ELF: no usable program headers");
+        return ERR_NOT_EXECUTABLE;
+    }
+
+    /* Read the whole program header table in one go */
+    tableSize = (unsigned long)header.progNum * header.progSize;
+    if (tableSize > ELF_READ_CHUNK) {
+        DEBUG("[!] Cannot load ELF: program header table too large");
+        return ERR_BAD_BINARY;
+    }
+
+    progTable = (uint8_t *)malloc(tableSize);
+    if (progTable == 0) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    position = sizeof(header);
+    if (header.progOffset != position) {
+        chan_seek(chan, header.progOffset, 0);
+    }
+    numBytes = chan_read(chan, progTable, (short)tableSize);
+    if (numBytes != tableSize) {
+        DEBUG("[!] Could not read ELF program headers");
+        free(progTable);
+        return ERR_BAD_BINARY;
+    }
+    position = header.progOffset + tableSize;
+
+    /* Validate the segments and collect the loadable ones */
+	for (progIndex = 0; progIndex < header.progNum; progIndex++) {
+        progHeader = (elf32_program_header *)(progTable + progIndex * header.progSize);
+		switch (progHeader->type) {
 			case PT_NULL:
 			case PT_PHDR:
 			case PT_NOTE:
 				break;
 			case PT_DYNAMIC:
+                if (header.type == ET_DYN) {
+                    /* Position independent executables carry their relocations here */
+                    dynHeader = progHeader;
+                    break;
+                }
+                /* Otherwise, fall through */
 			case PT_SHLIB:
 				DEBUG("[!] Dynamically linked ELFs not supported");
+                free(progTable);
 				return ERR_NOT_EXECUTABLE;
 			case PT_LOAD:
-                chan_seek(chan, progHeader.offset, 0);
-                uint8_t * write_buffer = (uint8_t *) progHeader.physAddr;
-				numBytes = chan_read(chan, write_buffer, progHeader.fileSize);
-				if (progHeader.fileSize < progHeader.memSize)
-					memset((uint8_t*)progHeader.physAddr + progHeader.fileSize, 0, progHeader.memSize - progHeader.fileSize);
-				if (progHeader.physAddr + progHeader.fileSize > highMem) highMem = progHeader.physAddr + progHeader.fileSize;
-				if (progHeader.physAddr < lowMem) lowMem = progHeader.physAddr + progHeader.align;
+                if (loadCount >= ELF_MAX_LOAD) {
+                    DEBUG("[!] Cannot load ELF: too many loadable segments");
+                    free(progTable);
+                    return ERR_NOT_EXECUTABLE;
+                }
+                loadHeader[loadCount++] = progHeader;
+
+                /* Track the span of memory the image needs */
+                address = (header.type == ET_DYN) ? progHeader->virtAddr : progHeader->physAddr;
+                if (address + progHeader->memSize > highMem) highMem = address + progHeader->memSize;
+                if (address < lowMem) lowMem = address;
 				break;
 			case PT_INTERP:
 				DEBUG("[!] Interpreted ELFs are not supported");
+                free(progTable);
 				return ERR_NOT_EXECUTABLE;
 		}
-		progIndex++;
 	}
 
-    *start = header.entry;
-	return 0;
+    if (loadCount == 0) {
+        DEBUG("[!] Cannot load ELF: no loadable segments");
+        free(progTable);
+        return ERR_NOT_EXECUTABLE;
+    }
+
+    if (header.type == ET_DYN) {
+        /* Get the memory for the image and work out how far to move it */
+        if (destination != 0) {
+            base = destination;
+            result = fsys_load_claim(base, highMem - lowMem);
+            if (result != 0) {
+                free(progTable);
+                return result;
+            }
+        } else {
+            base = mem_alloc(MEM_OWN_USER, g_load_tag, highMem - lowMem);
+            if (base == 0) {
+                free(progTable);
+                return ERR_OUT_OF_MEMORY;
+            }
+        }
+        bias = base - lowMem;
+        log_num(LOG_DEBUG, "fsys_elf_loader: relocating to: ", base);
+
+    } else {
+        /* Claim the pages each segment will occupy... if any of them are not ours, do not load */
+        for (i = 0; i < loadCount; i++) {
+            result = fsys_load_claim(loadHeader[i]->physAddr, loadHeader[i]->memSize);
+            if (result != 0) {
+                DEBUG("[!] Cannot load ELF: segment overlaps memory in use");
+                free(progTable);
+                return result;
+            }
+        }
+    }
+
+    /* Sort the loadable segments by file offset, so we read the file front to back */
+    for (i = 1; i < loadCount; i++) {
+        progHeader = loadHeader[i];
+        for (j = i; (j > 0) && (loadHeader[j - 1]->offset > progHeader->offset); j--) {
+            loadHeader[j] = loadHeader[j - 1];
+        }
+        loadHeader[j] = progHeader;
+    }
+
+    jiffies_phase = timers_jiffies();
+    log_num(LOG_DEBUG, "fsys_elf_loader: headers (jiffies): ", jiffies_phase - jiffies_start);
+
+    /* Load the segments, seeking only when there is a gap in the file */
+    for (i = 0; (i < loadCount) && (result == 0); i++) {
+        progHeader = loadHeader[i];
+        if (progHeader->fileSize > 0) {
+            address = ((header.type == ET_DYN) ? progHeader->virtAddr : progHeader->physAddr) + bias;
+            if (progHeader->offset != position) {
+                chan_seek(chan, progHeader->offset, 0);
+            }
+            result = fsys_elf_read(chan, (uint8_t *)address, progHeader->fileSize);
+            position = progHeader->offset + progHeader->fileSize;
+        }
+    }
+
+    log_num(LOG_DEBUG, "fsys_elf_loader: segments (jiffies): ", timers_jiffies() - jiffies_phase);
+    jiffies_phase = timers_jiffies();
+
+    /* Clear the BSS portions of the segments */
+    for (i = 0; (i < loadCount) && (result == 0); i++) {
+        progHeader = loadHeader[i];
+        if (progHeader->fileSize < progHeader->memSize) {
+            address = ((header.type == ET_DYN) ? progHeader->virtAddr : progHeader->physAddr) + bias;
+            fsys_elf_zero((uint8_t *)address + progHeader->fileSize, progHeader->memSize - progHeader->fileSize);
+        }
+    }
+
+    log_num(LOG_DEBUG, "fsys_elf_loader: bss (jiffies): ", timers_jiffies() - jiffies_phase);
+
+    if ((result == 0) && (dynHeader != 0)) {
+        /* Apply the relocations for a position independent executable */
+        jiffies_phase = timers_jiffies();
+        result = fsys_elf_relocate_dynamic((elf32_dyn *)(dynHeader->virtAddr + bias), bias);
+        log_num(LOG_DEBUG, "fsys_elf_loader: relocation (jiffies): ", timers_jiffies() - jiffies_phase);
+    }
+
+    log_num(LOG_DEBUG, "fsys_elf_loader: total (jiffies): ", timers_jiffies() - jiffies_start);
+
+    free(progTable);
+
+    if (result == 0) {
+        *start = header.entry + bias;
+    }
+	return result;
 }
 
 
@@ -1072,6 +2251,7 @@ short fsys_pgx_loader(short chan, long destination, long * start) {
     const char signature[] = "PGX\x02";
     unsigned char * chunk = 0;
     unsigned char * dest = 0;
+    unsigned char * claimed = 0;
     long file_idx = 0;
     long address = 0;
     short result = 0;
@@ -1113,6 +2293,15 @@ short fsys_pgx_loader(short chan, long destination, long * start) {
                             dest = (unsigned char *)address;
                         }
 
+                        if (dest >= claimed) {
+                            /* Claim the memory for the rest of the chunk before writing it */
+                            result = fsys_load_claim((unsigned long)dest, n - i);
+                            if (result != 0) {
+                                break;
+                            }
+                            claimed = dest + (n - i);
+                        }
+
                         /* Store the data in the destination address */
                         *dest++ = chunk[i];
                     }
@@ -1137,10 +2326,12 @@ short fsys_pgx_loader(short chan, long destination, long * start) {
 }
 
 /*
- * Load a file into memory at the designated destination address.
+ * Load a file into memory, claiming the memory it occupies under the given tag.
  *
  * If destination = 0, the file must be in a recognized binary format
- * that specifies its own loading address.
+ * that specifies its own loading address. If the file would land on memory
+ * that belongs to anything else, it is not loaded (ERR_MEMORY_IN_USE). Memory
+ * already claimed is left to the caller to release (see mem_free_tag).
  *
  * Inputs:
  * path = the path to the file to load
@@ -1148,11 +2339,12 @@ short fsys_pgx_loader(short chan, long destination, long * start) {
  * start = pointer to the long variable to fill with the starting address
  *         (0 if not an executable, any other number if file is executable
  *         with a known starting address)
+ * tag = the memory tag (for MEM_OWN_USER) to claim the memory under
  *
  * Returns:
  * 0 on success, negative number on error
  */
-short fsys_load(const char * path, long destination, long * start) {
+short fsys_load_as(const char * path, long destination, long * start, unsigned short tag) {
     int i;
     char extension[MAX_EXT];
     short chan = -1;
@@ -1229,8 +2421,10 @@ short fsys_load(const char * path, long destination, long * start) {
     /* Open the file for reading */
     chan = fsys_open(path, FA_READ);
     if (chan >= 0) {
-        /* If it opened correctly, load the file */
+        /* If it opened correctly, load the file, with its memory under the given tag */
+        g_load_tag = tag;
         short result = loader(chan, destination, start);
+        g_load_tag = 0;
         fsys_close(chan);
 
         if (result != 0) {
@@ -1245,6 +2439,42 @@ short fsys_load(const char * path, long destination, long * start) {
     }
 }
 
+/*
+ * Load a file into memory at the designated destination address.
+ *
+ * The memory the file is loaded into is claimed for it. While a program is running,
+ * what it loads is added to its own memory and is returned when it exits. Otherwise
+ * (e.g. LOAD from the command line), the file gets a tag of its own and stays resident.
+ *
+ * Inputs:
+ * path = the path to the file to load
+ * destination = the destination address (0 for use file's address)
+ * start = pointer to the long variable to fill with the starting address
+ *
+ * Returns:
+ * 0 on success, negative number on error
+ */
+short fsys_load(const char * path, long destination, long * start) {
+    unsigned short tag = proc_get_tag();
+    short result;
+
+    if (tag != 0) {
+        return fsys_load_as(path, destination, start, tag);
+    }
+
+    tag = mem_new_tag(MEM_OWN_USER);
+    if (tag == 0) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    result = fsys_load_as(path, destination, start, tag);
+    if (result != 0) {
+        mem_free_tag(MEM_OWN_USER, tag);
+    }
+
+    return result;
+}
+
 /*
  * Register a file loading routine
  *
@@ -1309,6 +2539,9 @@ short fsys_init() {
         g_fil_state[i] = 0;
     }
 
+    /* Start with an empty directory entry cache */
+    fsys_dircache_invalidate(0);
+
     /* Mount all logical drives that are present */
 
     for (i = 0; i < MAX_DRIVES; i++) {
@@ -1336,6 +2569,7 @@ short fsys_init() {
     g_file_dev.number = CDEV_FILE;
     g_file_dev.name = "FILE";
     g_file_dev.init = fchan_init;
+    g_file_dev.close = fchan_close;
     g_file_dev.ioctrl = fchan_ioctrl;
     g_file_dev.read = fchan_read;
     g_file_dev.read_b = fchan_read_b;
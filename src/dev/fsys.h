@@ -21,6 +21,40 @@ typedef struct s_file_info {
     char name[MAX_PATH_LEN];
 } t_file_info, * p_file_info;
 
+/*
+ * Fields to include in the records returned by fsys_readdir_batch
+ */
+#define FSYS_RECORD_NAME    0x01    /* Include the name of the entry */
+#define FSYS_RECORD_ATTR    0x02    /* Include the attributes, size, date, and time of the entry */
+#define FSYS_RECORD_ALL     0x03    /* Include everything */
+
+/**
+ * Attribute fields of a compact directory record (see fsys_readdir_batch)
+ *
+ * Records are packed one after the other in the caller's buffer. Each record
+ * starts with an unsigned short giving the length of the record in bytes (always
+ * even), followed by a t_dir_record_attr if FSYS_RECORD_ATTR was requested, and
+ * then the NUL terminated name if FSYS_RECORD_NAME was requested.
+ */
+typedef struct s_dir_record_attr {
+    unsigned char attributes;
+    unsigned char reserved;
+    long size;
+    unsigned short date;
+    unsigned short time;
+} t_dir_record_attr, * p_dir_record_attr;
+
+/* The largest a compact directory record can be */
+#define FSYS_RECORD_MAX     (sizeof(unsigned short) + sizeof(t_dir_record_attr) + MAX_PATH_LEN)
+
+/*
+ * File system formats for fsys_mkfs
+ */
+#define FSYS_FORMAT_ANY     0x00    /* Pick FAT, FAT32, or exFAT based on the size of the volume */
+#define FSYS_FORMAT_FAT     0x01    /* FAT12 or FAT16 */
+#define FSYS_FORMAT_FAT32   0x02    /* FAT32 */
+#define FSYS_FORMAT_EXFAT   0x03    /* exFAT (no 4GB file limit, contiguous files need no FAT chain) */
+
 /*
  * Pointer type for file loaders
  *
@@ -100,6 +134,25 @@ extern short fsys_closedir(short dir);
  */
 extern short fsys_readdir(short dir, p_file_info file);
 
+/**
+ * Read a batch of entries from an open directory as compact records
+ *
+ * Entries are read until max_entries records have been filled, the end of
+ * the directory is reached, or there is no longer room in the buffer for a
+ * record of the largest possible size.
+ *
+ * Inputs:
+ * dir = the handle of the open directory
+ * buffer = the buffer to fill with the packed records
+ * size = the size of the buffer in bytes
+ * max_entries = the maximum number of records to return
+ * fields = which fields to include (FSYS_RECORD_NAME, FSYS_RECORD_ATTR, or both)
+ *
+ * Returns:
+ * the number of records returned (0 at the end of the directory), negative number on failure
+ */
+extern short fsys_readdir_batch(short dir, unsigned char * buffer, short size, short max_entries, short fields);
+
 /**
  * Open a directory given the path and search for the first file matching the pattern.
  *
@@ -143,14 +196,35 @@ extern short fsys_getlabel(char * path, char * label);
  */
 extern short fsys_setlabel(short drive, const char * label);
 
+/*
+ * Get the free space on the drive holding the path
+ *
+ * The first call for a FAT volume scans the FAT once to build a map of the
+ * free clusters. After that, the answer comes from memory.
+ *
+ * Inputs:
+ * path = path to the drive
+ * free_kb = pointer to the long to fill with the free space in KB
+ * total_kb = pointer to the long to fill with the size of the volume in KB (may be 0)
+ *
+ * Returns:
+ * 0 on success, negative number on failure
+ */
+extern short fsys_get_free(const char * path, unsigned long * free_kb, unsigned long * total_kb);
+
 /*
  * Format a drive
  *
  * Inputs:
  * drive = drive number
- * label = the label to apply to the drive
+ * label = the label to apply to the drive (may be 0 or empty for no label)
+ * format = the file system to create (FSYS_FORMAT_ANY, FSYS_FORMAT_FAT, FSYS_FORMAT_FAT32, FSYS_FORMAT_EXFAT)
+ * cluster_size = the size of a cluster in bytes (0 to pick the default for the volume size)
+ *
+ * Returns:
+ * 0 on success, negative number on failure
  */
-extern short fsys_mkfs(short drive, char * label);
+extern short fsys_mkfs(short drive, char * label, short format, unsigned long cluster_size);
 
 /**
  * Create a directory
@@ -213,7 +287,9 @@ extern short fsys_get_cwd(char * path, short size);
  * Load a file into memory at the designated destination address.
  *
  * If destination = 0, the file must be in a recognized binary format
- * that specifies its own loading address.
+ * that specifies its own loading address. The memory is claimed for the
+ * running program (and returned when it exits), or kept resident if no
+ * program is running.
  *
  * Inputs:
  * path = the path to the file to load
@@ -227,6 +303,23 @@ extern short fsys_get_cwd(char * path, short size);
  */
 extern short fsys_load(const char * path, long destination, long * start);
 
+/*
+ * Load a file into memory, claiming the memory it occupies under the given tag.
+ *
+ * If the file would land on memory that belongs to anything else, it is not loaded
+ * (ERR_MEMORY_IN_USE). Memory already claimed is left to the caller to release.
+ *
+ * Inputs:
+ * path = the path to the file to load
+ * destination = the destination address (0 for use file's address)
+ * start = pointer to the long variable to fill with the starting address
+ * tag = the memory tag (for MEM_OWN_USER) to claim the memory under
+ *
+ * Returns:
+ * 0 on success, negative number on error
+ */
+extern short fsys_load_as(const char * path, long destination, long * start, unsigned short tag);
+
 /*
  * Register a file loading routine
  *
@@ -10,12 +10,15 @@
 #include "interrupt.h"
 #include "kbd_mo.h"
 #include "ring_buffer.h"
+#include "dev/key_event.h"
+#include "dev/text_screen_iii.h"
 #include "gabe_reg.h"
 
 #define KBD_MO_DATA     ((volatile unsigned short *)0x00C00040)     /* Data register for the keyboard (scan codes will be here) */
 #define KBD_MO_STAT     ((volatile unsigned short *)0x00C00042)     /* Status register for the keyboard */
 #define KBD_MO_EMPTY    0x8000                                      /* Status flag that will be set if the keyboard buffer is empty */
 #define KBD_MO_FULL     0x4000                                      /* Status flag that will be set if the keyboard buffer is full */
+#define KBD_BUFFER_SIZE 128                                         /* Number of entries in each of the keyboard ring buffers */
 
 /*
  * Modifier bit flags
@@ -38,7 +41,10 @@ struct s_kdbmo_kbd {
     unsigned char status;       /* Status of the keyboard */
     t_word_ring sc_buf;         /* Buffer containing scancodes that have been processed */
     t_word_ring char_buf;       /* Buffer containing characters to be read */
+    unsigned short sc_storage[KBD_BUFFER_SIZE];     /* Storage for sc_buf */
+    unsigned short char_storage[KBD_BUFFER_SIZE];   /* Storage for char_buf */
     unsigned char modifiers;    /* State of the modifier keys (CTRL, ALT, SHIFT) and caps lock */
+    t_key_queue key_events;                 /* Key events waiting to be read, and the keys held right now */
 
     /* Scan code to character lookup tables */
 
@@ -202,8 +208,9 @@ short kbdmo_init() {
 
     /* Set up the ring buffers */
 
-    rb_word_init(&g_kbdmo_control.sc_buf);        /* Scan-code ring buffer is empty */
-    rb_word_init(&g_kbdmo_control.char_buf);      /* Character ring buffer is empty */
+    rb_word_init(&g_kbdmo_control.sc_buf, g_kbdmo_control.sc_storage, KBD_BUFFER_SIZE);   /* Scan-code ring buffer is empty */
+    rb_word_init(&g_kbdmo_control.char_buf, g_kbdmo_control.char_storage, KBD_BUFFER_SIZE); /* Character ring buffer is empty */
+    key_event_init(&g_kbdmo_control.key_events);    /* Key event queue is empty and no keys are down */
 
     /* Set the default keyboard layout to US */
 
@@ -317,6 +324,7 @@ void kbdmo_enqueue_scan(unsigned char scan_code) {
                 break;
         }
 
+        key_event_note(&g_kbdmo_control.key_events, scan_code, g_kbdmo_control.modifiers);
         rb_word_put(&g_kbdmo_control.sc_buf, g_kbdmo_control.modifiers << 8 | scan_code);
     }
 }
@@ -369,6 +377,47 @@ unsigned short kbdmo_get_scancode() {
     }
 }
 
+/*
+ * Take the next key event from the queue
+ *
+ * Inputs:
+ * event = the record to fill in with the event
+ *
+ * Returns:
+ * 1 if an event was returned, 0 if there was none waiting
+ */
+short kbdmo_get_event(p_key_event event) {
+    if (rb_empty(&g_kbdmo_control.key_events.events) && ((*KBD_MO_STAT & 0x00ff) != 0)) {
+        /* Nothing in the queue, but something is pending... process it as if an interrupt occurred */
+        kbdmo_handle_irq();
+    }
+
+    return key_event_get(&g_kbdmo_control.key_events, event);
+}
+
+/*
+ * Return the record of which keys are held down right now
+ *
+ * The record stays in place and is updated as keys change, so a caller can keep the
+ * pointer and read it as often as it likes.
+ */
+const t_key_state * kbdmo_key_state() {
+    return &g_kbdmo_control.key_events.state;
+}
+
+/*
+ * Check if there is keyboard input waiting to be processed
+ *
+ * This does not translate or consume anything, so it is cheap enough to call
+ * when polling. A pending scan code may turn out not to produce a character.
+ *
+ * Returns:
+ *      non-zero if a character or scan code is waiting, 0 otherwise
+ */
+short kbdmo_input_pending() {
+    return !rb_word_empty(&g_kbdmo_control.char_buf) || !rb_word_empty(&g_kbdmo_control.sc_buf);
+}
+
 /*
  * Try to get a character from the keyboard...
  *
@@ -388,6 +437,14 @@ char kbdmo_getc() {
                 // If it's a make code, let's try to look it up...
                 unsigned char modifiers = (raw_code >> 8) & 0xff;    // Get the modifiers
                 unsigned char scan_code = raw_code & 0x7f;           // Get the base code for the key
+                unsigned char key = (unsigned char)g_kbdmo_control.keys_unmodified[scan_code];    // The key's code (the tables are signed char)
+
+                if ((modifiers & KBD_MOD_SHIFT) && ((key == KBD_KEY_PGUP) || (key == KBD_KEY_PGDN))) {
+                    // SHIFT-PgUp and SHIFT-PgDn page the main screen through its scrollback
+                    text_history_page(0, (key == KBD_KEY_PGUP) ? TEXT_HISTORY_UP : TEXT_HISTORY_DOWN);
+                    raw_code = kbdmo_get_scancode();
+                    continue;
+                }
 
                 // Check the modifiers to see what we should lookup...
 
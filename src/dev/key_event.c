@@ -0,0 +1,62 @@
+/*
+ * Implementation of the key event queues shared by the keyboard drivers
+ */
+
+#include <string.h>
+#include "ring_buffer.h"
+#include "dev/key_event.h"
+#include "dev/rtc.h"
+
+/*
+ * Empty the queue and mark every key as up
+ */
+void key_event_init(p_key_queue queue) {
+    rb_init(&queue->events, queue->storage, sizeof(t_key_event), KEY_EVENTS);
+    queue->lost = 0;
+    memset(&queue->state, 0, sizeof(t_key_state));
+}
+
+/*
+ * Note a key change in the key state and queue an event for it
+ *
+ * Inputs:
+ * queue = the key queue
+ * scan_code = the make or break scan code
+ * modifiers = the modifier and lock keys after the change
+ */
+void key_event_note(p_key_queue queue, unsigned char scan_code, unsigned char modifiers) {
+    unsigned char code = scan_code & 0x7f;
+    unsigned char bit = 1 << (code & 7);
+    t_key_event event;
+
+    event.flags = 0;
+    if (scan_code & 0x80) {
+        event.flags = KEY_EVENT_BREAK;
+        queue->state.keys[code >> 3] &= ~bit;
+    } else {
+        if (queue->state.keys[code >> 3] & bit) {
+            /* Already down: the keyboard is repeating it */
+            event.flags = KEY_EVENT_REPEAT;
+        }
+        queue->state.keys[code >> 3] |= bit;
+    }
+    queue->state.modifiers = modifiers;
+    queue->state.changes++;
+
+    event.time = (unsigned long)rtc_get_jiffies();
+    event.scan_code = code;
+    event.modifiers = modifiers;
+    event.flags |= queue->lost ? KEY_EVENT_LOST : 0;
+    event.reserved = 0;
+    queue->lost = (rb_write(&queue->events, &event, 1) == 0);
+}
+
+/*
+ * Take the next key event from the queue
+ *
+ * Returns:
+ * 1 if an event was returned, 0 if there was none waiting
+ */
+short key_event_get(p_key_queue queue, p_key_event event) {
+    return rb_read(&queue->events, event, 1);
+}
@@ -0,0 +1,65 @@
+/*
+ * Declarations for the key event queues shared by the keyboard drivers
+ *
+ * A keyboard driver keeps one of these for its keyboard. Its interrupt handler notes
+ * every make and break code with key_event_note, which keeps the record of keys held
+ * and queues a time stamped event. Programs take the events with key_event_get.
+ */
+
+#ifndef __KEY_EVENT_H
+#define __KEY_EVENT_H
+
+#include "types.h"
+#include "ring_buffer.h"
+
+#define KEY_EVENTS          64          /* Number of key events queued (a power of two) */
+
+#define KBD_KEY_PGUP        0x84        /* Code for the PgUp key in the layout tables */
+#define KBD_KEY_PGDN        0x85        /* Code for the PgDn key in the layout tables */
+
+/*
+ * The key events waiting to be read and the keys held right now
+ */
+typedef struct s_key_queue {
+    t_ring events;                      /* Key events waiting to be read */
+    t_key_event storage[KEY_EVENTS];    /* Storage for the events */
+    unsigned char lost;                 /* Non-zero if events were dropped since the last one queued */
+    t_key_state state;                  /* The keys held right now */
+} t_key_queue, *p_key_queue;
+
+/*
+ * Empty the queue and mark every key as up
+ *
+ * Inputs:
+ * queue = the key queue
+ */
+extern void key_event_init(p_key_queue queue);
+
+/*
+ * Note a key change in the key state and queue an event for it
+ *
+ * If the event queue is full, the event is dropped, and the next one queued is marked
+ * KEY_EVENT_LOST. The key state is always updated.
+ *
+ * NOTE: called from the keyboard interrupt handler.
+ *
+ * Inputs:
+ * queue = the key queue
+ * scan_code = the make or break scan code
+ * modifiers = the modifier and lock keys after the change
+ */
+extern void key_event_note(p_key_queue queue, unsigned char scan_code, unsigned char modifiers);
+
+/*
+ * Take the next key event from the queue
+ *
+ * Inputs:
+ * queue = the key queue
+ * event = the record to fill in with the event
+ *
+ * Returns:
+ * 1 if an event was returned, 0 if there was none waiting
+ */
+extern short key_event_get(p_key_queue queue, p_key_event event);
+
+#endif
@@ -2,9 +2,17 @@
  * Parallel port printer driver
  */
 
+#include <string.h>
 #include "log.h"
+#include "errors.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "ring_buffer.h"
+#include "timers.h"
+#include "dev/fsys.h"
 #include "dev/lpt.h"
 #include "dev/text_screen_iii.h"
+#include "fatfs/ff.h"
 #include "sys_general.h"
 
 #if MODEL == MODEL_FOENIX_A2560K
@@ -41,13 +49,6 @@ short lpt_delay() {
     return x;
 }
 
-/*
- * Install the LPT driver
- */
-short lpt_install() {
-    return 0;
-}
-
 void lpt_initialize() {
     int i;
 
@@ -92,12 +93,24 @@ short lpt_wait_ack() {
     return 0;
 }
 
+/*
+ * Return true if the printer is ready for another byte
+ */
+short lpt_ready() {
+    return (*LPT_STAT_PORT & LPT_STAT_BUSY) != 0;
+}
+
 /*
  * Write a character to the parallel port
+ *
+ * In non-blocking mode, returns DEV_WOULD_BLOCK if the printer is busy.
  */
 short lpt_write_b(p_channel chan, unsigned char b) {
-    /* This write routine is polled I/O. */
-    /* TODO: convert it to interrupt driven */
+    /* This write routine is polled I/O: the LPT channel spools through the ACK interrupt instead */
+
+    if (chan && (chan->flags & CHAN_FLAG_NONBLOCK) && !lpt_ready()) {
+        return DEV_WOULD_BLOCK;
+    }
 
     /* Wait until the printer is not busy */
     if (lpt_wait_busy()) {
@@ -125,6 +138,9 @@ short lpt_write_b(p_channel chan, unsigned char b) {
 
 /*
  * Write a buffer of bytes to the parallel port
+ *
+ * Returns the number of bytes written. In non-blocking mode, stops when the
+ * printer is busy (DEV_WOULD_BLOCK if nothing could be written).
  */
 short lpt_write(p_channel chan, unsigned char * buffer, short size) {
     int i;
@@ -132,12 +148,371 @@ short lpt_write(p_channel chan, unsigned char * buffer, short size) {
 
     for (i = 0; i < size; i++) {
         result = lpt_write_b(chan, buffer[i]);
-        if (result < 0) {
+        if (result == DEV_WOULD_BLOCK) {
+            return (i > 0) ? i : result;
+        } else if (result < 0) {
             return result;
         }
     }
 
+    return i;
+}
+
+/*
+ * Channel device for the parallel port
+ *
+ * Bytes written to the channel go into a spool, and the printer is fed from it one byte
+ * per ACK interrupt, so a program can write a whole listing and carry on while it prints.
+ * Optionally, a spool file takes whatever does not fit in the spool in memory. The file
+ * is moved back into memory as room frees up, from the LPT calls and while the console
+ * waits for a key (lpt_spool_service).
+ */
+
+#define LPT_TAG             0x7900      /* Tag for the memory page used by the spool */
+#define LPT_SPOOL_SIZE      0x1000      /* Size of the spool in memory (one page) */
+#define LPT_REFILL_SIZE     256         /* Most bytes moved from the spool file at a time */
+#define LPT_ACK_TIMEOUT     3           /* Jiffies to wait for an ACK before trying the next byte anyway */
+
+static uint8_t * lpt_storage = 0;       /* The memory page for the spool (0 until first opened) */
+static t_byte_ring lpt_spool;           /* Bytes waiting to be printed */
+static short lpt_opens = 0;             /* Number of channels that have the port open */
+static volatile short lpt_busy = 0;     /* Non-zero while a byte has been strobed and not acknowledged */
+static long lpt_sent_at = 0;            /* When the last byte was strobed (in jiffies) */
+static short lpt_file = -1;             /* The channel of the spool file (-1 if none) */
+static short lpt_file_keep = 0;         /* Non-zero to keep the spool file open once it is emptied */
+static long lpt_file_read = 0;          /* Position of the next byte to take from the spool file */
+static long lpt_file_written = 0;       /* Position just past the last byte put in the spool file */
+static p_int_handler lpt_sof_next = 0;  /* The SOF handler that was there before ours (0 if none) */
+static short lpt_sof_hooked = 0;        /* Non-zero once the spool is checked on the SOF interrupt */
+static uint8_t lpt_refill[LPT_REFILL_SIZE];    /* Bytes on their way from the spool file (kept off the supervisor stack) */
+
+/*
+ * Send the next spooled byte if the printer can take it
+ *
+ * NOTE: called from the interrupt handlers, or with interrupts off.
+ */
+static void lpt_feed() {
+    if (!lpt_busy && !rb_byte_empty(&lpt_spool) && lpt_ready()) {
+        *LPT_DATA_PORT = rb_byte_get(&lpt_spool);
+        *LPT_CTRL_PORT = LPT_STROBE_ON | LPT_CTRL_IRQE;
+        lpt_delay();
+        *LPT_CTRL_PORT = LPT_STROBE_OFF | LPT_CTRL_IRQE;
+
+        lpt_busy = 1;
+        lpt_sent_at = timers_jiffies();
+    }
+}
+
+/*
+ * Interrupt handler for the parallel port: the printer took the last byte
+ */
+static void lpt_handle_irq() {
+    lpt_busy = 0;
+    lpt_feed();
+}
+
+/*
+ * Start of frame handler: restart the spool if the printer was not ready,
+ * or if an ACK went missing
+ */
+static void lpt_sof_handler() {
+    if (lpt_busy && (timers_jiffies() - lpt_sent_at > LPT_ACK_TIMEOUT) && lpt_ready()) {
+        lpt_busy = 0;
+    }
+    lpt_feed();
+
+    if (lpt_sof_next) {
+        /* Pass the interrupt along (e.g. to the jiffy counter) */
+        lpt_sof_next();
+    }
+}
+
+/*
+ * Return the number of bytes in the spool file that are not yet in memory
+ */
+static long lpt_file_pending() {
+    return lpt_file_written - lpt_file_read;
+}
+
+/*
+ * Move bytes from the spool file into the spool in memory as room allows
+ *
+ * Closes the spool file once it is emptied, if nothing wants it kept open.
+ */
+void lpt_spool_service() {
+    short count;
+    short mask;
+
+    if (lpt_file < 0) {
+        return;
+    }
+
+    while (lpt_file_pending() > 0) {
+        count = rb_byte_space(&lpt_spool);
+        if (count > LPT_REFILL_SIZE) {
+            count = LPT_REFILL_SIZE;
+        }
+        if (count > lpt_file_pending()) {
+            count = (short)lpt_file_pending();
+        }
+        if (count <= 0) {
+            return;
+        }
+
+        chan_seek(lpt_file, lpt_file_read, CDEV_SEEK_START);
+        count = chan_read(lpt_file, lpt_refill, count);
+        if (count <= 0) {
+            /* The spool file cannot be read: drop what is left in it */
+            lpt_file_read = lpt_file_written;
+            break;
+        }
+
+        mask = int_disable_all();
+        rb_byte_write(&lpt_spool, lpt_refill, count);
+        lpt_feed();
+        int_restore(mask);
+
+        lpt_file_read += count;
+    }
+
+    /* Emptied: start over at the beginning of the file */
+    lpt_file_read = 0;
+    lpt_file_written = 0;
+
+    if (!lpt_file_keep) {
+        fsys_close(lpt_file);
+        lpt_file = -1;
+    }
+}
+
+/*
+ * Add bytes to the spool
+ *
+ * Returns:
+ * the number of bytes taken (DEV_WOULD_BLOCK if none, in non-blocking mode)
+ */
+static short lpt_spool_write(p_channel chan, const uint8_t * buffer, short size) {
+    short count = 0;
+    short n;
+    short mask;
+
+    while (count < size) {
+        lpt_spool_service();
+
+        if ((lpt_file >= 0) && ((lpt_file_pending() > 0) || rb_byte_full(&lpt_spool))) {
+            /* Keep the bytes in order: once the file has some, the rest go after them */
+            chan_seek(lpt_file, lpt_file_written, CDEV_SEEK_START);
+            n = chan_write(lpt_file, buffer + count, size - count);
+            if (n == 0) {
+                /* The file took nothing (the disk is full): no more can be spooled for now */
+                n = DEV_CANNOT_WRITE;
+            }
+            if (n < 0) {
+                return (count > 0) ? count : n;
+            }
+            lpt_file_written += n;
+            count += n;
+            continue;
+        }
+
+        mask = int_disable_all();
+        n = rb_byte_write(&lpt_spool, buffer + count, size - count);
+        lpt_feed();
+        int_restore(mask);
+
+        if (n > 0) {
+            count += n;
+
+        } else if (chan->flags & CHAN_FLAG_NONBLOCK) {
+            return (count > 0) ? count : DEV_WOULD_BLOCK;
+
+        } else {
+            int_wait();
+        }
+    }
+
+    return count;
+}
+
+short lpt_chan_init() {
+    return 0;
+}
+
+/*
+ * Open the parallel port... initializes the printer, unless it is still printing a spooled job
+ */
+short lpt_chan_open(p_channel chan, const uint8_t * path, short mode) {
+    short mask;
+
+    if (lpt_storage == 0) {
+        lpt_storage = (uint8_t *)mem_alloc_top(MEM_OWN_KERNEL, LPT_TAG, LPT_SPOOL_SIZE);
+        if (lpt_storage == 0) {
+            return ERR_OUT_OF_MEMORY;
+        }
+        rb_byte_init(&lpt_spool, lpt_storage, LPT_SPOOL_SIZE);
+    }
+
+    if (lpt_opens++ == 0) {
+        if (rb_byte_empty(&lpt_spool) && !lpt_busy && (lpt_file < 0)) {
+            lpt_initialize();
+        }
+
+        *LPT_CTRL_PORT = LPT_STROBE_OFF | LPT_CTRL_IRQE;
+
+        mask = int_disable_all();
+        if (!lpt_sof_hooked) {
+            lpt_sof_next = int_register(INT_SOF_A, lpt_sof_handler);
+            lpt_sof_hooked = 1;
+        }
+        int_restore(mask);
+
+        int_clear(INT_LPT1);
+        int_enable(INT_LPT1);
+    }
+
+    return 0;
+}
+
+/*
+ * Close the parallel port... anything spooled carries on printing in the background
+ */
+short lpt_chan_close(p_channel chan) {
+    if (lpt_opens > 0) {
+        lpt_opens--;
+    }
     return 0;
 }
 
+/*
+ * The printer cannot be read
+ */
+short lpt_chan_read(p_channel chan, uint8_t * buffer, short size) {
+    return DEV_CANNOT_READ;
+}
+
+short lpt_chan_read_b(p_channel chan) {
+    return DEV_CANNOT_READ;
+}
+
+/*
+ * Spool bytes for the printer
+ *
+ * Returns as soon as the bytes are spooled. In non-blocking mode, spools what will fit
+ * and returns the count (DEV_WOULD_BLOCK if nothing would fit).
+ */
+short lpt_chan_write(p_channel chan, const uint8_t * buffer, short size) {
+    return lpt_spool_write(chan, buffer, size);
+}
+
+short lpt_chan_write_b(p_channel chan, uint8_t b) {
+    short result = lpt_spool_write(chan, &b, 1);
+    return (result < 0) ? result : 0;
+}
+
+short lpt_chan_status(p_channel chan) {
+    unsigned char stat = *LPT_STAT_PORT;
+
+    lpt_spool_service();
+
+    if (((stat & LPT_STAT_ERROR) == 0) || (stat & LPT_STAT_PO)) {
+        /* Printer error or out of paper */
+        return CDEV_STAT_ERROR;
+    } else if ((lpt_file >= 0) || !rb_byte_full(&lpt_spool)) {
+        return CDEV_STAT_WRITABLE;
+    }
+
+    return 0;
+}
+
+/*
+ * Wait for everything spooled to be printed
+ */
+short lpt_chan_flush(p_channel chan) {
+    while ((lpt_file_pending() > 0) || !rb_byte_empty(&lpt_spool) || lpt_busy) {
+        lpt_spool_service();
+        int_wait();
+    }
+    return 0;
+}
+
+short lpt_chan_seek(p_channel chan, long position, short base) {
+    return 0;
+}
+
+/*
+ * Send a command to the parallel port
+ *
+ * LPT_IOCTRL_SPOOL_FILE = spool what does not fit in memory to a file (buffer holds the path),
+ *                         or stop using the file once it empties (size 0)
+ * LPT_IOCTRL_PENDING = copy the number of bytes still to print into buffer as an unsigned long
+ */
+short lpt_chan_ioctrl(p_channel chan, short command, uint8_t * buffer, short size) {
+    unsigned long pending;
+    short fd;
+
+    switch (command) {
+        case LPT_IOCTRL_SPOOL_FILE:
+            if ((size == 0) || (buffer == 0) || (buffer[0] == 0)) {
+                lpt_file_keep = 0;
+                lpt_spool_service();
+                return 0;
+            }
+
+            if (lpt_file >= 0) {
+                /* Already spooling to a file */
+                return ERR_OUT_OF_HANDLES;
+            }
+
+            fd = fsys_open((const char *)buffer, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+            if (fd < 0) {
+                return fd;
+            }
+
+            lpt_file = fd;
+            lpt_file_keep = 1;
+            lpt_file_read = 0;
+            lpt_file_written = 0;
+            return 0;
+
+        case LPT_IOCTRL_PENDING:
+            if (size < sizeof(unsigned long)) {
+                return DEV_BOUNDS_ERR;
+            }
+            pending = rb_byte_count(&lpt_spool) + lpt_file_pending();
+            memcpy(buffer, &pending, sizeof(unsigned long));
+            return 0;
+
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Install the LPT driver
+ */
+short lpt_install() {
+    t_dev_chan dev;
+
+    int_register(INT_LPT1, lpt_handle_irq);
+
+    dev.name = "LPT";
+    dev.number = CDEV_LPT;
+    dev.init = lpt_chan_init;
+    dev.open = lpt_chan_open;
+    dev.close = lpt_chan_close;
+    dev.read = lpt_chan_read;
+    dev.readline = lpt_chan_read;
+    dev.read_b = lpt_chan_read_b;
+    dev.write = lpt_chan_write;
+    dev.write_b = lpt_chan_write_b;
+    dev.flush = lpt_chan_flush;
+    dev.seek = lpt_chan_seek;
+    dev.status = lpt_chan_status;
+    dev.ioctrl = lpt_chan_ioctrl;
+    dev.readv = 0;
+    dev.writev = 0;
+
+    return cdev_register(&dev);
+}
+
 #endif
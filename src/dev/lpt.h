@@ -7,20 +7,39 @@
 
 #include "dev/channel.h"
 
+/*
+ * IOCTRL commands for the LPT channel
+ */
+
+#define LPT_IOCTRL_SPOOL_FILE   0x0100  /* Spool what does not fit in memory to a file (buffer holds the path, size 0 to stop) */
+#define LPT_IOCTRL_PENDING      0x0200  /* Get the number of bytes still to print (an unsigned long) */
+
 /*
  * Install the LPT driver
+ *
+ * Writes to the channel are spooled and printed in the background from the ACK interrupt.
+ * The device honors the channel's non-blocking flag (see CHAN_IOCTRL_NONBLOCK_ON).
  */
 extern short lpt_install();
 
+/*
+ * Move spooled bytes from the spool file back into memory as room allows
+ *
+ * Called by the LPT channel itself and while the console waits for a key.
+ */
+extern void lpt_spool_service();
+
 extern void lpt_initialize();
 
 /*
- * Write a character to the parallel port
+ * Write a character to the parallel port, waiting for the printer (no spooling)
  */
 extern short lpt_write_b(p_channel chan, unsigned char b);
 
 /*
  * Write a buffer of bytes to the parallel port
+ *
+ * Returns the number of bytes written, any negative number is an error code
  */
 extern short lpt_write(p_channel chan, unsigned char * buffer, short size);
 
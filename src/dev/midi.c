@@ -2,7 +2,14 @@
  * Definitions for the MIDI ports
  */
 
+#include <string.h>
+#include "errors.h"
+#include "interrupt.h"
+#include "memory.h"
 #include "midi_reg.h"
+#include "ring_buffer.h"
+#include "timers.h"
+#include "dev/channel.h"
 #include "dev/midi.h"
 #include "simpleio.h"
 #include "sys_general.h"
@@ -17,10 +24,10 @@ short midi_input_not_ready() {
 }
 
 /*
- * Return true if there is data waiting to be read
+ * Return true if the port is still busy sending the last byte
  */
 short midi_output_busy() {
-    return (*MIDI_STAT & MIDI_STAT_RX_EMPTY);
+    return (*MIDI_STAT & MIDI_STAT_TX_BUSY);
 }
 
 
@@ -79,4 +86,355 @@ unsigned char midi_get_poll() {
     return *MIDI_DATA;
 }
 
+/*
+ * Channel device for the MIDI port
+ *
+ * While the port is open, its receive interrupt moves each byte into a ring of events,
+ * stamped with the time it arrived. Bytes written to the channel go into a transmit queue.
+ * The port has no transmit interrupt in UART mode, so the queue is fed to it whenever the
+ * port is found idle: by the writer, by the receive interrupt, and on every start of frame.
+ */
+
+#define MIDI_TAG            0x7a00      /* Tag for the memory page holding the rings */
+#define MIDI_BUFFER_SIZE    0x1000      /* One page: the transmit queue, then the receive events */
+#define MIDI_TX_SIZE        0x400       /* Number of bytes in the transmit queue (a power of two) */
+#define MIDI_RX_EVENTS      ((MIDI_BUFFER_SIZE - MIDI_TX_SIZE) / sizeof(t_midi_event))  /* Number of events in the receive ring */
+
+static uint8_t * midi_storage = 0;              /* The memory page for the rings (0 until first opened) */
+static t_ring midi_rx;                          /* The receive events */
+static unsigned char midi_rx_lost = 0;          /* Non-zero if events were dropped since the last one stored */
+static t_byte_ring midi_tx;                     /* Bytes waiting to be sent */
+static short midi_opens = 0;                    /* Number of channels that have the port open */
+static p_int_handler midi_sof_next = 0;         /* The SOF handler that was there before ours (0 if none) */
+static short midi_sof_hooked = 0;               /* Non-zero once the transmit queue is fed on the SOF interrupt */
+
+/*
+ * Return the time to stamp on a received byte (in jiffies)
+ */
+static unsigned long midi_time() {
+    return (unsigned long)timers_jiffies();
+}
+
+/*
+ * Feed the transmit queue to the port
+ *
+ * Bytes go out only while the port is idle. Once it is busy, the rest is left for the next
+ * drain (the next receive interrupt or start of frame), so this never waits on the port.
+ *
+ * NOTE: called from the interrupt handlers, or with interrupts off.
+ */
+static void midi_tx_drain() {
+    while (!rb_byte_empty(&midi_tx) && !midi_output_busy()) {
+        *MIDI_DATA = rb_byte_get(&midi_tx);
+    }
+}
+
+/*
+ * Interrupt handler for the MIDI port: stamp and queue everything received
+ */
+static void midi_handle_irq() {
+    t_midi_event event;
+
+    while (!midi_input_not_ready()) {
+        event.data = *MIDI_DATA;
+        event.time = midi_time();
+        event.flags = midi_rx_lost ? MIDI_EVENT_LOST : 0;
+
+        midi_rx_lost = (rb_write(&midi_rx, &event, 1) == 0);
+    }
+
+    midi_tx_drain();
+}
+
+/*
+ * Start of frame handler: keep the transmit queue moving
+ */
+static void midi_sof_handler() {
+    if (midi_opens > 0) {
+        midi_tx_drain();
+    }
+
+    if (midi_sof_next) {
+        /* Pass the interrupt along (e.g. to the jiffy counter) */
+        midi_sof_next();
+    }
+}
+
+/*
+ * Queue bytes to send and push out what the port will take right away
+ *
+ * Returns:
+ * the number of bytes queued
+ */
+static short midi_tx_queue(const uint8_t * data, short size) {
+    short mask = int_disable_all();
+    short count = rb_byte_write(&midi_tx, data, size);
+    midi_tx_drain();
+    int_restore(mask);
+    return count;
+}
+
+/*
+ * Wait for the transmit queue to empty, feeding the port as it goes
+ *
+ * The busy bit is watched with interrupts on. They are only turned off for the moment it
+ * takes to hand the port a byte, so the serial ports keep being serviced.
+ */
+static void midi_tx_wait() {
+    short mask;
+
+    while (!rb_byte_empty(&midi_tx)) {
+        if (!midi_output_busy()) {
+            mask = int_disable_all();
+            midi_tx_drain();
+            int_restore(mask);
+        }
+    }
+}
+
+/*
+ * Take up to count events out of the receive ring
+ *
+ * Returns:
+ * the number of events copied
+ */
+static short midi_rx_get(p_midi_event events, short count) {
+    return rb_read(&midi_rx, events, count);
+}
+
+short midi_chan_init() {
+    return 0;
+}
+
+/*
+ * Open the MIDI port... the first open resets it, puts it in UART mode, and turns on its interrupt
+ */
+short midi_chan_open(p_channel chan, const uint8_t * path, short mode) {
+    short result;
+    short mask;
+
+    if (midi_opens++ > 0) {
+        return 0;
+    }
+
+    if (midi_storage == 0) {
+        midi_storage = (uint8_t *)mem_alloc_top(MEM_OWN_KERNEL, MIDI_TAG, MIDI_BUFFER_SIZE);
+        if (midi_storage == 0) {
+            midi_opens = 0;
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    /* The reset handshake is polled, so keep the handler out of the way */
+    int_disable(INT_MIDI);
+    result = midi_init();
+    if (result) {
+        midi_opens = 0;
+        return result;
+    }
+
+    rb_byte_init(&midi_tx, midi_storage, MIDI_TX_SIZE);
+    rb_init(&midi_rx, midi_storage + MIDI_TX_SIZE, sizeof(t_midi_event), MIDI_RX_EVENTS);
+    midi_rx_lost = 0;
+
+    mask = int_disable_all();
+    if (!midi_sof_hooked) {
+        midi_sof_next = int_register(INT_SOF_A, midi_sof_handler);
+        midi_sof_hooked = 1;
+    }
+    int_restore(mask);
+
+    int_clear(INT_MIDI);
+    int_enable(INT_MIDI);
+
+    return 0;
+}
+
+/*
+ * Close the MIDI port... the last close sends what is queued and turns off the interrupt
+ */
+short midi_chan_close(p_channel chan) {
+    if (midi_opens > 0) {
+        if (--midi_opens == 0) {
+            midi_tx_wait();
+            int_disable(INT_MIDI);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Read a byte from the MIDI port
+ *
+ * In non-blocking mode, returns DEV_WOULD_BLOCK if no byte has been received.
+ */
+short midi_chan_read_b(p_channel chan) {
+    t_midi_event event;
+
+    while (midi_rx_get(&event, 1) == 0) {
+        if (chan->flags & CHAN_FLAG_NONBLOCK) {
+            return DEV_WOULD_BLOCK;
+        }
+        int_wait();
+    }
+
+    return event.data;
+}
+
+/*
+ * Read bytes from the MIDI port (without their time stamps: see MIDI_IOCTRL_EVENTS)
+ *
+ * In non-blocking mode, returns the bytes already received (DEV_WOULD_BLOCK if there were none).
+ */
+short midi_chan_read(p_channel chan, uint8_t * buffer, short size) {
+    t_midi_event event;
+    short i = 0;
+
+    while (i < size) {
+        if (midi_rx_get(&event, 1)) {
+            buffer[i++] = event.data;
+
+        } else if (chan->flags & CHAN_FLAG_NONBLOCK) {
+            return (i > 0) ? i : DEV_WOULD_BLOCK;
+
+        } else {
+            int_wait();
+        }
+    }
+
+    return i;
+}
+
+/*
+ * MIDI is not line oriented
+ */
+short midi_chan_readline(p_channel chan, uint8_t * buffer, short size) {
+    return DEV_CANNOT_READ;
+}
+
+/*
+ * Send a byte to the MIDI port
+ *
+ * In non-blocking mode, returns DEV_WOULD_BLOCK if the transmit queue is full.
+ */
+short midi_chan_write(p_channel chan, const uint8_t * buffer, short size);
+
+short midi_chan_write_b(p_channel chan, uint8_t b) {
+    return (midi_chan_write(chan, &b, 1) < 0) ? DEV_WOULD_BLOCK : 0;
+}
+
+/*
+ * Send bytes to the MIDI port
+ *
+ * In blocking mode, returns once everything has gone to the port. In non-blocking mode,
+ * queues what will fit and returns the count (DEV_WOULD_BLOCK if nothing would fit).
+ */
+short midi_chan_write(p_channel chan, const uint8_t * buffer, short size) {
+    short count = 0;
+    short n;
+
+    while (count < size) {
+        n = midi_tx_queue(buffer + count, size - count);
+        if (n > 0) {
+            count += n;
+
+        } else if (chan->flags & CHAN_FLAG_NONBLOCK) {
+            return (count > 0) ? count : DEV_WOULD_BLOCK;
+
+        } else {
+            midi_tx_wait();
+        }
+    }
+
+    if (!(chan->flags & CHAN_FLAG_NONBLOCK)) {
+        midi_tx_wait();
+    }
+
+    return count;
+}
+
+short midi_chan_status(p_channel chan) {
+    short status = 0;
+
+    if (!rb_empty(&midi_rx)) {
+        status |= CDEV_STAT_READABLE;
+    }
+
+    if (!rb_byte_full(&midi_tx)) {
+        status |= CDEV_STAT_WRITABLE;
+    }
+
+    return status;
+}
+
+/*
+ * Wait for everything queued on the MIDI port to be sent
+ */
+short midi_chan_flush(p_channel chan) {
+    midi_tx_wait();
+    return 0;
+}
+
+short midi_chan_seek(p_channel chan, long position, short base) {
+    return 0;
+}
+
+/*
+ * Send a command to the MIDI port
+ *
+ * MIDI_IOCTRL_EVENTS = take received events out of the ring: buffer is an array of t_midi_event,
+ *                      size is its size in bytes. Returns the number of events copied (0 if none).
+ * MIDI_IOCTRL_TIME = copy the current time (in the units of the event stamps) into buffer
+ *                    as an unsigned long.
+ */
+short midi_chan_ioctrl(p_channel chan, short command, uint8_t * buffer, short size) {
+    unsigned long now;
+
+    switch (command) {
+        case MIDI_IOCTRL_EVENTS:
+            return midi_rx_get((p_midi_event)buffer, size / sizeof(t_midi_event));
+
+        case MIDI_IOCTRL_TIME:
+            if (size < sizeof(unsigned long)) {
+                return DEV_BOUNDS_ERR;
+            }
+            now = midi_time();
+            memcpy(buffer, &now, sizeof(unsigned long));
+            return 0;
+
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Install the MIDI channel device
+ */
+short midi_install() {
+    t_dev_chan dev;
+
+    midi_opens = 0;
+    int_register(INT_MIDI, midi_handle_irq);
+
+    dev.name = "MIDI";
+    dev.number = CDEV_MIDI;
+    dev.init = midi_chan_init;
+    dev.open = midi_chan_open;
+    dev.close = midi_chan_close;
+    dev.read = midi_chan_read;
+    dev.readline = midi_chan_readline;
+    dev.read_b = midi_chan_read_b;
+    dev.write = midi_chan_write;
+    dev.write_b = midi_chan_write_b;
+    dev.flush = midi_chan_flush;
+    dev.seek = midi_chan_seek;
+    dev.status = midi_chan_status;
+    dev.ioctrl = midi_chan_ioctrl;
+    dev.readv = 0;
+    dev.writev = 0;
+
+    return cdev_register(&dev);
+}
+
 #endif
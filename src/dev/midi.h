@@ -5,6 +5,26 @@
 #ifndef __MIDI_H
 #define __MIDI_H
 
+#include "types.h"
+
+/*
+ * IOCTRL commands for the MIDI channel
+ */
+
+#define MIDI_IOCTRL_EVENTS  0x0100      /* Read time stamped events (buffer is an array of t_midi_event) */
+#define MIDI_IOCTRL_TIME    0x0200      /* Get the current time in the units of the event stamps */
+
+#define MIDI_EVENT_LOST     0x01        /* Events were dropped just before this one (the ring was full) */
+
+/*
+ * A byte received on the MIDI port, with the time it arrived
+ */
+typedef struct s_midi_event {
+    unsigned long time;                 /* When the byte arrived (in jiffies) */
+    unsigned char data;                 /* The byte received */
+    unsigned char flags;                /* MIDI_EVENT_* flags */
+} t_midi_event, *p_midi_event;
+
 /*
  * Initilialize the MIDI port
  */
@@ -26,4 +46,16 @@ extern short midi_put(unsigned char b);
  */
 extern unsigned char midi_get_poll();
 
+/*
+ * Install the MIDI channel device
+ *
+ * Received bytes are time stamped by the interrupt handler and can be read with their
+ * stamps through MIDI_IOCTRL_EVENTS. The device honors the channel's non-blocking flag
+ * (see CHAN_IOCTRL_NONBLOCK_ON).
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+extern short midi_install();
+
 #endif
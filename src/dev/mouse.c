@@ -0,0 +1,315 @@
+/*
+ * Implementation of the mouse: pointer state, event queue, and the MOUSE channel device
+ *
+ * The mouse interrupt handler reports each packet here. The position is kept in pixels,
+ * clamped to the size of the main screen (as set by text_setsizes). While the MOUSE
+ * channel is open, each change is queued as an event, but if the newest event still
+ * waiting is plain motion, further motion is added to it instead, so a slow reader gets
+ * fewer, larger moves rather than losing button presses when the queue fills.
+ */
+
+#include "errors.h"
+#include "interrupt.h"
+#include "ring_buffer.h"
+#include "dev/channel.h"
+#include "dev/mouse.h"
+#include "dev/rtc.h"
+#include "dev/text_screen_iii.h"
+
+#define MOUSE_EVENTS        64          /* Number of events in the queue (a power of two) */
+#define MOUSE_DEFAULT_X     640         /* Width to clamp to if the screen size is not known */
+#define MOUSE_DEFAULT_Y     480         /* Height to clamp to if the screen size is not known */
+
+static t_mouse_state mouse_now;                     /* The pointer's position and buttons */
+static t_mouse_event mouse_storage[MOUSE_EVENTS];   /* Storage for the event queue */
+static t_ring mouse_events;                         /* Events waiting to be read */
+static unsigned char mouse_lost = 0;                /* Non-zero if events were dropped since the last one queued */
+static short mouse_opens = 0;                       /* Number of channels that have the mouse open */
+
+/*
+ * Add two motion counts, saturating rather than wrapping
+ */
+static short mouse_add(short a, short b) {
+    long sum = (long)a + b;
+
+    if (sum > 0x7fff) {
+        return 0x7fff;
+    } else if (sum < -0x8000) {
+        return -0x8000;
+    }
+
+    return (short)sum;
+}
+
+/*
+ * Move the pointer by the given amount, keeping it on the screen
+ *
+ * NOTE: called with interrupts off, or from the interrupt handler.
+ */
+static void mouse_move(short x, short y) {
+    short width;
+    short height;
+
+    text_get_pixels(0, &width, &height);
+    if ((width <= 0) || (height <= 0)) {
+        width = MOUSE_DEFAULT_X;
+        height = MOUSE_DEFAULT_Y;
+    }
+
+    if (x < 0) {
+        x = 0;
+    } else if (x >= width) {
+        x = width - 1;
+    }
+
+    if (y < 0) {
+        y = 0;
+    } else if (y >= height) {
+        y = height - 1;
+    }
+
+    mouse_now.x = x;
+    mouse_now.y = y;
+}
+
+/*
+ * Report a packet from the mouse
+ */
+void mouse_report(unsigned char buttons, short dx, short dy) {
+    unsigned char flags = 0;
+    t_mouse_event new_event;
+    p_mouse_event event;
+
+    buttons &= (MOUSE_BUTTON_LEFT | MOUSE_BUTTON_RIGHT | MOUSE_BUTTON_MIDDLE);
+    if (dx || dy) {
+        flags |= MOUSE_EVENT_MOTION;
+    }
+    if (buttons != mouse_now.buttons) {
+        flags |= MOUSE_EVENT_BUTTONS;
+    }
+    if (flags == 0) {
+        return;
+    }
+
+    mouse_move(mouse_now.x + dx, mouse_now.y + dy);
+    mouse_now.buttons = buttons;
+    mouse_now.changes++;
+
+    if (mouse_opens == 0) {
+        /* Nobody is reading events */
+        return;
+    }
+
+    if (flags == MOUSE_EVENT_MOTION) {
+        /* If the reader is behind, fold plain motion into the newest event, if it is plain motion too */
+        event = (p_mouse_event)rb_newest(&mouse_events);
+        if (event && ((event->flags & ~MOUSE_EVENT_LOST) == MOUSE_EVENT_MOTION)) {
+            event->time = (unsigned long)rtc_get_jiffies();
+            event->x = mouse_now.x;
+            event->y = mouse_now.y;
+            event->dx = mouse_add(event->dx, dx);
+            event->dy = mouse_add(event->dy, dy);
+            return;
+        }
+    }
+
+    new_event.time = (unsigned long)rtc_get_jiffies();
+    new_event.x = mouse_now.x;
+    new_event.y = mouse_now.y;
+    new_event.dx = dx;
+    new_event.dy = dy;
+    new_event.buttons = buttons;
+    new_event.flags = flags | (mouse_lost ? MOUSE_EVENT_LOST : 0);
+    mouse_lost = (rb_write(&mouse_events, &new_event, 1) == 0);
+}
+
+/*
+ * Take the next mouse event from the queue
+ *
+ * The copy is made with interrupts off, since the handler may still be adding motion to
+ * the event being taken.
+ */
+short mouse_get_event(p_mouse_event event) {
+    short mask;
+    short result = 0;
+
+    mask = int_disable_all();
+    result = rb_read(&mouse_events, event, 1);
+    int_restore(mask);
+
+    return result;
+}
+
+/*
+ * Return the record of the pointer's position and buttons
+ */
+const t_mouse_state * mouse_state() {
+    return &mouse_now;
+}
+
+/*
+ * Move the pointer (clamped to the screen)
+ */
+void mouse_set_position(short x, short y) {
+    short mask;
+
+    mask = int_disable_all();
+    mouse_move(x, y);
+    mouse_now.changes++;
+    int_restore(mask);
+}
+
+short mouse_chan_init() {
+    return 0;
+}
+
+/*
+ * Open the mouse... events are queued from the first open on
+ */
+short mouse_chan_open(p_channel chan, const uint8_t * path, short mode) {
+    short mask;
+
+    mask = int_disable_all();
+    if (mouse_opens++ == 0) {
+        rb_init(&mouse_events, mouse_storage, sizeof(t_mouse_event), MOUSE_EVENTS);
+        mouse_lost = 0;
+    }
+    int_restore(mask);
+
+    return 0;
+}
+
+/*
+ * Close the mouse... the last close stops the queueing of events
+ */
+short mouse_chan_close(p_channel chan) {
+    short mask;
+
+    mask = int_disable_all();
+    if (mouse_opens > 0) {
+        mouse_opens--;
+    }
+    int_restore(mask);
+
+    return 0;
+}
+
+/*
+ * Read mouse events from the channel
+ *
+ * Only whole t_mouse_event records are returned. Blocks until at least one event is
+ * available, unless the channel is non-blocking (DEV_WOULD_BLOCK if there is none).
+ *
+ * Returns:
+ * the number of bytes read
+ */
+short mouse_chan_read(p_channel chan, uint8_t * buffer, short size) {
+    p_mouse_event events = (p_mouse_event)buffer;
+    short count = size / sizeof(t_mouse_event);
+    short i = 0;
+
+    if (count <= 0) {
+        return DEV_BOUNDS_ERR;
+    }
+
+    while (!mouse_get_event(&events[0])) {
+        if (chan->flags & CHAN_FLAG_NONBLOCK) {
+            return DEV_WOULD_BLOCK;
+        }
+        int_wait();
+    }
+
+    for (i = 1; (i < count) && mouse_get_event(&events[i]); i++) ;
+
+    return i * sizeof(t_mouse_event);
+}
+
+/*
+ * The mouse cannot be read a byte or line at a time
+ */
+short mouse_chan_read_b(p_channel chan) {
+    return DEV_CANNOT_READ;
+}
+
+short mouse_chan_readline(p_channel chan, uint8_t * buffer, short size) {
+    return DEV_CANNOT_READ;
+}
+
+/*
+ * The mouse cannot be written
+ */
+short mouse_chan_write(p_channel chan, const uint8_t * buffer, short size) {
+    return DEV_CANNOT_WRITE;
+}
+
+short mouse_chan_write_b(p_channel chan, uint8_t b) {
+    return DEV_CANNOT_WRITE;
+}
+
+short mouse_chan_status(p_channel chan) {
+    return rb_empty(&mouse_events) ? 0 : CDEV_STAT_READABLE;
+}
+
+short mouse_chan_flush(p_channel chan) {
+    return 0;
+}
+
+short mouse_chan_seek(p_channel chan, long position, short base) {
+    return 0;
+}
+
+/*
+ * Send a command to the mouse
+ *
+ * MOUSE_IOCTRL_SETXY = move the pointer: buffer holds the new x and y as two shorts.
+ */
+short mouse_chan_ioctrl(p_channel chan, short command, uint8_t * buffer, short size) {
+    short * position = (short *)buffer;
+
+    switch (command) {
+        case MOUSE_IOCTRL_SETXY:
+            if (size < 2 * sizeof(short)) {
+                return DEV_BOUNDS_ERR;
+            }
+            mouse_set_position(position[0], position[1]);
+            return 0;
+
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Install the MOUSE channel device
+ */
+short mouse_install() {
+    t_dev_chan dev;
+
+    mouse_now.x = 0;
+    mouse_now.y = 0;
+    mouse_now.buttons = 0;
+    mouse_now.reserved = 0;
+    mouse_now.changes = 0;
+    mouse_opens = 0;
+    mouse_lost = 0;
+    rb_init(&mouse_events, mouse_storage, sizeof(t_mouse_event), MOUSE_EVENTS);
+
+    dev.name = "MOUSE";
+    dev.number = CDEV_MOUSE;
+    dev.init = mouse_chan_init;
+    dev.open = mouse_chan_open;
+    dev.close = mouse_chan_close;
+    dev.read = mouse_chan_read;
+    dev.readline = mouse_chan_readline;
+    dev.read_b = mouse_chan_read_b;
+    dev.write = mouse_chan_write;
+    dev.write_b = mouse_chan_write_b;
+    dev.flush = mouse_chan_flush;
+    dev.seek = mouse_chan_seek;
+    dev.status = mouse_chan_status;
+    dev.ioctrl = mouse_chan_ioctrl;
+    dev.readv = 0;
+    dev.writev = 0;
+
+    return cdev_register(&dev);
+}
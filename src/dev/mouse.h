@@ -0,0 +1,117 @@
+/*
+ * Declarations for the mouse
+ *
+ * The mouse driver (the PS/2 port) hands each complete packet to mouse_report, which keeps
+ * the pointer's position and buttons, and queues events for programs to read through
+ * the system calls or the MOUSE channel.
+ */
+
+#ifndef __MOUSE_H
+#define __MOUSE_H
+
+#include "types.h"
+
+/*
+ * IOCTRL commands for the MOUSE channel
+ */
+
+#define MOUSE_IOCTRL_SETXY      0x0100      /* Move the pointer (buffer holds the x and y as two shorts) */
+
+/*
+ * Mouse buttons (bits in the buttons of an event or the mouse state)
+ */
+
+#define MOUSE_BUTTON_LEFT       0x01
+#define MOUSE_BUTTON_RIGHT      0x02
+#define MOUSE_BUTTON_MIDDLE     0x04
+
+/*
+ * Mouse event flags
+ */
+
+#define MOUSE_EVENT_MOTION      0x01        /* The pointer moved */
+#define MOUSE_EVENT_BUTTONS     0x02        /* The buttons changed */
+#define MOUSE_EVENT_LOST        0x04        /* Events were dropped just before this one (the queue was full) */
+
+/*
+ * A change in the mouse
+ *
+ * If the queue backs up, consecutive motion is gathered into the newest waiting motion
+ * event: dx and dy then add up all of the motion (stopping at the limits of a short),
+ * and x and y are where it ended.
+ */
+typedef struct s_mouse_event {
+    unsigned long time;                 /* When the (last) change happened (in jiffies) */
+    short x;                            /* Position of the pointer after the event */
+    short y;
+    short dx;                           /* Motion carried by the event (right and down are positive) */
+    short dy;
+    unsigned char buttons;              /* MOUSE_BUTTON_* held after the event */
+    unsigned char flags;                /* MOUSE_EVENT_* flags */
+} t_mouse_event, *p_mouse_event;
+
+/*
+ * The pointer's position and buttons right now, kept up to date by the driver
+ *
+ * A program may keep the pointer to this record and read it whenever it likes.
+ */
+typedef struct s_mouse_state {
+    volatile short x;                   /* Position of the pointer, within the screen */
+    volatile short y;
+    volatile unsigned char buttons;     /* MOUSE_BUTTON_* held */
+    unsigned char reserved;
+    volatile unsigned short changes;    /* Bumped on every change, so a reader can tell when the state moved */
+} t_mouse_state, *p_mouse_state;
+
+/*
+ * Report a packet from the mouse
+ *
+ * NOTE: called from the mouse interrupt handler.
+ *
+ * Inputs:
+ * buttons = MOUSE_BUTTON_* held
+ * dx = horizontal motion (right is positive)
+ * dy = vertical motion (down is positive)
+ */
+extern void mouse_report(unsigned char buttons, short dx, short dy);
+
+/*
+ * Take the next mouse event from the queue
+ *
+ * Events are only queued while the MOUSE channel is open. This includes events read
+ * through sys_mouse_event.
+ *
+ * Inputs:
+ * event = the record to fill in with the event
+ *
+ * Returns:
+ * 1 if an event was returned, 0 if there was none waiting
+ */
+extern short mouse_get_event(p_mouse_event event);
+
+/*
+ * Return the record of the pointer's position and buttons (kept up to date as the mouse moves)
+ */
+extern const t_mouse_state * mouse_state();
+
+/*
+ * Move the pointer (clamped to the screen)
+ *
+ * Inputs:
+ * x = the new column of the pointer, in pixels
+ * y = the new row of the pointer, in pixels
+ */
+extern void mouse_set_position(short x, short y);
+
+/*
+ * Install the MOUSE channel device
+ *
+ * Reading the channel returns whole t_mouse_event records. The device honors the
+ * channel's non-blocking flag (see CHAN_IOCTRL_NONBLOCK_ON).
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+extern short mouse_install();
+
+#endif
@@ -317,6 +317,65 @@ short pata_read(long lba, unsigned char * buffer, short size) {
     return i;
 }
 
+//
+// Read a run of consecutive blocks from the PATA drive
+//
+// The drive is given the whole run in one READ SECTORS command,
+// and then hands over the sectors one after the other.
+//
+// Inputs:
+//  lba = the logical block address of the first block to read
+//  buffer = the buffer into which to copy the block data
+//  count = the number of blocks to read
+//
+// Returns:
+//  number of blocks read, any negative number is an error code
+//
+short pata_read_blocks(unsigned long lba, unsigned char * buffer, short count) {
+    short block;
+    short i;
+    unsigned short *wptr;
+    TRACE("pata_read_blocks");
+
+    if ((count < 1) || (count > 255)) {
+        return DEV_BOUNDS_ERR;
+    }
+
+    if (pata_wait_ready_not_busy()) {
+        return DEV_TIMEOUT;
+    }
+
+    *PATA_HEAD = ((lba >> 24) & 0x07) | 0xe0;       // Upper 3 bits of LBA, Drive 0, LBA mode.
+    if (pata_wait_ready_not_busy()) {
+        return DEV_TIMEOUT;
+    }
+
+    *PATA_SECT_CNT = (unsigned char)count;          // Read the whole run
+    *PATA_SECT_SRT = lba & 0xff;                    // Set the rest of the LBA
+    *PATA_CLDR_LO = (lba >> 8) & 0xff;
+    *PATA_CLDR_HI = (lba >> 16) & 0xff;
+
+    *PATA_CMD_STAT = PATA_CMD_READ_SECTOR;          // Issue the READ command
+
+    wptr = (unsigned short *)buffer;
+    for (block = 0; block < count; block++) {
+        if (pata_wait_ready_not_busy()) {
+            return DEV_TIMEOUT;
+        }
+
+        if (pata_wait_data_request()) {
+            return DEV_TIMEOUT;
+        }
+
+        // Copy the sector... let the compiler and the FPGA worry about endianess
+        for (i = 0; i < PATA_SECTOR_SIZE; i += 2) {
+            *wptr++ = *PATA_DATA_16;
+        }
+    }
+
+    return count;
+}
+
 short pata_flush_cache() {
     long target_ticks;
     short i;
@@ -580,6 +639,8 @@ short pata_install() {
         bdev.status = pata_status;
         bdev.flush = pata_flush;
         bdev.ioctrl = pata_ioctrl;
+        bdev.read_blocks = pata_read_blocks;
+        bdev.write_blocks = 0;
 
         g_pata_status = PATA_STAT_PRESENT & PATA_STAT_NOINIT;
 
@@ -65,6 +65,19 @@ extern short pata_init();
 //
 extern short pata_read(long lba, unsigned char * buffer, short size);
 
+//
+// Read a run of consecutive blocks from the PATA hard drive
+//
+// Inputs:
+//  lba = the logical block address of the first block to read
+//  buffer = the buffer into which to copy the block data
+//  count = the number of blocks to read (1 - 255)
+//
+// Returns:
+//  number of blocks read, any negative number is an error code
+//
+extern short pata_read_blocks(unsigned long lba, unsigned char * buffer, short count);
+
 //
 // Write a block to the PATA hard drive
 //
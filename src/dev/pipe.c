@@ -0,0 +1,434 @@
+/*
+ * Implementation of the pipe channel device
+ *
+ * Each pipe has a ring buffer taken from the memory manager, and two
+ * channels from the channel table: one for the reader end and one for the
+ * writer end. The buffer is given back when both ends have been closed, or
+ * when the program that created the pipe exits (see pipe_release).
+ */
+
+#include "log.h"
+#include "errors.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "proc.h"
+#include "ring_buffer.h"
+#include "dev/channel.h"
+#include "dev/pipe.h"
+
+#define PIPE_END_READ       0           /* The channel is the reader end of the pipe */
+#define PIPE_END_WRITE      1           /* The channel is the writer end of the pipe */
+
+/*
+ * Structure to track a pipe
+ */
+typedef struct s_pipe {
+    short in_use;                       /* Non-zero if the pipe is allocated */
+    volatile short reader;              /* Channel number of the reader end (-1 if closed) */
+    volatile short writer;              /* Channel number of the writer end (-1 if closed) */
+    unsigned short tag;                 /* Memory tag of the program that created the pipe (0 for the kernel/CLI) */
+    t_byte_ring ring;                   /* The bytes in transit */
+} t_pipe, *p_pipe;
+
+/*
+ * Structure kept in the data area of a pipe channel
+ */
+typedef struct s_pipe_end {
+    short pipe;                         /* The number of the pipe */
+    short end;                          /* Which end of the pipe this is (PIPE_END_READ or PIPE_END_WRITE) */
+} t_pipe_end, *p_pipe_end;
+
+static t_pipe g_pipes[PIPE_MAX];
+
+/*
+ * Find the pipe behind a channel
+ *
+ * Inputs:
+ * chan = the channel
+ * end = which end of the pipe the caller needs (PIPE_END_READ or PIPE_END_WRITE)
+ *
+ * Returns:
+ * a pointer to the pipe, 0 if the channel is not that end of a pipe
+ */
+static p_pipe pipe_get(p_channel chan, short end) {
+    p_pipe_end pe = (p_pipe_end)chan->data;
+
+    if ((pe->pipe >= 0) && (pe->pipe < PIPE_MAX) && (pe->end == end) && g_pipes[pe->pipe].in_use) {
+        return &g_pipes[pe->pipe];
+    }
+
+    return 0;
+}
+
+/*
+ * Return true if the running code holds the pipe's ends
+ *
+ * The kernel is single tasking, so if the pipe belongs to the running program (or to
+ * the command line, when no program is running) nothing else can fill or empty it
+ * while the caller waits.
+ */
+static short pipe_held(p_pipe pipe) {
+    return pipe->tag == proc_get_tag();
+}
+
+/*
+ * Give a pipe's buffer back and free its channels
+ */
+static void pipe_free(p_pipe pipe) {
+    if (pipe->reader >= 0) {
+        chan_free(chan_get_record(pipe->reader));
+        pipe->reader = -1;
+    }
+
+    if (pipe->writer >= 0) {
+        chan_free(chan_get_record(pipe->writer));
+        pipe->writer = -1;
+    }
+
+    mem_free(MEM_OWN_KERNEL, (uint32_t)pipe->ring.buffer);
+    pipe->in_use = 0;
+}
+
+/*
+ * Initialize the pipe device
+ */
+short pipe_init() {
+    short i;
+
+    for (i = 0; i < PIPE_MAX; i++) {
+        g_pipes[i].in_use = 0;
+        g_pipes[i].reader = -1;
+        g_pipes[i].writer = -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Pipes cannot be opened by path... use pipe_create
+ */
+short pipe_open(p_channel chan, const uint8_t * path, short mode) {
+    return ERR_NOT_FOUND;
+}
+
+/*
+ * Close one end of a pipe
+ */
+short pipe_close(p_channel chan) {
+    p_pipe_end pe = (p_pipe_end)chan->data;
+    p_pipe pipe;
+
+    if ((pe->pipe < 0) || (pe->pipe >= PIPE_MAX)) {
+        return ERR_BADCHANNEL;
+    }
+
+    pipe = &g_pipes[pe->pipe];
+    if (pe->end == PIPE_END_READ) {
+        pipe->reader = -1;
+    } else {
+        pipe->writer = -1;
+    }
+
+    if ((pipe->reader < 0) && (pipe->writer < 0)) {
+        /* Both ends are closed: give the buffer back */
+        pipe_free(pipe);
+    }
+
+    return 0;
+}
+
+/*
+ * Read bytes from the reader end
+ *
+ * In blocking mode, waits until at least one byte is available or the writer
+ * has closed its end. In non-blocking mode, or if the caller holds the writer
+ * end itself (so waiting would never end), returns DEV_WOULD_BLOCK if the
+ * pipe is empty but the writer is still open. Returns 0 at end of file.
+ */
+short pipe_read(p_channel chan, uint8_t * buffer, short size) {
+    p_pipe pipe = pipe_get(chan, PIPE_END_READ);
+
+    if (pipe == 0) {
+        return DEV_CANNOT_READ;
+    }
+
+    if (chan->flags & CHAN_FLAG_NONBLOCK) {
+        if (rb_byte_empty(&pipe->ring) && (pipe->writer >= 0)) {
+            return DEV_WOULD_BLOCK;
+        }
+    } else {
+        while (rb_byte_empty(&pipe->ring) && (pipe->writer >= 0)) {
+            if (pipe_held(pipe)) {
+                return DEV_WOULD_BLOCK;
+            }
+            int_wait();
+        }
+    }
+
+    return (short)rb_byte_read(&pipe->ring, buffer, (unsigned short)size);
+}
+
+/*
+ * Read a single byte from the reader end
+ *
+ * Returns DEV_EOF once the writer has closed its end and the pipe is empty.
+ */
+short pipe_read_b(p_channel chan) {
+    uint8_t b;
+    short result = pipe_read(chan, &b, 1);
+
+    if (result == 1) {
+        return b;
+    } else if (result < 0) {
+        return result;
+    }
+
+    return DEV_EOF;
+}
+
+/*
+ * Read a line of text from the reader end (the newline is kept)
+ */
+short pipe_readline(p_channel chan, uint8_t * buffer, short size) {
+    short count = 0;
+    short n;
+
+    while (count < size - 1) {
+        n = pipe_read(chan, &buffer[count], 1);
+        if (n == DEV_WOULD_BLOCK) {
+            /* Non-blocking: hand back the partial line */
+            if (count == 0) {
+                return n;
+            }
+            break;
+        } else if (n < 0) {
+            return n;
+        } else if (n == 0) {
+            break;
+        }
+
+        if (buffer[count++] == '\n') {
+            break;
+        }
+    }
+
+    buffer[count] = 0;
+    return count;
+}
+
+/*
+ * Write bytes to the writer end
+ *
+ * In blocking mode, waits for room until every byte has been written.
+ * In non-blocking mode, or if the caller holds the reader end itself (so
+ * waiting would never end), writes what fits and returns the count (or
+ * DEV_WOULD_BLOCK if the pipe is full).
+ */
+short pipe_write(p_channel chan, const uint8_t * buffer, short size) {
+    p_pipe pipe = pipe_get(chan, PIPE_END_WRITE);
+    short count = 0;
+
+    if (pipe == 0) {
+        return DEV_CANNOT_WRITE;
+    }
+
+    while (1) {
+        if (pipe->reader < 0) {
+            /* Nobody will ever read this */
+            return (count > 0) ? count : DEV_CANNOT_WRITE;
+        }
+
+        count += rb_byte_write(&pipe->ring, buffer + count, (unsigned short)(size - count));
+        if ((count == size) || (chan->flags & CHAN_FLAG_NONBLOCK) || pipe_held(pipe)) {
+            break;
+        }
+
+        int_wait();
+    }
+
+    if ((count == 0) && (size > 0)) {
+        return DEV_WOULD_BLOCK;
+    }
+
+    return count;
+}
+
+/*
+ * Write a single byte to the writer end
+ */
+short pipe_write_b(p_channel chan, uint8_t b) {
+    short result = pipe_write(chan, &b, 1);
+    if (result < 0) {
+        return result;
+    }
+
+    return 0;
+}
+
+/*
+ * Get the status of one end of a pipe
+ */
+short pipe_status(p_channel chan) {
+    p_pipe_end pe = (p_pipe_end)chan->data;
+    p_pipe pipe;
+    short status = 0;
+
+    if ((pe->pipe < 0) || (pe->pipe >= PIPE_MAX) || !g_pipes[pe->pipe].in_use) {
+        return ERR_BADCHANNEL;
+    }
+
+    pipe = &g_pipes[pe->pipe];
+    if (pe->end == PIPE_END_READ) {
+        if (!rb_byte_empty(&pipe->ring)) {
+            status |= CDEV_STAT_READABLE;
+        } else if (pipe->writer < 0) {
+            status |= CDEV_STAT_EOF;
+        }
+
+    } else {
+        if (pipe->reader < 0) {
+            status |= CDEV_STAT_ERROR;
+        } else if (!rb_byte_full(&pipe->ring)) {
+            status |= CDEV_STAT_WRITABLE;
+        }
+    }
+
+    return status;
+}
+
+/*
+ * Nothing to flush: bytes are visible to the reader as soon as they are written
+ */
+short pipe_flush(p_channel chan) {
+    return 0;
+}
+
+/*
+ * Pipes cannot seek
+ */
+short pipe_seek(p_channel chan, long position, short base) {
+    return ERR_GENERAL;
+}
+
+/*
+ * No control commands yet
+ */
+short pipe_ioctrl(p_channel chan, short command, uint8_t * buffer, short size) {
+    return 0;
+}
+
+/*
+ * Create a pipe
+ *
+ * Inputs:
+ * reader = pointer to the short to set to the channel number of the reader end
+ * writer = pointer to the short to set to the channel number of the writer end
+ * flags = PIPE_BLOCK or PIPE_NONBLOCK
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+short pipe_create(short * reader, short * writer, short flags) {
+    p_channel rchan;
+    p_channel wchan;
+    p_pipe_end pe;
+    uint8_t * storage;
+    short i;
+
+    TRACE("pipe_create");
+
+    for (i = 0; i < PIPE_MAX; i++) {
+        if (!g_pipes[i].in_use) {
+            break;
+        }
+    }
+
+    if (i == PIPE_MAX) {
+        return ERR_OUT_OF_HANDLES;
+    }
+
+    storage = (uint8_t *)mem_alloc_top(MEM_OWN_KERNEL, PIPE_TAG + i, PIPE_SIZE);
+    if (storage == 0) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    rchan = chan_alloc(CDEV_PIPE);
+    if (rchan == 0) {
+        mem_free(MEM_OWN_KERNEL, (uint32_t)storage);
+        return ERR_OUT_OF_HANDLES;
+    }
+
+    wchan = chan_alloc(CDEV_PIPE);
+    if (wchan == 0) {
+        chan_free(rchan);
+        mem_free(MEM_OWN_KERNEL, (uint32_t)storage);
+        return ERR_OUT_OF_HANDLES;
+    }
+
+    rb_byte_init(&g_pipes[i].ring, storage, PIPE_SIZE);
+    g_pipes[i].reader = rchan->number;
+    g_pipes[i].writer = wchan->number;
+    g_pipes[i].tag = proc_get_tag();
+    g_pipes[i].in_use = 1;
+
+    pe = (p_pipe_end)rchan->data;
+    pe->pipe = i;
+    pe->end = PIPE_END_READ;
+
+    pe = (p_pipe_end)wchan->data;
+    pe->pipe = i;
+    pe->end = PIPE_END_WRITE;
+
+    if (flags & PIPE_NONBLOCK) {
+        rchan->flags |= CHAN_FLAG_NONBLOCK;
+        wchan->flags |= CHAN_FLAG_NONBLOCK;
+    }
+
+    *reader = rchan->number;
+    *writer = wchan->number;
+    return 0;
+}
+
+/*
+ * Close every pipe created by a program
+ *
+ * Inputs:
+ * tag = the memory tag of the program (see proc_get_tag)
+ */
+void pipe_release(unsigned short tag) {
+    short i;
+
+    for (i = 0; i < PIPE_MAX; i++) {
+        if (g_pipes[i].in_use && (g_pipes[i].tag == tag)) {
+            pipe_free(&g_pipes[i]);
+        }
+    }
+}
+
+/*
+ * Install the pipe channel device
+ */
+short pipe_install() {
+    t_dev_chan dev;
+
+    pipe_init();
+
+    dev.name = "PIPE";
+    dev.number = CDEV_PIPE;
+    dev.init = pipe_init;
+    dev.open = pipe_open;
+    dev.close = pipe_close;
+    dev.read = pipe_read;
+    dev.readline = pipe_readline;
+    dev.read_b = pipe_read_b;
+    dev.write = pipe_write;
+    dev.write_b = pipe_write_b;
+    dev.flush = pipe_flush;
+    dev.seek = pipe_seek;
+    dev.status = pipe_status;
+    dev.ioctrl = pipe_ioctrl;
+    dev.readv = 0;
+    dev.writev = 0;
+
+    return cdev_register(&dev);
+}
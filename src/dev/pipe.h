@@ -0,0 +1,56 @@
+/*
+ * Declarations for the pipe channel device
+ *
+ * A pipe is an in-memory ring buffer with two channels: bytes written to
+ * the writer end come out of the reader end, in order. Once the writer end
+ * is closed and the buffer has drained, the reader end is at end of file.
+ */
+
+#ifndef __PIPE_H
+#define __PIPE_H
+
+#include "dev/channel.h"
+
+#define PIPE_MAX            4           /* The maximum number of pipes open at once */
+#define PIPE_SIZE           0x1000      /* The size of a pipe's buffer (one memory page) */
+#define PIPE_TAG            0x7e00      /* Tag for the memory pages used by pipe buffers (plus the pipe number) */
+
+/*
+ * Flags for pipe_create
+ */
+#define PIPE_BLOCK          0x00        /* Reads wait for data, and writes wait for room */
+#define PIPE_NONBLOCK       0x01        /* Start both ends in non-blocking mode (see CHAN_IOCTRL_NONBLOCK_ON) */
+
+/*
+ * Install the pipe channel device
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+extern short pipe_install();
+
+/*
+ * Create a pipe
+ *
+ * Inputs:
+ * reader = pointer to the short to set to the channel number of the reader end
+ * writer = pointer to the short to set to the channel number of the writer end
+ * flags = PIPE_BLOCK or PIPE_NONBLOCK
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+extern short pipe_create(short * reader, short * writer, short flags);
+
+/*
+ * Close every pipe created by a program
+ *
+ * Both ends are closed and the buffer is given back, whether or not the
+ * program closed them itself. Called when a program exits.
+ *
+ * Inputs:
+ * tag = the memory tag of the program (see proc_get_tag)
+ */
+extern void pipe_release(unsigned short tag);
+
+#endif
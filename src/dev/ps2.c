@@ -12,6 +12,8 @@
 #include "interrupt.h"
 #include "simpleio.h"
 #include "vicky_general.h"
+#include "dev/key_event.h"
+#include "dev/mouse.h"
 #include "dev/ps2.h"
 #include "dev/rtc.h"
 #include "dev/text_screen_iii.h"
@@ -20,6 +22,9 @@
 #define PS2_TIMEOUT_JF          10          /* Timeout in jiffies: 1/60 second units */
 #define PS2_RESEND_MAX          50          /* Number of times we'll repeat a command on receiving a 0xFE reply */
 #define KBD_XLATE_TABLE_SIZE    128*8       /* Number of characters in the keyboard layout tables */
+#define KBD_BUFFER_SIZE         128         /* Number of entries in each of the keyboard ring buffers */
+#define MOUSE_SYNC              0x08        /* Bit that is always set in the first byte of a mouse packet */
+#define MOUSE_PACKET_GAP        2           /* Jiffies between bytes after which a packet is taken to be broken */
 
 /*
  * Modifier bit flags
@@ -70,7 +75,10 @@ struct s_ps2_kbd {
     unsigned char status;       /* Status of the keyboard */
     t_word_ring sc_buf;         /* Buffer containing scancodes that have been processed */
     t_word_ring char_buf;       /* Buffer containing characters to be read */
+    unsigned short sc_storage[KBD_BUFFER_SIZE];     /* Storage for sc_buf */
+    unsigned short char_storage[KBD_BUFFER_SIZE];   /* Storage for char_buf */
     unsigned char modifiers;    /* State of the modifier keys (CTRL, ALT, SHIFT) and caps lock */
+    t_key_queue key_events;                 /* Key events waiting to be read, and the keys held right now */
 
     /* Scan code to character lookup tables */
 
@@ -93,6 +101,8 @@ struct s_ps2_kbd {
 struct s_ps2_kbd g_kbd_control;
 
 short g_mouse_state = 0;                /* Mouse packet state machine's state */
+static unsigned char mouse_packet[3];   /* The bytes of the mouse packet being gathered */
+static long mouse_byte_time = 0;        /* When the last mouse byte arrived (in jiffies) */
 
 /*
  * Mapping of "codepoints" 0x80 - 0x95 (function keys, etc)
@@ -516,6 +526,7 @@ void kbd_enqueue_scan(unsigned char scan_code) {
                 break;
         }
 
+        key_event_note(&g_kbd_control.key_events, scan_code, g_kbd_control.modifiers);
         rb_word_put(&g_kbd_control.sc_buf, g_kbd_control.modifiers << 8 | scan_code);
     }
 }
@@ -530,6 +541,29 @@ unsigned short kbd_get_scancode() {
     return rb_word_get(&g_kbd_control.sc_buf);
 }
 
+/*
+ * Take the next key event from the queue
+ *
+ * Inputs:
+ * event = the record to fill in with the event
+ *
+ * Returns:
+ * 1 if an event was returned, 0 if there was none waiting
+ */
+short kbd_get_event(p_key_event event) {
+    return key_event_get(&g_kbd_control.key_events, event);
+}
+
+/*
+ * Return the record of which keys are held down right now
+ *
+ * The record stays in place and is updated as keys change, so a caller can keep the
+ * pointer and read it as often as it likes.
+ */
+const t_key_state * kbd_key_state() {
+    return &g_kbd_control.key_events.state;
+}
+
 /*
  * IRQ handler for the keyboard... read a scan code and queue it
  */
@@ -771,6 +805,19 @@ char kbd_to_ansi(unsigned char modifiers, unsigned char c) {
     }
 }
 
+/*
+ * Check if there is keyboard input waiting to be processed
+ *
+ * This does not translate or consume anything, so it is cheap enough to call
+ * when polling. A pending scan code may turn out not to produce a character.
+ *
+ * Returns:
+ *      non-zero if a character or scan code is waiting, 0 otherwise
+ */
+short kbd_input_pending() {
+    return !rb_word_empty(&g_kbd_control.char_buf) || !rb_word_empty(&g_kbd_control.sc_buf);
+}
+
 /*
  * Try to get a character from the keyboard...
  *
@@ -790,6 +837,14 @@ char kbd_getc() {
                 // If it's a make code, let's try to look it up...
                 unsigned char modifiers = (raw_code >> 8) & 0xff;    // Get the modifiers
                 unsigned char scan_code = raw_code & 0x7f;           // Get the base code for the key
+                unsigned char key = (unsigned char)g_kbd_control.keys_unmodified[scan_code];    // The key's code (the tables are signed char)
+
+                if ((modifiers & KBD_MOD_SHIFT) && ((key == KBD_KEY_PGUP) || (key == KBD_KEY_PGDN))) {
+                    // SHIFT-PgUp and SHIFT-PgDn page the main screen through its scrollback
+                    text_history_page(0, (key == KBD_KEY_PGUP) ? TEXT_HISTORY_UP : TEXT_HISTORY_DOWN);
+                    raw_code = kbd_get_scancode();
+                    continue;
+                }
 
                 if (scan_code < KBD_SC_PIVOT) {
                     // It's on the left side of the keyboard, use modifiers to determine lookup table
@@ -857,30 +912,67 @@ char kbd_getc() {
     }
 }
 
+/*
+ * Decode a complete PS/2 mouse packet and report it
+ *
+ * The first byte holds the buttons, the sign bits of the motion, and overflow flags.
+ * The second and third bytes hold the low eight bits of the X and Y motion. PS/2 counts
+ * Y upwards, the screen counts it down. A packet whose first byte is missing the sync
+ * bit is out of step with the mouse and is thrown away.
+ */
+static void mouse_decode(const unsigned char * packet) {
+    short dx;
+    short dy;
+
+    if ((packet[0] & MOUSE_SYNC) == 0) {
+        return;
+    }
+
+    if (packet[0] & 0xC0) {
+        /* The motion overflowed, so the counts are meaningless: keep just the buttons */
+        dx = 0;
+        dy = 0;
+    } else {
+        dx = (short)packet[1] - ((packet[0] & 0x10) ? 0x100 : 0);
+        dy = (short)packet[2] - ((packet[0] & 0x20) ? 0x100 : 0);
+    }
+
+    mouse_report(packet[0] & 0x07, dx, -dy);
+}
+
 /*
  * Handle an interrupt from the PS/2 mouse port
  */
 void mouse_handle_irq() {
     //unsigned char status = *PS2_STATUS;
     unsigned char mouse_byte = *PS2_DATA_BUF;
+    long now = rtc_get_jiffies();
 
     /* Clear the pending interrupt flag for the mouse */
     int_clear(INT_MOUSE);
 
-    if ((g_mouse_state == 0) && ((mouse_byte & 0x08) != 0x08)) {
+    if ((g_mouse_state != 0) && (now - mouse_byte_time > MOUSE_PACKET_GAP)) {
+        /* The rest of the last packet never came: this byte starts a new one */
+        g_mouse_state = 0;
+    }
+    mouse_byte_time = now;
+
+    if ((g_mouse_state == 0) && ((mouse_byte & MOUSE_SYNC) != MOUSE_SYNC)) {
         /*
-         * If this is the first byte in the packet, bit 4 must be set
+         * If this is the first byte in the packet, bit 3 must be set
          * If it is not, ignore the byte... we're out of synch
          */
         return;
 
     } else {
         /* Send the byte to Vicky */
-        MousePtr_A_Mouse0[g_mouse_state++] = (unsigned short)mouse_byte;
+        MousePtr_A_Mouse0[g_mouse_state] = (unsigned short)mouse_byte;
+        mouse_packet[g_mouse_state++] = mouse_byte;
 
-        /* After three bytes, return to state 0 */
+        /* After three bytes, report the packet and return to state 0 */
         if (g_mouse_state > 2) {
             g_mouse_state = 0;
+            mouse_decode(mouse_packet);
         }
     }
 }
@@ -950,8 +1042,11 @@ short ps2_mouse_get_packet() {
 
         /* Send the byte to Vicky */
         MousePtr_A_Mouse0[i] = (unsigned short)data;
+        mouse_packet[i] = data;
     }
 
+    mouse_decode(mouse_packet);
+
     return 0;
 }
 
@@ -1153,8 +1248,9 @@ short ps2_init() {
     // Initialize the keyboard controller variables
 
     g_kbd_control.state = KBD_ST_IDLE;          // Initial state for the scan code state machine
-    rb_word_init(&g_kbd_control.sc_buf);        // Scan-code ring buffer is empty
-    rb_word_init(&g_kbd_control.char_buf);      // Character ring buffer is empty
+    rb_word_init(&g_kbd_control.sc_buf, g_kbd_control.sc_storage, KBD_BUFFER_SIZE);   // Scan-code ring buffer is empty
+    rb_word_init(&g_kbd_control.char_buf, g_kbd_control.char_storage, KBD_BUFFER_SIZE); // Character ring buffer is empty
+    key_event_init(&g_kbd_control.key_events);  // Key event queue is empty and no keys are down
 
     // Set the default keyboard layout to US
 
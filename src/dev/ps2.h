@@ -36,6 +36,22 @@ extern short ps2_init();
  */
 extern unsigned short kbd_get_scancode();
 
+/*
+ * Take the next key event from the queue
+ *
+ * Inputs:
+ * event = the record to fill in with the event
+ *
+ * Returns:
+ * 1 if an event was returned, 0 if there was none waiting
+ */
+extern short kbd_get_event(p_key_event event);
+
+/*
+ * Return the record of which keys are held down right now (kept up to date as keys change)
+ */
+extern const t_key_state * kbd_key_state();
+
 /*
  * Try to get a character from the keyboard...
  *
@@ -44,6 +60,14 @@ extern unsigned short kbd_get_scancode();
  */
 extern char kbd_getc();
 
+/*
+ * Check if there is keyboard input waiting to be processed (nothing is consumed)
+ *
+ * Returns:
+ *      non-zero if a character or scan code is waiting, 0 otherwise
+ */
+extern short kbd_input_pending();
+
 /*
  * Set the keyboard translation tables
  *
@@ -416,6 +416,8 @@ short sdc_install() {
     dev.flush = sdc_flush;
     dev.status = sdc_status;
     dev.ioctrl = sdc_ioctrl;
+    dev.read_blocks = 0;                // The SDC controller moves one block per transaction
+    dev.write_blocks = 0;
 
     return bdev_register(&dev);
 }
@@ -3,6 +3,9 @@
  */
 
 #include "constants.h"
+#include "errors.h"
+#include "interrupt.h"
+#include "memory.h"
 #include "vicky_general.h"
 #include "text_screen_iii.h"
 #include "simpleio.h"
@@ -10,6 +13,15 @@
 
 #define MAX_TEXT_CHANNELS 2
 
+#define TEXT_COLUMNS_MAX    128         /* The most columns any resolution has */
+#define TEXT_ROWS_MAX       96          /* The most rows any resolution has */
+#define TEXT_CELLS_MAX      (TEXT_COLUMNS_MAX * TEXT_ROWS_MAX)
+#define TEXT_DIRTY_LONGS    ((TEXT_ROWS_MAX + 31) / 32)
+#define TEXT_SHADOW_SIZE    (2 * TEXT_CELLS_MAX)    /* Text cells, then color cells */
+#define TEXT_SHADOW_TAG     0x7d00      /* Tag for the memory pages used by the shadows (plus the screen number) */
+#define TEXT_HISTORY_LINE   (2 * TEXT_COLUMNS_MAX)  /* Bytes per scrollback line: the characters, then their colors */
+#define TEXT_HISTORY_TAG    0x7c00      /* Tag for the memory pages used by the scrollback (plus the screen number) */
+
 /*
  * Structure to hold pointers to the text channel's registers and memory
  */
@@ -27,14 +39,38 @@ typedef struct s_text_channel {
     short rows_max;
     short columns_visible;
     short rows_visible;
+    short pixels_x;                         /* Width of the display in pixels (from the resolution) */
+    short pixels_y;                         /* Height of the display in pixels (from the resolution) */
 
     short x;
     short y;
     volatile char * text_cursor_ptr;
     volatile unsigned char * color_cursor_ptr;
+
+    /*
+     * With the shadow on, text_cells and color_cells point into the shadow in RAM,
+     * and the rows marked dirty are copied to VICKY on the next start of frame.
+     */
+    volatile char * vram_text_cells;        /* The text cells in VICKY */
+    volatile char * vram_color_cells;       /* The color cells in VICKY */
+    char * shadow;                          /* The RAM shadow of the cells (0 if the shadow is off) */
+    unsigned long dirty[TEXT_DIRTY_LONGS];  /* Bitmap of the rows changed since the last flush */
+
+    /*
+     * Scrollback: rows that scroll off the top go into a ring. While the view is
+     * scrolled back, the live screen carries on in the shadow, and VICKY shows the history.
+     */
+    char * history;                         /* The ring of scrolled-off lines (0 if there is no scrollback) */
+    short history_lines;                    /* The number of lines the ring can hold */
+    short history_head;                     /* The index of the next line to write */
+    short history_count;                    /* The number of lines in the ring */
+    short history_view;                     /* How many lines the view is scrolled back (0 for the live screen) */
+    short history_own_shadow;               /* Non-zero if the shadow was turned on just for the view */
 } t_text_channel, *p_text_channel;
 
 static t_text_channel text_channel[MAX_TEXT_CHANNELS];
+static p_int_handler text_sof_next = 0;     /* The SOF handler that was there before the shadow flush (0 if none) */
+static short text_sof_hooked = 0;           /* Non-zero once the shadow flush is on the SOF interrupt */
 
 //  0xHHLL, 0xHHLL
 //  0xGGBB, 0xAARR
@@ -78,6 +114,9 @@ const unsigned short bg_color_lut [32] = {
 
 /*
  * Initialize the text screen driver
+ *
+ * If the screens already have a shadow or a scrollback ring (text_init can run more than once
+ * while booting), those blocks are given back, and the screens start without them.
  */
 int text_init() {
     short need_hires = 0;
@@ -98,12 +137,32 @@ int text_init() {
         text_channel[i].border_control = 0xffffffff;
         text_channel[i].text_cursor_ptr = 0xffffffff;
         text_channel[i].color_cursor_ptr = 0xffffffff;
+        text_channel[i].vram_text_cells = 0xffffffff;
+        text_channel[i].vram_color_cells = 0xffffffff;
         #pragma popwarn
+        if (text_channel[i].shadow) {
+            mem_free(MEM_OWN_KERNEL, (uint32_t)text_channel[i].shadow);
+        }
+        text_channel[i].shadow = 0;
+        for (x = 0; x < TEXT_DIRTY_LONGS; x++) {
+            text_channel[i].dirty[x] = 0;
+        }
+        if (text_channel[i].history) {
+            mem_free(MEM_OWN_KERNEL, (uint32_t)text_channel[i].history);
+        }
+        text_channel[i].history = 0;
+        text_channel[i].history_lines = 0;
+        text_channel[i].history_head = 0;
+        text_channel[i].history_count = 0;
+        text_channel[i].history_view = 0;
+        text_channel[i].history_own_shadow = 0;
         text_channel[i].current_color = 0;
         text_channel[i].columns_max = 0;
         text_channel[i].rows_max = 0;
         text_channel[i].columns_visible = 0;
         text_channel[i].rows_visible = 0;
+        text_channel[i].pixels_x = 0;
+        text_channel[i].pixels_y = 0;
         text_channel[i].x = 0;
         text_channel[i].y = 0;
     }
@@ -125,6 +184,8 @@ int text_init() {
     chan_a->master_control = MasterControlReg_A;
     chan_a->text_cells = ScreenText_A;
     chan_a->color_cells = ColorText_A;
+    chan_a->vram_text_cells = ScreenText_A;
+    chan_a->vram_color_cells = ColorText_A;
     chan_a->cursor_settings = CursorControlReg_L_A;
     chan_a->cursor_position = CursorControlReg_H_A;
     chan_a->border_control = BorderControlReg_L_A;
@@ -157,6 +218,8 @@ int text_init() {
     chan_b->master_control = MasterControlReg_B;
     chan_b->text_cells = ScreenText_B;
     chan_b->color_cells = ColorText_B;
+    chan_b->vram_text_cells = ScreenText_B;
+    chan_b->vram_color_cells = ColorText_B;
     chan_b->cursor_settings = CursorControlReg_L_B;
     chan_b->cursor_position = CursorControlReg_H_B;
     chan_b->border_control = BorderControlReg_L_B;
@@ -232,6 +295,52 @@ void text_set_cursor(short screen, short color, char character, short rate, shor
     }
 }
 
+/*
+ * Show or hide the cursor without changing its other properties
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * enable = 1 to display the cursor, 0 to hide it
+ */
+void text_set_cursor_visible(short screen, short enable) {
+    if (screen < MAX_TEXT_CHANNELS) {
+        p_text_channel chan = &text_channel[screen];
+        unsigned long settings = *(chan->cursor_settings);
+
+        settings &= ~0x01;
+        if (enable) {
+            settings |= 0x01;
+        }
+
+        *(chan->cursor_settings) = settings;
+    }
+}
+
+/*
+ * Move the hardware cursor and the internal print pointers to the channel's x and y
+ */
+static void text_update_cursor(p_text_channel chan) {
+    short offset = chan->y * chan->columns_max + chan->x;
+
+    *(chan->cursor_position) = ((unsigned long)chan->y << 16) | (unsigned long)chan->x;
+    chan->text_cursor_ptr = &chan->text_cells[offset];
+    chan->color_cursor_ptr = &chan->color_cells[offset];
+}
+
+/*
+ * Note that rows of the shadow have changed and need to go to VICKY
+ *
+ * Call this after changing the cells, so the SOF flush cannot miss the change.
+ */
+static void text_mark_rows(p_text_channel chan, short first, short last) {
+    if (chan->shadow) {
+        short row;
+        for (row = first; row <= last; row++) {
+            chan->dirty[row >> 5] |= 1UL << (row & 31);
+        }
+    }
+}
+
 /*
  * Set the position of the cursor on the screen. Adjusts internal pointers used for printing the characters
  *
@@ -261,10 +370,7 @@ void text_set_xy(short screen, unsigned short x, unsigned short y) {
         chan->x = x;
         chan->y = y;
 
-        *(chan->cursor_position) = ((unsigned long)y << 16) | (unsigned long)x;
-        short offset = y * chan->columns_max + x;
-        chan->text_cursor_ptr = &chan->text_cells[offset];
-        chan->color_cursor_ptr = &chan->color_cells[offset];
+        text_update_cursor(chan);
     }
 }
 
@@ -306,21 +412,29 @@ void text_setsizes(short screen) {
             case 0: /* 640x480 */
                 chan->columns_max = 80;
                 chan->rows_max = 60;
+                chan->pixels_x = 640;
+                chan->pixels_y = 480;
                 break;
 
             case 1: /* 800x600 */
                 chan->columns_max = 100;
                 chan->rows_max = 75;
+                chan->pixels_x = 800;
+                chan->pixels_y = 600;
                 break;
 
             case 2: /* 1024x768 */
                 chan->columns_max = 128;
                 chan->rows_max = 96;
+                chan->pixels_x = 1024;
+                chan->pixels_y = 768;
                 break;
 
             case 3: /* 640x400 */
                 chan->columns_max = 80;
                 chan->rows_max = 50;
+                chan->pixels_x = 640;
+                chan->pixels_y = 400;
                 break;
 
             default:
@@ -356,6 +470,24 @@ void text_setsizes(short screen) {
     }
 }
 
+/*
+ * Get the size of the display in pixels, as last computed by text_setsizes
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * width = pointer to the width to set
+ * height = pointer to the height to set
+ */
+void text_get_pixels(short screen, short * width, short * height) {
+    if (screen < MAX_TEXT_CHANNELS) {
+        *width = text_channel[screen].pixels_x;
+        *height = text_channel[screen].pixels_y;
+    } else {
+        *width = 0;
+        *height = 0;
+    }
+}
+
 /*
  * Set the foreground and background color for printing
  *
@@ -387,6 +519,119 @@ void text_get_color(short screen, short * foreground, short * background) {
     }
 }
 
+/*
+ * Copy text or color cells from lower to higher addresses
+ *
+ * Moves longs whenever source and destination can both be word aligned, which
+ * is most of the time (rows start on even addresses). Safe for overlapping
+ * regions as long as dest is below src.
+ */
+static void text_copy_cells(volatile char * dest, volatile char * src, short count) {
+    if (((((unsigned long)dest ^ (unsigned long)src) & 1) == 0) && (count >= 4)) {
+        volatile unsigned long * ldest;
+        volatile unsigned long * lsrc;
+        short longs;
+
+        if ((unsigned long)dest & 1) {
+            *dest++ = *src++;
+            count--;
+        }
+
+        ldest = (volatile unsigned long *)dest;
+        lsrc = (volatile unsigned long *)src;
+        for (longs = count >> 2; longs > 0; longs--) {
+            *ldest++ = *lsrc++;
+        }
+
+        dest = (volatile char *)ldest;
+        src = (volatile char *)lsrc;
+        count &= 3;
+    }
+
+    while (count-- > 0) {
+        *dest++ = *src++;
+    }
+}
+
+/*
+ * Copy text or color cells from higher to lower addresses
+ *
+ * The mirror of text_copy_cells, for overlapping regions where dest is above src.
+ */
+static void text_copy_cells_back(volatile char * dest, volatile char * src, short count) {
+    dest += count;
+    src += count;
+
+    if (((((unsigned long)dest ^ (unsigned long)src) & 1) == 0) && (count >= 4)) {
+        volatile unsigned long * ldest;
+        volatile unsigned long * lsrc;
+        short longs;
+
+        if ((unsigned long)dest & 1) {
+            *--dest = *--src;
+            count--;
+        }
+
+        ldest = (volatile unsigned long *)dest;
+        lsrc = (volatile unsigned long *)src;
+        for (longs = count >> 2; longs > 0; longs--) {
+            *--ldest = *--lsrc;
+        }
+
+        dest = (volatile char *)ldest;
+        src = (volatile char *)lsrc;
+        count &= 3;
+    }
+
+    while (count-- > 0) {
+        *--dest = *--src;
+    }
+}
+
+/*
+ * Fill text or color cells with a value, a long at a time
+ */
+static void text_fill_cells(volatile char * dest, unsigned char value, short count) {
+    if (count >= 4) {
+        volatile unsigned long * ldest;
+        unsigned long lvalue = value;
+        short longs;
+
+        if ((unsigned long)dest & 1) {
+            *dest++ = value;
+            count--;
+        }
+
+        lvalue |= lvalue << 8;
+        lvalue |= lvalue << 16;
+
+        ldest = (volatile unsigned long *)dest;
+        for (longs = count >> 2; longs > 0; longs--) {
+            *ldest++ = lvalue;
+        }
+
+        dest = (volatile char *)ldest;
+        count &= 3;
+    }
+
+    while (count-- > 0) {
+        *dest++ = value;
+    }
+}
+
+/*
+ * Blank a range of cells: spaces in the current color
+ */
+static void text_blank_cells(p_text_channel chan, short start, short count) {
+    if (count > 0) {
+        text_fill_cells(&chan->text_cells[start], ' ', count);
+        text_fill_cells(&chan->color_cells[start], chan->current_color, count);
+        if (chan->shadow) {
+            text_mark_rows(chan, start / chan->columns_max, (start + count - 1) / chan->columns_max);
+        }
+    }
+}
+
 /*
  * Clear the screen of data
  *
@@ -398,41 +643,29 @@ void text_get_color(short screen, short * foreground, short * background) {
  */
 void text_clear(short screen, short mode) {
     if (screen < MAX_TEXT_CHANNELS) {
-        int i;
-        int sos_index = 0;
         p_text_channel chan = &text_channel[screen];
-        int eos_index = chan->columns_max * chan->rows_max;
-        int cursor_index = chan->y * chan->columns_max + chan->x;
-
-        // switch (mode) {
-        //     case 0:
-        //         /* Clear from cursor to the end of the screen */
-        //         for (i = cursor_index; i < eos_index; i++) {
-        //             chan->text_cells[i] = ' ';
-        //             chan->color_cells[i] = chan->current_color;
-        //         }
-        //         break;
-        //
-        //     case 1:
-        //         /* Clear from (0, 0) to cursor */
-        //         for (i = sos_index; i <= cursor_index; i++) {
-        //             chan->text_cells[i] = ' ';
-        //             chan->color_cells[i] = chan->current_color;
-        //         }
-        //         break;
-        //
-        //     case 2:
+        short eos_index = chan->columns_max * chan->rows_max;
+        short cursor_index = chan->y * chan->columns_max + chan->x;
+
+        switch (mode) {
+            case 0:
+                /* Clear from cursor to the end of the screen */
+                text_blank_cells(chan, cursor_index, eos_index - cursor_index);
+                break;
+
+            case 1:
+                /* Clear from (0, 0) to cursor */
+                text_blank_cells(chan, 0, cursor_index + 1);
+                break;
+
+            case 2:
                 /* Clear entire screen */
-                for (i = 0; i < 0x2000; i++) {
-                    chan->text_cells[i] = ' ';
-                    chan->color_cells[i] = chan->current_color;
-                }
+                text_blank_cells(chan, 0, eos_index);
+                break;
 
-        //         break;
-        //
-        //     default:
-        //         break;
-        // }
+            default:
+                break;
+        }
     }
 }
 
@@ -447,35 +680,24 @@ void text_clear(short screen, short mode) {
  */
 void text_clear_line(short screen, short mode) {
     if (screen < MAX_TEXT_CHANNELS) {
-        int i;
         p_text_channel chan = &text_channel[screen];
-        int sol_index = chan->y * chan->columns_max;
-        int eol_index = (chan->y + 1) * chan->columns_max;
-        int cursor_index = chan->y * chan->columns_max + chan->x;
+        short sol_index = chan->y * chan->columns_max;
+        short cursor_index = sol_index + chan->x;
 
         switch (mode) {
             case 0:
                 /* Clear from cursor to the end of the line */
-                for (i = cursor_index; i < eol_index; i++) {
-                    chan->text_cells[i] = ' ';
-                    chan->color_cells[i] = chan->current_color;
-                }
+                text_blank_cells(chan, cursor_index, chan->columns_max - chan->x);
                 break;
 
             case 1:
                 /* Clear from (0, y) to cursor */
-                for (i = sol_index; i <= cursor_index; i++) {
-                    chan->text_cells[i] = ' ';
-                    chan->color_cells[i] = chan->current_color;
-                }
+                text_blank_cells(chan, sol_index, chan->x + 1);
                 break;
 
             case 2:
-                /* Clear entire screen */
-                for (i = sol_index; i < eol_index; i++) {
-                    chan->text_cells[i] = ' ';
-                    chan->color_cells[i] = chan->current_color;
-                }
+                /* Clear entire line */
+                text_blank_cells(chan, sol_index, chan->columns_max);
                 break;
 
             default:
@@ -487,79 +709,102 @@ void text_clear_line(short screen, short mode) {
 /*
  * Insert a number of characters at the cursor position
  *
+ * Characters from the cursor on are pushed right (and off the end of the line).
+ *
  * Inputs:
  * screen = the screen number 0 for channel A, 1 for channel B
  * count = the number of characters to insert
  */
 void text_insert(short screen, short count) {
-    int i;
-    p_text_channel chan = &text_channel[screen];
-    int eol_index = (chan->y + 1) * chan->columns_max - 1;
-    int cursor_index = chan->y * chan->columns_max + chan->x;
+    if (screen < MAX_TEXT_CHANNELS) {
+        p_text_channel chan = &text_channel[screen];
+        short cursor_index = chan->y * chan->columns_max + chan->x;
+        short remaining = chan->columns_max - chan->x;
 
-    for (i = cursor_index; i < eol_index; i++) {
-        chan->text_cells[i+1] = chan->text_cells[i];
-        chan->color_cells[i+1] = chan->color_cells[i];
-    }
+        if (count > remaining) {
+            count = remaining;
+        }
 
-    chan->text_cells[cursor_index] = ' ';
-    chan->color_cells[cursor_index] = chan->current_color;
+        if (count > 0) {
+            text_copy_cells_back(&chan->text_cells[cursor_index + count], &chan->text_cells[cursor_index], remaining - count);
+            text_copy_cells_back(&chan->color_cells[cursor_index + count], &chan->color_cells[cursor_index], remaining - count);
+            text_blank_cells(chan, cursor_index, count);
+        }
+    }
 }
 
 /*
  * Delete a number of characters at the cursor position
  *
+ * Characters to the right are pulled left, and the end of the line is blanked.
+ *
  * Inputs:
  * screen = the screen number 0 for channel A, 1 for channel B
  * count = the number of characters to delete
  */
 void text_delete(short screen, short count) {
-    int i;
-    p_text_channel chan = &text_channel[screen];
-    int eol_index = (chan->y + 1) * chan->columns_max - 1;
-    int cursor_index = chan->y * chan->columns_max + chan->x;
+    if (screen < MAX_TEXT_CHANNELS) {
+        p_text_channel chan = &text_channel[screen];
+        short cursor_index = chan->y * chan->columns_max + chan->x;
+        short remaining = chan->columns_max - chan->x;
+
+        if (count > remaining) {
+            count = remaining;
+        }
+
+        if (count > 0) {
+            text_copy_cells(&chan->text_cells[cursor_index], &chan->text_cells[cursor_index + count], remaining - count);
+            text_copy_cells(&chan->color_cells[cursor_index], &chan->color_cells[cursor_index + count], remaining - count);
+            text_blank_cells(chan, cursor_index + remaining - count, count);
+        }
+    }
+}
 
-    for (i = cursor_index; i < eol_index; i++) {
-        chan->text_cells[i] = chan->text_cells[i+1];
-        chan->color_cells[i] = chan->color_cells[i+1];
+/*
+ * Save the top row of the screen in the scrollback ring
+ */
+static void text_history_append(p_text_channel chan) {
+    char * line = &chan->history[chan->history_head * TEXT_HISTORY_LINE];
+
+    text_copy_cells(line, chan->text_cells, chan->columns_max);
+    text_copy_cells(&line[TEXT_COLUMNS_MAX], chan->color_cells, chan->columns_max);
+
+    if (++chan->history_head >= chan->history_lines) {
+        chan->history_head = 0;
     }
 
-    chan->text_cells[eol_index] = ' ';
-    chan->color_cells[eol_index] = chan->current_color;
+    if (chan->history_count < chan->history_lines) {
+        chan->history_count++;
+    }
+
+    if ((chan->history_view > 0) && (chan->history_view < chan->history_count)) {
+        /* Keep the view on the same lines: nothing on screen needs to change */
+        chan->history_view++;
+    }
 }
 
 /*
  * Scroll the text screen up one row
+ *
+ * Rows are contiguous in text memory, so the visible rows move up as one block.
+ * If the screen has a scrollback ring, the top row is saved in it first.
+ *
  * Inputs:
  * screen = the screen number 0 for channel A, 1 for channel B
  */
 void text_scroll(short screen) {
     if (screen < MAX_TEXT_CHANNELS) {
-        short row, column;
         p_text_channel chan = &text_channel[screen];
+        short count = (chan->rows_visible - 1) * chan->columns_max;
 
-        for (row = 0; row < chan->rows_visible - 1; row++) {
-            short offset1 = row * chan->columns_max;
-            short offset2 = (row + 1) * chan->columns_max;
-            volatile short * text_dest = (short*)&chan->text_cells[offset1];
-            volatile short * color_dest = (short*)&chan->color_cells[offset1];
-            volatile short * text_src = (short*)&chan->text_cells[offset2];
-            volatile short * color_src = (short*)&chan->color_cells[offset2];
-
-            for (column = 0; column < chan->columns_max; column += 2) {
-                *text_dest++ = *text_src++;
-                *color_dest++ = *color_src++;
-            }
+        if (chan->history) {
+            text_history_append(chan);
         }
 
-        short offset3 = (chan->rows_visible - 1) * chan->columns_max;
-        volatile short * text_dest = (short*)&chan->text_cells[offset3];
-        volatile short * color_dest = (short*)&chan->color_cells[offset3];
-        uint8_t color = chan->current_color;
-        for (column = 0; column < chan->columns_max; column += 2) {
-            *text_dest++ = ' ';
-            *color_dest++ = color << 8 | color;
-        }
+        text_copy_cells(chan->text_cells, &chan->text_cells[chan->columns_max], count);
+        text_copy_cells(chan->color_cells, &chan->color_cells[chan->columns_max], count);
+        text_blank_cells(chan, count, chan->columns_max);
+        text_mark_rows(chan, 0, chan->rows_visible - 1);
     }
 }
 
@@ -588,6 +833,7 @@ void text_put_raw(short screen, char c) {
                 text_set_xy(screen, chan->x - 1, chan->y);
                 *chan->text_cursor_ptr = ' ';
                 *chan->color_cursor_ptr = chan->current_color;
+                text_mark_rows(chan, chan->y, chan->y);
             }
             break;
 
@@ -600,8 +846,369 @@ void text_put_raw(short screen, char c) {
         default:
             *chan->text_cursor_ptr++ = c;
             *chan->color_cursor_ptr++ = chan->current_color;
+            text_mark_rows(chan, chan->y, chan->y);
             text_set_xy(screen, chan->x + 1, chan->y);
             break;
         }
     }
 }
+
+/*
+ * Send a run of printable characters to the screen
+ *
+ * The characters are copied straight into text memory a line at a time,
+ * wrapping and scrolling as needed, and the cursor is moved once at the end.
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * s = the characters to print
+ * count = the number of characters to print
+ */
+void text_put_run(short screen, const char * s, short count) {
+    if ((screen >= 0) && (screen < MAX_TEXT_CHANNELS)) {
+        p_text_channel chan = &text_channel[screen];
+        unsigned char color = chan->current_color;
+        short x;
+        short y;
+
+        if ((chan->x < 0) || (chan->x >= chan->columns_visible) || (chan->y < 0) || (chan->y >= chan->rows_visible)) {
+            /* The cursor is off the visible screen (e.g. after a resize): wrap it back on first */
+            text_set_xy(screen, chan->x, chan->y);
+            if ((chan->x >= chan->columns_visible) || (chan->y >= chan->rows_visible)) {
+                /* Still not on the screen: leave it to the slow path */
+                while (count-- > 0) {
+                    text_put_raw(screen, *s++);
+                }
+                return;
+            }
+        }
+
+        x = chan->x;
+        y = chan->y;
+        while (count > 0) {
+            volatile char * text_dest;
+            volatile unsigned char * color_dest;
+            short n = chan->columns_visible - x;
+
+            /* Only as much as fits on this line */
+            if (n > count) {
+                n = count;
+            }
+            count -= n;
+
+            text_dest = &chan->text_cells[y * chan->columns_max + x];
+            color_dest = (volatile unsigned char *)&chan->color_cells[y * chan->columns_max + x];
+            x += n;
+
+            while (n-- > 0) {
+                *text_dest++ = *s++;
+                *color_dest++ = color;
+            }
+            text_mark_rows(chan, y, y);
+
+            if (x >= chan->columns_visible) {
+                /* Wrap to the next line, scrolling if we're at the bottom */
+                x = 0;
+                if (++y >= chan->rows_visible) {
+                    y = chan->rows_visible - 1;
+                    text_scroll(screen);
+                }
+            }
+        }
+
+        chan->x = x;
+        chan->y = y;
+        text_update_cursor(chan);
+    }
+}
+
+/*
+ * Copy the dirty rows of a channel's shadow to VICKY
+ */
+static void text_flush_rows(p_text_channel chan) {
+    unsigned long bits;
+    short offset;
+    short row;
+    short i;
+
+    for (i = 0; i < TEXT_DIRTY_LONGS; i++) {
+        bits = chan->dirty[i];
+        if (bits) {
+            chan->dirty[i] = 0;
+            for (row = i * 32; bits; row++, bits >>= 1) {
+                if (bits & 1) {
+                    offset = row * chan->columns_max;
+                    text_copy_cells(&chan->vram_text_cells[offset], &chan->text_cells[offset], chan->columns_max);
+                    text_copy_cells(&chan->vram_color_cells[offset], &chan->color_cells[offset], chan->columns_max);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Start of frame handler: bring VICKY up to date with the shadows
+ */
+static void text_sof_handler() {
+    short i;
+
+    for (i = 0; i < MAX_TEXT_CHANNELS; i++) {
+        if (text_channel[i].shadow && (text_channel[i].history_view == 0)) {
+            /* Not while the scrollback is on screen: the rows stay dirty until the view returns */
+            text_flush_rows(&text_channel[i]);
+        }
+    }
+
+    if (text_sof_next) {
+        /* Pass the interrupt along (e.g. to the jiffy counter) */
+        text_sof_next();
+    }
+}
+
+/*
+ * Turn the RAM shadow of a text screen on or off
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * enable = non-zero to draw into a shadow in RAM, 0 to draw straight to VICKY
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+short text_set_shadow(short screen, short enable) {
+    p_text_channel chan;
+    char * shadow;
+    short cells;
+    short old_mask;
+
+    if ((screen < 0) || (screen >= MAX_TEXT_CHANNELS)) {
+        return DEV_ERR_BADDEV;
+    }
+
+    chan = &text_channel[screen];
+    cells = chan->columns_max * chan->rows_max;
+
+    if (enable && (chan->shadow == 0)) {
+        shadow = (char *)mem_alloc_top(MEM_OWN_KERNEL, TEXT_SHADOW_TAG + screen, TEXT_SHADOW_SIZE);
+        if (shadow == 0) {
+            return ERR_OUT_OF_MEMORY;
+        }
+
+        /* Start the shadow off with what is on the screen */
+        text_copy_cells(shadow, chan->vram_text_cells, cells);
+        text_copy_cells(&shadow[TEXT_CELLS_MAX], chan->vram_color_cells, cells);
+
+        old_mask = int_disable_all();
+        chan->text_cells = shadow;
+        chan->color_cells = &shadow[TEXT_CELLS_MAX];
+        chan->shadow = shadow;
+        text_update_cursor(chan);
+
+        if (!text_sof_hooked) {
+            text_sof_next = int_register(INT_SOF_A, text_sof_handler);
+            text_sof_hooked = 1;
+        }
+        int_restore(old_mask);
+
+        int_enable(INT_SOF_A);
+
+    } else if (!enable && chan->shadow) {
+        shadow = chan->shadow;
+
+        /* Bring the screen up to date, then draw straight to it again */
+        old_mask = int_disable_all();
+        if (chan->history_view) {
+            /* The scrollback view needs the shadow: go back to the live screen */
+            chan->history_view = 0;
+            chan->history_own_shadow = 0;
+            text_mark_rows(chan, 0, chan->rows_visible - 1);
+        }
+        text_flush_rows(chan);
+        chan->text_cells = chan->vram_text_cells;
+        chan->color_cells = chan->vram_color_cells;
+        chan->shadow = 0;
+        text_update_cursor(chan);
+        int_restore(old_mask);
+
+        mem_free(MEM_OWN_KERNEL, (uint32_t)shadow);
+    }
+
+    return 0;
+}
+
+/*
+ * Return true if a text screen is drawing into a RAM shadow
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ *
+ * Returns:
+ * 1 if the shadow is on, 0 if it is off, any negative number is an error code
+ */
+short text_get_shadow(short screen) {
+    if ((screen < 0) || (screen >= MAX_TEXT_CHANNELS)) {
+        return DEV_ERR_BADDEV;
+    }
+
+    return text_channel[screen].shadow ? 1 : 0;
+}
+
+/*
+ * Draw the scrolled back view: history lines, then as much of the live screen as fits
+ */
+static void text_history_draw(p_text_channel chan) {
+    short first = chan->history_count - chan->history_view;
+    short offset;
+    short line;
+    short row;
+    char * src;
+
+    for (row = 0; row < chan->rows_visible; row++) {
+        offset = row * chan->columns_max;
+        line = first + row;
+        if (line < chan->history_count) {
+            /* Oldest lines sit just after the head of the ring */
+            line += chan->history_head - chan->history_count;
+            if (line < 0) {
+                line += chan->history_lines;
+            }
+
+            src = &chan->history[line * TEXT_HISTORY_LINE];
+            text_copy_cells(&chan->vram_text_cells[offset], src, chan->columns_max);
+            text_copy_cells(&chan->vram_color_cells[offset], &src[TEXT_COLUMNS_MAX], chan->columns_max);
+
+        } else {
+            line = (line - chan->history_count) * chan->columns_max;
+            text_copy_cells(&chan->vram_text_cells[offset], &chan->text_cells[line], chan->columns_max);
+            text_copy_cells(&chan->vram_color_cells[offset], &chan->color_cells[line], chan->columns_max);
+        }
+    }
+}
+
+/*
+ * Give a text screen a scrollback ring, or take it away
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * lines = the number of lines to keep (0 to remove the scrollback, at most TEXT_HISTORY_MAX)
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+short text_set_history(short screen, short lines) {
+    p_text_channel chan;
+    char * history = 0;
+    char * old_history;
+    short old_mask;
+
+    if ((screen < 0) || (screen >= MAX_TEXT_CHANNELS)) {
+        return DEV_ERR_BADDEV;
+    }
+
+    if ((lines < 0) || (lines > TEXT_HISTORY_MAX)) {
+        return DEV_BOUNDS_ERR;
+    }
+
+    chan = &text_channel[screen];
+    text_history_page(screen, TEXT_HISTORY_LIVE);
+
+    if (lines > 0) {
+        history = (char *)mem_alloc_top(MEM_OWN_KERNEL, TEXT_HISTORY_TAG + screen, (uint32_t)lines * TEXT_HISTORY_LINE);
+        if (history == 0) {
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    old_mask = int_disable_all();
+    old_history = chan->history;
+    chan->history = history;
+    chan->history_lines = lines;
+    chan->history_head = 0;
+    chan->history_count = 0;
+    int_restore(old_mask);
+
+    if (old_history) {
+        mem_free(MEM_OWN_KERNEL, (uint32_t)old_history);
+    }
+
+    return 0;
+}
+
+/*
+ * Return the number of lines a text screen's scrollback ring can hold
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ *
+ * Returns:
+ * the number of lines (0 if there is no scrollback), any negative number is an error code
+ */
+short text_get_history(short screen) {
+    if ((screen < 0) || (screen >= MAX_TEXT_CHANNELS)) {
+        return DEV_ERR_BADDEV;
+    }
+
+    return text_channel[screen].history_lines;
+}
+
+/*
+ * Page the view of a text screen through its scrollback
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * direction = TEXT_HISTORY_UP, TEXT_HISTORY_DOWN, or TEXT_HISTORY_LIVE
+ *
+ * Returns:
+ * the number of lines the view is scrolled back, any negative number is an error code
+ */
+short text_history_page(short screen, short direction) {
+    p_text_channel chan;
+    short view;
+    short result;
+
+    if ((screen < 0) || (screen >= MAX_TEXT_CHANNELS)) {
+        return DEV_ERR_BADDEV;
+    }
+
+    chan = &text_channel[screen];
+    if (direction == TEXT_HISTORY_LIVE) {
+        view = 0;
+    } else {
+        view = chan->history_view + direction * (chan->rows_visible - 1);
+        if (view > chan->history_count) {
+            view = chan->history_count;
+        } else if (view < 0) {
+            view = 0;
+        }
+    }
+
+    if (view == chan->history_view) {
+        return view;
+    }
+
+    if (view > 0) {
+        if (chan->shadow == 0) {
+            /* The live screen has to keep going somewhere while VICKY shows the history */
+            result = text_set_shadow(screen, 1);
+            if (result) {
+                return result;
+            }
+            chan->history_own_shadow = 1;
+        }
+
+        chan->history_view = view;
+        text_history_draw(chan);
+
+    } else {
+        /* Back to the live screen: have every row copied back to VICKY */
+        text_mark_rows(chan, 0, chan->rows_visible - 1);
+        chan->history_view = 0;
+
+        if (chan->history_own_shadow) {
+            chan->history_own_shadow = 0;
+            text_set_shadow(screen, 0);
+        }
+    }
+
+    return view;
+}
@@ -5,6 +5,16 @@
  * Driver for VICKY III text screens, both channel A and channel B
  */
 
+/*
+ * Directions for text_history_page
+ */
+#define TEXT_HISTORY_LIVE   0           /* Return to the live screen */
+#define TEXT_HISTORY_UP     1           /* Back a page, to older lines */
+#define TEXT_HISTORY_DOWN   -1          /* Forward a page, to newer lines */
+
+#define TEXT_HISTORY_LINES  128         /* Default number of lines of scrollback for the main screen */
+#define TEXT_HISTORY_MAX    1024        /* The most lines a scrollback ring may hold */
+
 /*
  * Initialize the text screen driver
  */
@@ -22,6 +32,15 @@ extern int text_init();
  */
 extern void text_set_cursor(short screen, short color, char character, short rate, short enable);
 
+/*
+ * Show or hide the cursor without changing its other properties
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * enable = 1 to display the cursor, 0 to hide it
+ */
+extern void text_set_cursor_visible(short screen, short enable);
+
 /*
  * Set the border
  *
@@ -66,6 +85,16 @@ extern void text_get_xy(short screen, unsigned short * x, unsigned short * y);
  */
 extern void text_setsizes(short screen);
 
+/*
+ * Get the size of the display in pixels, as last computed by text_setsizes
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * width = pointer to the width to set
+ * height = pointer to the height to set
+ */
+extern void text_get_pixels(short screen, short * width, short * height);
+
 /*
  * Send a character to the screen without any escape code interpretation
  *
@@ -75,6 +104,21 @@ extern void text_setsizes(short screen);
  */
 extern void text_put_raw(short screen, char c);
 
+/*
+ * Send a run of printable characters to the screen
+ *
+ * The characters are copied straight into text memory a line at a time,
+ * wrapping and scrolling as needed, and the cursor is moved once at the end.
+ * No control characters are interpreted: the caller must only pass characters
+ * that text_put_raw would just print.
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * s = the characters to print
+ * count = the number of characters to print
+ */
+extern void text_put_run(short screen, const char * s, short count);
+
 /*
  * Set the foreground and background color for printing
  *
@@ -142,4 +186,72 @@ extern void text_delete(short screen, short count);
  */
 extern void text_scroll(short screen);
 
+/*
+ * Turn the RAM shadow of a text screen on or off
+ *
+ * With the shadow on, all drawing happens in RAM, and the rows that changed
+ * are copied to VICKY once per frame by the start of frame interrupt.
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * enable = non-zero to draw into a shadow in RAM, 0 to draw straight to VICKY
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+extern short text_set_shadow(short screen, short enable);
+
+/*
+ * Return true if a text screen is drawing into a RAM shadow
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ *
+ * Returns:
+ * 1 if the shadow is on, 0 if it is off, any negative number is an error code
+ */
+extern short text_get_shadow(short screen);
+
+/*
+ * Give a text screen a scrollback ring, or take it away
+ *
+ * Lines that scroll off the top of the screen are kept in the ring, one byte
+ * per character and one per color, with the memory from the memory manager.
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * lines = the number of lines to keep (0 to remove the scrollback, at most TEXT_HISTORY_MAX)
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+extern short text_set_history(short screen, short lines);
+
+/*
+ * Return the number of lines a text screen's scrollback ring can hold
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ *
+ * Returns:
+ * the number of lines (0 if there is no scrollback), any negative number is an error code
+ */
+extern short text_get_history(short screen);
+
+/*
+ * Page the view of a text screen through its scrollback
+ *
+ * While the view is scrolled back, output carries on in the background (using
+ * the RAM shadow), and costs nothing more than saving lines in the ring as
+ * they scroll off. Returning to the live screen redraws it on the next frame.
+ *
+ * Inputs:
+ * screen = the screen number 0 for channel A, 1 for channel B
+ * direction = TEXT_HISTORY_UP, TEXT_HISTORY_DOWN, or TEXT_HISTORY_LIVE
+ *
+ * Returns:
+ * the number of lines the view is scrolled back, any negative number is an error code
+ */
+extern short text_history_page(short screen, short direction);
+
 #endif
@@ -3,7 +3,14 @@
  */
 
 #include "log.h"
+#include "constants.h"
+#include "errors.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "ring_buffer.h"
+#include "timers.h"
 #include "uart_reg.h"
+#include "dev/channel.h"
 #include "dev/uart.h"
 
 volatile unsigned char * uart_get_base(short uart) {
@@ -143,3 +150,651 @@ unsigned char uart_get(short uart) {
         return uart_base[UART_TRHB];
     }
 }
+
+/*
+ * Return true (non-zero) if the UART can accept a byte to send
+ *
+ * Inputs:
+ * uart = the number of the UART: 0 for COM1, 1 for COM2
+ *
+ * Returns:
+ * non-zero if a byte can be sent without waiting, 0 if the UART is busy.
+ */
+short uart_can_send(short uart) {
+    volatile unsigned char * uart_base = uart_get_base(uart);
+    if (uart_base) {
+        if (uart_base[UART_LSR] & LSR_XMIT_EMPTY) {
+            return 1;
+        } else {
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+}
+
+/*
+ * Channel device for the serial ports
+ *
+ * COM1 and COM2 share these routines: the UART number comes from the channel's device.
+ *
+ * While a port is open, it is driven by its interrupt: received bytes are moved from the
+ * FIFO into a receive ring, and bytes written to the channel are queued in a transmit ring
+ * which is fed to the FIFO as it empties. Reads and writes copy whole buffers to and from
+ * the rings rather than touching the UART a byte at a time.
+ */
+
+#define UART_TAG            0x7b00                  /* Tag for the memory page used by a port's rings (plus the UART number) */
+#define UART_BUFFER_SIZE    0x1000                  /* One page: the first half receives, the second half transmits */
+#define UART_RX_SIZE        (UART_BUFFER_SIZE / 2)  /* Size of the receive ring */
+#define UART_TX_SIZE        (UART_BUFFER_SIZE / 2)  /* Size of the transmit ring */
+#define UART_RX_HIGH        (UART_RX_SIZE / 8)      /* Drop RTS when the receive ring has less room than this */
+#define UART_RX_LOW         (UART_RX_SIZE / 2)      /* Raise RTS again once the receive ring has this much room */
+#define UART_CLOSE_TIMEOUT  120                     /* Jiffies close waits for the transmit ring to move before dropping the rest */
+
+typedef struct s_uart_port {
+    uint8_t * storage;          /* The memory page holding the rings (0 until first opened) */
+    t_byte_ring rx;             /* Bytes received, waiting to be read */
+    t_byte_ring tx;             /* Bytes written, waiting to be sent */
+    short opens;                /* Number of channels that have the port open */
+    short flow;                 /* UART_FLOW_NONE or UART_FLOW_RTSCTS */
+    short rts_held;             /* Non-zero if RTS was dropped because the receive ring is nearly full */
+    unsigned char ier;          /* Copy of the interrupt enable register */
+    unsigned char trigger;      /* FCR_TRIGGER_* level for the receive interrupt */
+    unsigned long overruns;     /* Number of bytes dropped because the receive ring was full */
+    unsigned long line_errors;  /* Number of overrun, parity, framing, and break conditions seen */
+    short error_pending;        /* Non-zero if an error has been seen since status last reported one */
+} t_uart_port, *p_uart_port;
+
+static t_uart_port g_uart_port[2];
+
+static short uart_chan_to_uart(p_channel chan) {
+    return (chan->dev == CDEV_COM1) ? 0 : 1;
+}
+
+static unsigned short uart_to_irq(short uart) {
+    return (uart == 0) ? INT_COM1 : INT_COM2;
+}
+
+/*
+ * Move bytes from the transmit ring into the UART's FIFO
+ *
+ * Leaves the transmit-empty interrupt on while there is still something queued. With hardware
+ * flow control on, nothing is sent while CTS is low: the modem status interrupt restarts
+ * transmission when it comes back.
+ *
+ * NOTE: called from the interrupt handler, or with the port's interrupt masked.
+ *
+ * Inputs:
+ * uart = the number of the UART: 0 for COM1, 1 for COM2
+ */
+static void uart_tx_fill(short uart) {
+    volatile unsigned char * uart_base = uart_get_base(uart);
+    p_uart_port port = &g_uart_port[uart];
+    short i;
+
+    if ((port->flow == UART_FLOW_RTSCTS) && ((uart_base[UART_MSR] & MSR_CTS) == 0)) {
+        port->ier &= ~UINT_THR_EMPTY;
+
+    } else {
+        if (uart_base[UART_LSR] & LSR_XMIT_EMPTY) {
+            for (i = 0; (i < UART_FIFO_SIZE) && !rb_byte_empty(&port->tx); i++) {
+                uart_base[UART_TRHB] = rb_byte_get(&port->tx);
+            }
+        }
+
+        if (rb_byte_empty(&port->tx)) {
+            port->ier &= ~UINT_THR_EMPTY;
+        } else {
+            port->ier |= UINT_THR_EMPTY;
+        }
+    }
+
+    uart_base[UART_IER] = port->ier;
+}
+
+/*
+ * Service all the pending conditions on a UART
+ *
+ * Inputs:
+ * uart = the number of the UART: 0 for COM1, 1 for COM2
+ */
+static void uart_service(short uart) {
+    volatile unsigned char * uart_base = uart_get_base(uart);
+    p_uart_port port = &g_uart_port[uart];
+    unsigned char iir;
+
+    while (((iir = uart_base[UART_IIR]) & IIR_INTERRUPT_PENDING) == 0) {
+        switch (iir & IIR_ID_MASK) {
+            case IIR_DATA_AVAIL:
+            case IIR_TIMEOUT:
+                /* Empty the FIFO into the receive ring */
+                while (uart_base[UART_LSR] & LSR_DATA_AVAIL) {
+                    if (!rb_byte_put(&port->rx, uart_base[UART_TRHB])) {
+                        port->overruns++;
+                        port->error_pending = 1;
+                    }
+                }
+
+                if ((port->flow == UART_FLOW_RTSCTS) && !port->rts_held && (rb_byte_space(&port->rx) < UART_RX_HIGH)) {
+                    /* Ask the other end to hold off until the ring has been read */
+                    uart_base[UART_MCR] &= ~MCR_RTS;
+                    port->rts_held = 1;
+                }
+                break;
+
+            case IIR_THR_EMPTY:
+                uart_tx_fill(uart);
+                break;
+
+            case IIR_LINE_STATUS:
+                if (uart_base[UART_LSR] & (LSR_BREAK_INT | LSR_ERR_FRAME | LSR_ERR_PARITY | LSR_ERR_OVERRUN)) {
+                    port->line_errors++;
+                    port->error_pending = 1;
+                }
+                break;
+
+            case IIR_MODEM_STATUS:
+                if (uart_base[UART_MSR] & MSR_CTS) {
+                    uart_tx_fill(uart);
+                }
+                break;
+
+            default:
+                /* Not a condition we know how to clear */
+                return;
+        }
+    }
+}
+
+/*
+ * Interrupt handler for COM1
+ */
+static void uart_com1_handler() {
+    uart_service(0);
+}
+
+/*
+ * Interrupt handler for COM2
+ */
+static void uart_com2_handler() {
+    uart_service(1);
+}
+
+/*
+ * Add bytes to the transmit ring and start sending them
+ *
+ * Interrupts are held off while the ring is updated, so bytes queued from an interrupt
+ * handler (by the log, for instance) cannot land in the middle of another write.
+ *
+ * Inputs:
+ * uart = the number of the UART: 0 for COM1, 1 for COM2
+ * data = the bytes to send
+ * size = the number of bytes
+ * whole = if non-zero, queue nothing unless all the bytes fit
+ *
+ * Returns:
+ * the number of bytes queued
+ */
+static short uart_tx_queue(short uart, const uint8_t * data, short size, short whole) {
+    p_uart_port port = &g_uart_port[uart];
+    short count = 0;
+    short mask;
+
+    mask = int_disable_all();
+    if (!whole || (rb_byte_space(&port->tx) >= size)) {
+        count = rb_byte_write(&port->tx, data, size);
+        if (count > 0) {
+            uart_tx_fill(uart);
+        }
+    }
+    int_restore(mask);
+
+    return count;
+}
+
+/*
+ * Raise RTS again if it was held and the receive ring has been drained enough
+ *
+ * Inputs:
+ * uart = the number of the UART: 0 for COM1, 1 for COM2
+ */
+static void uart_rx_release(short uart) {
+    volatile unsigned char * uart_base = uart_get_base(uart);
+    p_uart_port port = &g_uart_port[uart];
+    unsigned short irq = uart_to_irq(uart);
+
+    if (port->rts_held && (rb_byte_space(&port->rx) >= UART_RX_LOW)) {
+        int_disable(irq);
+        uart_base[UART_MCR] |= MCR_RTS;
+        port->rts_held = 0;
+        int_enable(irq);
+    }
+}
+
+/*
+ * Queue a whole record to send on an open serial port, without waiting
+ *
+ * Inputs:
+ * uart = the number of the UART: 0 for COM1, 1 for COM2
+ * data = the bytes of the record
+ * size = the number of bytes in the record
+ *
+ * Returns:
+ * 1 if the record was queued, 0 if there was no room for all of it (or the port is not open)
+ */
+short uart_put_record(short uart, const uint8_t * data, short size) {
+    if (g_uart_port[uart].opens == 0) {
+        return 0;
+    }
+
+    return (uart_tx_queue(uart, data, size, 1) == size) ? 1 : 0;
+}
+
+short uart_chan_init() {
+    return 0;
+}
+
+/*
+ * Open a serial port
+ *
+ * The first open sets the port up for 9600 bps, 8 data bits, no parity, 1 stop bit, and
+ * turns on its interrupt. Later opens share the port as it is.
+ */
+short uart_chan_open(p_channel chan, const uint8_t * path, short mode) {
+    short uart = uart_chan_to_uart(chan);
+    volatile unsigned char * uart_base = uart_get_base(uart);
+    p_uart_port port = &g_uart_port[uart];
+    unsigned short irq = uart_to_irq(uart);
+
+    if (port->opens++ > 0) {
+        return 0;
+    }
+
+    if (port->storage == 0) {
+        port->storage = (uint8_t *)mem_alloc_top(MEM_OWN_KERNEL, UART_TAG + uart, UART_BUFFER_SIZE);
+        if (port->storage == 0) {
+            port->opens = 0;
+            return ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    int_disable(irq);
+
+    rb_byte_init(&port->rx, port->storage, UART_RX_SIZE);
+    rb_byte_init(&port->tx, port->storage + UART_RX_SIZE, UART_TX_SIZE);
+    port->rts_held = 0;
+    port->overruns = 0;
+    port->line_errors = 0;
+    port->error_pending = 0;
+
+    uart_init(uart);
+    uart_base[UART_FCR] = port->trigger | FCR_CLEAR_XMIT | FCR_CLEAR_RECV | FCR_FIFO_ENABLE;
+    uart_base[UART_MCR] = MCR_OUT2 | MCR_RTS | MCR_DTR;
+
+    port->ier = UINT_DATA_AVAIL | UINT_LINE_STATUS | UINT_MODEM_STATUS;
+    uart_base[UART_IER] = port->ier;
+
+    int_clear(irq);
+    int_enable(irq);
+
+    return 0;
+}
+
+/*
+ * Close a serial port
+ *
+ * When the last channel on the port is closed, waits for the queued bytes to go out and
+ * turns off the port's interrupt. If the bytes stop moving for UART_CLOSE_TIMEOUT jiffies
+ * (the other end never raises CTS, say), the rest are dropped.
+ */
+short uart_chan_close(p_channel chan) {
+    short uart = uart_chan_to_uart(chan);
+    volatile unsigned char * uart_base = uart_get_base(uart);
+    p_uart_port port = &g_uart_port[uart];
+    unsigned short pending;
+    long deadline;
+
+    if (port->opens > 0) {
+        if (--port->opens == 0) {
+            /* Let the transmit ring drain, but give up if it stops moving (e.g. CTS never comes) */
+            pending = rb_byte_count(&port->tx);
+            deadline = timers_jiffies() + UART_CLOSE_TIMEOUT;
+            while (pending > 0) {
+                if (timers_jiffies() > deadline) {
+                    break;
+                }
+                int_wait();
+                if (rb_byte_count(&port->tx) != pending) {
+                    pending = rb_byte_count(&port->tx);
+                    deadline = timers_jiffies() + UART_CLOSE_TIMEOUT;
+                }
+            }
+
+            int_disable(uart_to_irq(uart));
+
+            /* Whatever is still waiting will not be sent */
+            while (!rb_byte_empty(&port->tx)) {
+                rb_byte_get(&port->tx);
+            }
+
+            port->ier = 0;
+            uart_base[UART_IER] = 0;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Read a byte from the serial port
+ *
+ * In non-blocking mode, returns DEV_WOULD_BLOCK if no byte has been received.
+ */
+short uart_chan_read_b(p_channel chan) {
+    short uart = uart_chan_to_uart(chan);
+    p_uart_port port = &g_uart_port[uart];
+    uint8_t b;
+
+    while (rb_byte_empty(&port->rx)) {
+        if (chan->flags & CHAN_FLAG_NONBLOCK) {
+            return DEV_WOULD_BLOCK;
+        }
+        int_wait();
+    }
+
+    b = rb_byte_get(&port->rx);
+    uart_rx_release(uart);
+    return b;
+}
+
+/*
+ * Read bytes from the serial port
+ *
+ * In non-blocking mode, returns the bytes already received (DEV_WOULD_BLOCK if there were none).
+ */
+short uart_chan_read(p_channel chan, uint8_t * buffer, short size) {
+    short uart = uart_chan_to_uart(chan);
+    p_uart_port port = &g_uart_port[uart];
+    short count = 0;
+    short n;
+
+    while (count < size) {
+        n = rb_byte_read(&port->rx, buffer + count, size - count);
+        if (n > 0) {
+            count += n;
+            uart_rx_release(uart);
+
+        } else if (chan->flags & CHAN_FLAG_NONBLOCK) {
+            return (count > 0) ? count : DEV_WOULD_BLOCK;
+
+        } else {
+            int_wait();
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Read a line of text from the serial port (stops at a CR or LF, which is not kept)
+ *
+ * This always waits for the end of the line, even in non-blocking mode.
+ */
+short uart_chan_readline(p_channel chan, uint8_t * buffer, short size) {
+    short uart = uart_chan_to_uart(chan);
+    p_uart_port port = &g_uart_port[uart];
+    short i = 0;
+    unsigned char c;
+
+    while (i < size - 1) {
+        while (rb_byte_empty(&port->rx)) {
+            int_wait();
+        }
+
+        c = rb_byte_get(&port->rx);
+        uart_rx_release(uart);
+        if ((c == CHAR_CR) || (c == CHAR_NL)) {
+            break;
+        }
+        buffer[i++] = c;
+    }
+
+    buffer[i] = 0;
+    return i;
+}
+
+/*
+ * Send a byte to the serial port
+ *
+ * In non-blocking mode, returns DEV_WOULD_BLOCK if the transmit ring is full.
+ */
+short uart_chan_write_b(p_channel chan, uint8_t b) {
+    short uart = uart_chan_to_uart(chan);
+
+    while (uart_tx_queue(uart, &b, 1, 1) == 0) {
+        if (chan->flags & CHAN_FLAG_NONBLOCK) {
+            return DEV_WOULD_BLOCK;
+        }
+        int_wait();
+    }
+
+    return 0;
+}
+
+/*
+ * Send bytes to the serial port
+ *
+ * In non-blocking mode, queues what the transmit ring will take and returns the count
+ * (DEV_WOULD_BLOCK if it would take none).
+ */
+short uart_chan_write(p_channel chan, const uint8_t * buffer, short size) {
+    short uart = uart_chan_to_uart(chan);
+    short count = 0;
+    short n;
+
+    while (count < size) {
+        n = uart_tx_queue(uart, buffer + count, size - count, 0);
+        if (n > 0) {
+            count += n;
+
+        } else if (chan->flags & CHAN_FLAG_NONBLOCK) {
+            return (count > 0) ? count : DEV_WOULD_BLOCK;
+
+        } else {
+            int_wait();
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Return the status of the serial port
+ *
+ * CDEV_STAT_ERROR is reported once for the errors seen since the last call. The running
+ * counts of errors are available through UART_IOCTRL_ERRORS.
+ */
+short uart_chan_status(p_channel chan) {
+    short uart = uart_chan_to_uart(chan);
+    p_uart_port port = &g_uart_port[uart];
+    unsigned short irq = uart_to_irq(uart);
+    short status = 0;
+
+    if (!rb_byte_empty(&port->rx)) {
+        status |= CDEV_STAT_READABLE;
+    }
+
+    if (!rb_byte_full(&port->tx)) {
+        status |= CDEV_STAT_WRITABLE;
+    }
+
+    if (port->error_pending) {
+        int_disable(irq);
+        port->error_pending = 0;
+        int_enable(irq);
+        status |= CDEV_STAT_ERROR;
+    }
+
+    return status;
+}
+
+/*
+ * Wait for everything queued on the serial port to be sent
+ */
+short uart_chan_flush(p_channel chan) {
+    short uart = uart_chan_to_uart(chan);
+    volatile unsigned char * uart_base = uart_get_base(uart);
+    p_uart_port port = &g_uart_port[uart];
+
+    while (!rb_byte_empty(&port->tx)) {
+        int_wait();
+    }
+
+    while ((uart_base[UART_LSR] & LSR_XMIT_DONE) == 0) {
+        ;
+    }
+
+    return 0;
+}
+
+short uart_chan_seek(p_channel chan, long position, short base) {
+    return 0;
+}
+
+/*
+ * Send a command to a serial port
+ *
+ * UART_IOCTRL_BPS = set the speed (buffer holds the UART_* code as a big-endian word)
+ * UART_IOCTRL_LCR = set the line control register (buffer[0] holds the LCR_* bits)
+ * UART_IOCTRL_FLOW = set the flow control (buffer[0] holds UART_FLOW_NONE or UART_FLOW_RTSCTS)
+ * UART_IOCTRL_TRIGGER = set the receive FIFO trigger level (buffer[0] holds an FCR_TRIGGER_* code)
+ */
+short uart_chan_ioctrl(p_channel chan, short command, uint8_t * buffer, short size) {
+    short uart = uart_chan_to_uart(chan);
+    volatile unsigned char * uart_base = uart_get_base(uart);
+    p_uart_port port = &g_uart_port[uart];
+    unsigned short irq = uart_to_irq(uart);
+    unsigned long overruns;
+    unsigned long line_errors;
+    short i;
+
+    switch (command) {
+        case UART_IOCTRL_BPS:
+            if (size < 2) {
+                return DEV_BOUNDS_ERR;
+            }
+
+            /* Keep the handler away from the IER while the divisor latch is showing */
+            int_disable(irq);
+            uart_setbps(uart, ((unsigned short)buffer[0] << 8) | buffer[1]);
+            int_enable(irq);
+            return 0;
+
+        case UART_IOCTRL_LCR:
+            if (size < 1) {
+                return DEV_BOUNDS_ERR;
+            }
+
+            int_disable(irq);
+            uart_setlcr(uart, buffer[0] & ~LCR_DLB);
+            int_enable(irq);
+            return 0;
+
+        case UART_IOCTRL_FLOW:
+            if (size < 1) {
+                return DEV_BOUNDS_ERR;
+            }
+
+            int_disable(irq);
+            port->flow = buffer[0];
+            if ((port->flow != UART_FLOW_RTSCTS) && port->rts_held) {
+                uart_base[UART_MCR] |= MCR_RTS;
+                port->rts_held = 0;
+            }
+            uart_tx_fill(uart);
+            int_enable(irq);
+            return 0;
+
+        case UART_IOCTRL_TRIGGER:
+            if (size < 1) {
+                return DEV_BOUNDS_ERR;
+            }
+
+            int_disable(irq);
+            port->trigger = buffer[0] & FCR_TRIGGER_14;
+            uart_base[UART_FCR] = port->trigger | FCR_FIFO_ENABLE;
+            int_enable(irq);
+            return 0;
+
+        case UART_IOCTRL_ERRORS:
+            if (size < 8) {
+                return DEV_BOUNDS_ERR;
+            }
+
+            int_disable(irq);
+            overruns = port->overruns;
+            line_errors = port->line_errors;
+            int_enable(irq);
+
+            for (i = 0; i < 4; i++) {
+                buffer[i] = (overruns >> (24 - 8 * i)) & 0xff;
+                buffer[4 + i] = (line_errors >> (24 - 8 * i)) & 0xff;
+            }
+            return 0;
+
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Install the COM1 and COM2 channel devices
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+short uart_install() {
+    t_dev_chan dev;
+    short result;
+    short i;
+
+    for (i = 0; i < 2; i++) {
+        g_uart_port[i].storage = 0;
+        g_uart_port[i].opens = 0;
+        g_uart_port[i].flow = UART_FLOW_NONE;
+        g_uart_port[i].rts_held = 0;
+        g_uart_port[i].ier = 0;
+        g_uart_port[i].trigger = FCR_TRIGGER_8;
+    }
+
+    int_register(INT_COM1, uart_com1_handler);
+    int_register(INT_COM2, uart_com2_handler);
+
+    dev.name = "COM1";
+    dev.number = CDEV_COM1;
+    dev.init = uart_chan_init;
+    dev.open = uart_chan_open;
+    dev.close = uart_chan_close;
+    dev.read = uart_chan_read;
+    dev.readline = uart_chan_readline;
+    dev.read_b = uart_chan_read_b;
+    dev.write = uart_chan_write;
+    dev.write_b = uart_chan_write_b;
+    dev.flush = uart_chan_flush;
+    dev.seek = uart_chan_seek;
+    dev.status = uart_chan_status;
+    dev.ioctrl = uart_chan_ioctrl;
+    dev.readv = 0;
+    dev.writev = 0;
+
+    result = cdev_register(&dev);
+    if (result) {
+        return result;
+    }
+
+    dev.name = "COM2";
+    dev.number = CDEV_COM2;
+
+    return cdev_register(&dev);
+}
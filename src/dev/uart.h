@@ -5,6 +5,21 @@
 #ifndef __UART_H
 #define __UART_H
 
+#include "dev/channel.h"
+
+/*
+ * IOCTRL commands for the COM channels
+ */
+
+#define UART_IOCTRL_BPS         0x0100      /* Set the speed: buffer holds the UART_* code as a big-endian word */
+#define UART_IOCTRL_LCR         0x0200      /* Set the line control register: buffer[0] holds the LCR_* bits */
+#define UART_IOCTRL_FLOW        0x0300      /* Set the flow control: buffer[0] holds a UART_FLOW_* code */
+#define UART_IOCTRL_TRIGGER     0x0400      /* Set the receive FIFO trigger level: buffer[0] holds an FCR_TRIGGER_* code */
+#define UART_IOCTRL_ERRORS      0x0500      /* Get the error counts since the port was opened: buffer gets two big-endian longs, the bytes dropped and the line errors */
+
+#define UART_FLOW_NONE          0           /* No flow control */
+#define UART_FLOW_RTSCTS        1           /* Hardware flow control with RTS and CTS */
+
 /*
  * Set the data transfer speed
  *
@@ -61,4 +76,43 @@ extern void uart_put(short uart, unsigned char b);
  * the byte read from the UART
  */
 extern unsigned char uart_get(short uart);
+
+/*
+ * Return true (non-zero) if the UART can accept a byte to send
+ *
+ * Inputs:
+ * uart = the number of the UART: 0 for COM1, 1 for COM2
+ *
+ * Returns:
+ * non-zero if a byte can be sent without waiting, 0 if the UART is busy.
+ */
+extern short uart_can_send(short uart);
+
+/*
+ * Queue a whole record to send on an open serial port, without waiting
+ *
+ * The record is queued completely or not at all, so records are never torn when the
+ * transmit ring fills up. Safe to call from an interrupt handler.
+ *
+ * Inputs:
+ * uart = the number of the UART: 0 for COM1, 1 for COM2
+ * data = the bytes of the record
+ * size = the number of bytes in the record
+ *
+ * Returns:
+ * 1 if the record was queued, 0 if there was no room for all of it (or the port is not open)
+ */
+extern short uart_put_record(short uart, const uint8_t * data, short size);
+
+/*
+ * Install the COM1 and COM2 channel devices
+ *
+ * Open ports are interrupt driven, with receive and transmit rings between the FIFOs and
+ * the channel. Both honor the channel's non-blocking flag (see CHAN_IOCTRL_NONBLOCK_ON).
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+extern short uart_install();
+
 #endif
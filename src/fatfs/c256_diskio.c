@@ -67,20 +67,23 @@ DRESULT disk_read (
 	UINT count		/* Number of sectors to read */
 )
 {
-	DRESULT res;
-	int result;
-	int i;
+	short n;
+	short result;
 
 	TRACE("disk_read");
 
-	for (i = 0; i < count; i++) {
-		result = bdev_read(pdrv, sector, buff, 512);
+	/* Hand the block layer the longest runs it will take, so contiguous data moves in few transactions */
+	while (count > 0) {
+		n = (count > BDEV_BLOCKS_MAX) ? BDEV_BLOCKS_MAX : (short)count;
+		result = bdev_read_blocks(pdrv, (unsigned long)sector, buff, n);
 		if (result < 0) {
 			log_num(LOG_ERROR, "disk_read error: ", result);
 			return RES_PARERR;
-		} else {
-			sector++;
 		}
+
+		sector += n;
+		buff += (UINT)n * BDEV_BLOCK_SIZE;
+		count -= n;
 	}
 
 	return RES_OK;
@@ -101,19 +104,22 @@ DRESULT disk_write (
 	UINT count			/* Number of sectors to write */
 )
 {
-	DRESULT res;
-	int i;
-	int result;
+	short n;
+	short result;
 
 	TRACE("disk_write");
 
-	for (i = 0; i < count; i++) {
-		result = bdev_write(pdrv, sector, buff, 512);
+	while (count > 0) {
+		n = (count > BDEV_BLOCKS_MAX) ? BDEV_BLOCKS_MAX : (short)count;
+		result = bdev_write_blocks(pdrv, (unsigned long)sector, buff, n);
 		if (result < 0) {
+			log_num(LOG_ERROR, "disk_write error: ", result);
 			return RES_PARERR;
-		} else {
-			sector += result;
 		}
+
+		sector += n;
+		buff += (UINT)n * BDEV_BLOCK_SIZE;
+		count -= n;
 	}
 
 	return RES_OK;
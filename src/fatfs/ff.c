@@ -1254,6 +1254,11 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 			break;
 		}
 	}
+#if FF_USE_FREEMAP
+	if (res == FR_OK && (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT)) {
+		ff_freemap_update(fs, clst, (val & 0x0FFFFFFF) == 0);	/* Keep the free cluster map in step with the FAT */
+	}
+#endif
 	return res;
 }
 
@@ -1554,17 +1559,31 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 			}
 		}
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
-			ncl = scl;	/* Start cluster */
-			for (;;) {
-				ncl++;							/* Next cluster */
-				if (ncl >= fs->n_fatent) {		/* Check wrap-around */
-					ncl = 2;
-					if (ncl > scl) return 0;	/* No free cluster found? */
+#if FF_USE_FREEMAP
+			if (ff_freemap_find(fs, scl, &ncl)) {	/* Look up a free cluster in the free cluster map */
+				while (ncl != 0) {
+					cs = get_fat(obj, ncl);		/* Make sure the map is right */
+					if (cs == 0) break;			/* Found a free cluster? */
+					if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+					ff_freemap_update(fs, ncl, 0);	/* Map was out of date, try the next one */
+					ff_freemap_find(fs, scl, &ncl);
+				}
+				if (ncl == 0) return 0;			/* No free cluster found? */
+			} else
+#endif
+			{
+				ncl = scl;	/* Start cluster */
+				for (;;) {
+					ncl++;							/* Next cluster */
+					if (ncl >= fs->n_fatent) {		/* Check wrap-around */
+						ncl = 2;
+						if (ncl > scl) return 0;	/* No free cluster found? */
+					}
+					cs = get_fat(obj, ncl);			/* Get the cluster status */
+					if (cs == 0) break;				/* Found a free cluster? */
+					if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+					if (ncl == scl) return 0;		/* No free cluster found? */
 				}
-				cs = get_fat(obj, ncl);			/* Get the cluster status */
-				if (cs == 0) break;				/* Found a free cluster? */
-				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
-				if (ncl == scl) return 0;		/* No free cluster found? */
 			}
 		}
 		res = put_fat(fs, ncl, 0xFFFFFFFF);		/* Mark the new cluster 'EOC' */
@@ -2350,6 +2369,68 @@ static FRESULT dir_read (
 /* Directory handling - Find an object in the directory                  */
 /*-----------------------------------------------------------------------*/
 
+#if FF_USE_DIRCACHE && FF_USE_LFN
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Check an entry found in the directory cache      */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT dir_cached (	/* FR_OK(0):entry matches, !=0:stale entry or error */
+	DIR* dp,				/* Pointer to the directory object with the file name */
+	DWORD ofs,				/* Offset of the SFN entry */
+	DWORD lfn_ofs,			/* Offset of the first LFN entry (0xFFFFFFFF:none) */
+	BYTE by_lfn				/* The entry was matched by its LFN */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE c, a, ord = 0xFF, sum = 0;
+
+
+	if (by_lfn) {				/* Compare the LFN entries with the name */
+		if (lfn_ofs == 0xFFFFFFFF || (dp->fn[NSFLAG] & NS_NOLFN)) return FR_NO_FILE;
+		res = dir_sdi(dp, lfn_ofs);
+		if (res != FR_OK) return res;
+		do {
+			res = move_window(fs, dp->sect);
+			if (res != FR_OK) return res;
+			c = dp->dir[DIR_Name];
+			if ((dp->dir[DIR_Attr] & AM_MASK) != AM_LFN) return FR_NO_FILE;
+			if (dp->dptr == lfn_ofs) {	/* Start of LFN sequence */
+				if (!(c & LLEF)) return FR_NO_FILE;
+				sum = dp->dir[LDIR_Chksum];
+				c &= (BYTE)~LLEF; ord = c;
+			}
+			ord = (c == ord && sum == dp->dir[LDIR_Chksum] && cmp_lfn(fs->lfnbuf, dp->dir)) ? ord - 1 : 0xFF;
+			if (ord == 0xFF) return FR_NO_FILE;
+			res = dir_next(dp, 0);
+			if (res != FR_OK) return res;
+		} while (dp->dptr < ofs);
+		if (dp->dptr != ofs) return FR_NO_FILE;
+	} else {
+		res = dir_sdi(dp, ofs);
+		if (res != FR_OK) return res;
+	}
+
+	/* Check the SFN entry */
+	res = move_window(fs, dp->sect);
+	if (res != FR_OK) return res;
+	c = dp->dir[DIR_Name];
+	a = dp->dir[DIR_Attr] & AM_MASK;
+	if (c == 0 || c == DDEM || (a & AM_VOL)) return FR_NO_FILE;
+	if (by_lfn) {
+		if (ord != 0 || sum != sum_sfn(dp->dir)) return FR_NO_FILE;
+	} else {
+		if ((dp->fn[NSFLAG] & NS_LOSS) || memcmp(dp->dir, dp->fn, 11)) return FR_NO_FILE;
+	}
+
+	dp->obj.attr = a;
+	dp->blk_ofs = lfn_ofs;
+	return FR_OK;
+}
+#endif
+
+
+
 static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	DIR* dp					/* Pointer to the directory object with the file name */
 )
@@ -2384,6 +2465,18 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	}
 #endif
 	/* On the FAT/FAT32 volume */
+#if FF_USE_DIRCACHE && FF_USE_LFN
+	if (!(dp->fn[NSFLAG] & NS_NOLFN)) {	/* Try the directory cache first */
+		DWORD ofs, lfn_ofs;
+		BYTE by_lfn;
+
+		if (ff_dircache_lookup(fs, dp->obj.sclust, fs->lfnbuf, &ofs, &lfn_ofs, &by_lfn)) {
+			if (dir_cached(dp, ofs, lfn_ofs, by_lfn) == FR_OK) return FR_OK;
+			res = dir_sdi(dp, 0);		/* Stale entry, rewind and do a full scan */
+			if (res != FR_OK) return res;
+		}
+	}
+#endif
 #if FF_USE_LFN
 	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
 #endif
@@ -2420,6 +2513,11 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 		res = dir_next(dp, 0);	/* Next entry */
 	} while (res == FR_OK);
 
+#if FF_USE_DIRCACHE && FF_USE_LFN
+	if (res == FR_OK && !(dp->fn[NSFLAG] & NS_NOLFN)) {	/* Remember where the entry was found */
+		ff_dircache_store(fs, dp->obj.sclust, fs->lfnbuf, dp->dptr, dp->blk_ofs, (BYTE)(ord == 0 && sum == sum_sfn(dp->dir)));
+	}
+#endif
 	return res;
 }
 
@@ -4777,7 +4875,12 @@ FRESULT f_getfree (
 					stat = get_fat(&obj, clst);
 					if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
 					if (stat == 1) { res = FR_INT_ERR; break; }
-					if (stat == 0) nfree++;
+					if (stat == 0) {
+						nfree++;
+#if FF_USE_FREEMAP
+						ff_freemap_update(fs, clst, 1);
+#endif
+					}
 				} while (++clst < fs->n_fatent);
 			} else {
 #if FF_FS_EXFAT
@@ -4811,12 +4914,18 @@ FRESULT f_getfree (
 							if (res != FR_OK) break;
 						}
 						if (fs->fs_type == FS_FAT16) {
-							if (ld_word(fs->win + i) == 0) nfree++;
+							stat = ld_word(fs->win + i);
 							i += 2;
 						} else {
-							if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
+							stat = ld_dword(fs->win + i) & 0x0FFFFFFF;
 							i += 4;
 						}
+						if (stat == 0) {
+							nfree++;
+#if FF_USE_FREEMAP
+							ff_freemap_update(fs, fs->n_fatent - clst, 1);	/* Record the free cluster in the map */
+#endif
+						}
 						i %= SS(fs);
 					} while (--clst);
 				}
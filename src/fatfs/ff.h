@@ -367,6 +367,18 @@ void* ff_memalloc (UINT msize);			/* Allocate memory block */
 void ff_memfree (void* mblock);			/* Free memory block */
 #endif
 
+/* Directory entry cache functions */
+#if FF_USE_DIRCACHE && FF_USE_LFN
+int ff_dircache_lookup (FATFS* fs, DWORD sclust, const WCHAR* name, DWORD* ofs, DWORD* lfn_ofs, BYTE* by_lfn);	/* Find a cached entry */
+void ff_dircache_store (FATFS* fs, DWORD sclust, const WCHAR* name, DWORD ofs, DWORD lfn_ofs, BYTE by_lfn);		/* Cache an entry */
+#endif
+
+/* Free cluster map functions */
+#if FF_USE_FREEMAP
+int ff_freemap_find (FATFS* fs, DWORD scl, DWORD* ncl);		/* Find a free cluster after scl */
+void ff_freemap_update (FATFS* fs, DWORD clst, int is_free);	/* Record a change to a FAT entry */
+#endif
+
 /* Sync functions */
 #if FF_FS_REENTRANT
 int ff_cre_syncobj (BYTE vol, FF_SYNC_t* sobj);	/* Create a sync object */
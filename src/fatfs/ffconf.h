@@ -230,7 +230,7 @@
 /  buffer in the filesystem object (FATFS) is used for the file data transfer. */
 
 
-#define FF_FS_EXFAT		0
+#define FF_FS_EXFAT		1
 /* This option switches support for exFAT filesystem. (0:Disable or 1:Enable)
 /  To enable exFAT, also LFN needs to be enabled. (FF_USE_LFN >= 1)
 /  Note that enabling exFAT discards ANSI C (C89) compatibility. */
@@ -274,6 +274,31 @@
 /      lock control is independent of re-entrancy. */
 
 
+#define FF_USE_DIRCACHE	1
+/* The option FF_USE_DIRCACHE switches the directory entry cache. When enabled,
+/  dir_find() asks ff_dircache_lookup() where a name was last found in a directory
+/  and checks that entry before scanning the whole directory, and reports entries it
+/  finds to ff_dircache_store(). Both functions must be added to the project (they
+/  are in dev/fsys.c). Cached entries are always checked against the directory, so a
+/  stale entry only costs a full scan. This option has no effect when FF_USE_LFN == 0.
+/
+/   0: Disable directory entry cache.
+/   1: Enable directory entry cache. */
+
+
+#define FF_USE_FREEMAP	1
+/* The option FF_USE_FREEMAP switches the free cluster map for FAT volumes. When
+/  enabled, f_getfree() reports every free cluster it finds during a FAT scan to
+/  ff_freemap_update(), put_fat() reports every change to a FAT entry, and
+/  create_chain() asks ff_freemap_find() for a free cluster instead of reading the
+/  FAT linearly. Both functions must be added to the project (they are in dev/fsys.c),
+/  which decides whether a volume has a map at all. Clusters from the map are always
+/  checked against the FAT. This option has no effect on exFAT volumes.
+/
+/   0: Disable free cluster map.
+/   1: Enable free cluster map. */
+
+
 /* #include <somertos.h>	// O/S definitions */
 #define FF_FS_REENTRANT	0
 #define FF_FS_TIMEOUT	1000
@@ -8,6 +8,7 @@
 #include "sys_general.h"
 #include "simpleio.h"
 #include "log.h"
+#include "memory.h"
 #include "indicators.h"
 #include "interrupt.h"
 #include "gabe_reg.h"
@@ -15,6 +16,8 @@
 #if MODEL == MODEL_FOENIX_A2560K
 #include "superio.h"
 #include "dev/kbd_mo.h"
+#include "dev/lpt.h"
+#include "dev/midi.h"
 #endif
 
 #include "syscalls.h"
@@ -23,8 +26,10 @@
 #include "dev/channel.h"
 #include "dev/console.h"
 #include "dev/fdc.h"
+#include "dev/mouse.h"
 #include "dev/text_screen_iii.h"
 #include "dev/pata.h"
+#include "dev/pipe.h"
 #include "dev/ps2.h"
 #include "dev/rtc.h"
 #include "dev/sdc.h"
@@ -171,6 +176,9 @@ void initialize() {
     /* Initialize the interrupt system */
     int_init();
 
+    /* Initialize the memory manager */
+    mem_init();
+
 #if MODEL == MODEL_FOENIX_A2560K
     /* Initialize the SuperIO chip */
     init_superio();
@@ -197,6 +205,38 @@ void initialize() {
         log(LOG_INFO, "Console installed.");
     }
 
+    if (res = pipe_install()) {
+        log_num(LOG_ERROR, "FAILED: Pipe device installation", res);
+    } else {
+        log(LOG_INFO, "Pipe device installed.");
+    }
+
+    if (res = uart_install()) {
+        log_num(LOG_ERROR, "FAILED: Serial port installation", res);
+    } else {
+        log(LOG_INFO, "Serial ports installed.");
+    }
+
+    if (res = mouse_install()) {
+        log_num(LOG_ERROR, "FAILED: Mouse device installation", res);
+    } else {
+        log(LOG_INFO, "Mouse device installed.");
+    }
+
+#if MODEL == MODEL_FOENIX_A2560K
+    if (res = lpt_install()) {
+        log_num(LOG_ERROR, "FAILED: Parallel port installation", res);
+    } else {
+        log(LOG_INFO, "Parallel port installed.");
+    }
+
+    if (res = midi_install()) {
+        log_num(LOG_ERROR, "FAILED: MIDI port installation", res);
+    } else {
+        log(LOG_INFO, "MIDI port installed.");
+    }
+#endif
+
     /* Initialize the timers the MCP uses */
     timers_init();
 
@@ -261,6 +301,11 @@ void initialize() {
 
     /* Go back to text mode */
     text_init();
+
+    /* Give the main screen its scrollback now that text_init is done with it */
+    if (res = text_set_history(0, TEXT_HISTORY_LINES)) {
+        log_num(LOG_ERROR, "FAILED: Console scrollback", res);
+    }
 }
 
 int main(int argc, char * argv[]) {
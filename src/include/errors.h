@@ -45,4 +45,8 @@
 #define FSYS_ERR_TOO_MANY_OPEN_FILES    -35 /* (18) Number of open files > FF_FS_LOCK */
 #define FSYS_ERR_INVALID_PARAMETER      -36 /* (19) Given parameter is invalid */
 
+#define DEV_WOULD_BLOCK                 -37 // The channel is non-blocking and the operation would have to wait
+#define ERR_MEMORY_IN_USE               -38 // The memory needed is already in use by something else
+#define DEV_EOF                         -39 // There is nothing more to read: the end of the file or stream was reached
+
 #endif
@@ -13,8 +13,10 @@
 #include "types.h"
 #include "interrupt.h"
 #include "dev/channel.h"
+#include "dev/pipe.h"
 #include "dev/block.h"
 #include "dev/fsys.h"
+#include "dev/mouse.h"
 #include "dev/rtc.h"
 
 /*
@@ -49,6 +51,8 @@
 #define KFN_CHAN_OPEN           0x1A    /* Open a channel device */
 #define KFN_CHAN_CLOSE          0x1B    /* Close an open channel (not for files) */
 #define KFN_TEXT_SETSIZES       0x1C    /* Adjusts the screen size based on the current graphics mode */
+#define KFN_CHAN_READV          0x1D    /* Read bytes from a channel into several buffers */
+#define KFN_CHAN_WRITEV         0x1E    /* Write bytes to a channel from several buffers */
 
 
 /* Block device system calls */
@@ -59,6 +63,8 @@
 #define KFN_BDEV_STATUS         0x23    /* Get the status of a block device */
 #define KFN_BDEV_IOCTRL         0x24    /* Send a command to a block device (device dependent functionality) */
 #define KFN_BDEV_REGISTER       0x25    /* Register a block device driver */
+#define KFN_BDEV_GETBLOCKS      0x26    /* Read a run of consecutive blocks from a block device */
+#define KFN_BDEV_PUTBLOCKS      0x27    /* Write a run of consecutive blocks to a block device */
 
 /* File/Directory system calls */
 
@@ -91,6 +97,21 @@
 #define KFN_KBD_SCANCODE        0x53    /* Get the next scan code from the keyboard */
 #define KFN_KBD_LAYOUT          0x54    /* Set the translation tables for the keyboard */
 #define KFN_ERR_MESSAGE         0x55    /* Return an error description, given an error number */
+#define KFN_KBD_EVENT           0x56    /* Get the next key event from the keyboard */
+#define KFN_KBD_KEYSTATE        0x57    /* Get the record of the keys held down */
+#define KFN_MOUSE_EVENT         0x58    /* Get the next event from the mouse */
+#define KFN_MOUSE_STATE         0x59    /* Get the record of the mouse pointer's position and buttons */
+#define KFN_MOUSE_SETXY         0x5A    /* Move the mouse pointer */
+
+/* Additional file system calls */
+
+#define KFN_READDIR_BATCH       0x60    /* Read a batch of compact entries from an open directory */
+#define KFN_GET_FREE            0x61    /* Get the free space on a volume */
+
+/* Additional channel system calls */
+
+#define KFN_CHAN_PIPE           0x70    /* Create a pipe, returning its reader and writer channels */
+#define KFN_CHAN_POLL           0x71    /* Wait until one of a set of channels is ready */
 
 /*
  * Call into the kernel (provided by assembly)
@@ -193,7 +214,7 @@ extern void sys_int_clear(unsigned short n);
  *  channel = the number of the channel
  *
  * Returns:
- *  the value read (if negative, error)
+ *  the value read, DEV_EOF at the end of the data (any other negative number is an error)
  */
 extern short sys_chan_read_b(short channel);
 
@@ -247,6 +268,32 @@ extern short sys_chan_write_b(short channel, unsigned char b);
  */
 extern short sys_chan_write(short channel, const unsigned char * buffer, short size);
 
+/*
+ * Read bytes from the channel into several buffers
+ *
+ * Inputs:
+ *  channel = the number of the channel
+ *  iov = array of (buffer, size) pairs to fill, in order
+ *  count = the number of entries in iov
+ *
+ * Returns:
+ *  total number of bytes read, any negative number is an error code
+ */
+extern short sys_chan_readv(short channel, p_chan_iovec iov, short count);
+
+/*
+ * Write bytes to the channel from several buffers in one system call
+ *
+ * Inputs:
+ *  channel = the number of the channel
+ *  iov = array of (buffer, size) pairs to write, in order
+ *  count = the number of entries in iov
+ *
+ * Returns:
+ *  total number of bytes written, any negative number is an error code
+ */
+extern short sys_chan_writev(short channel, p_chan_iovec iov, short count);
+
 /*
  * Return the status of the channel device
  *
@@ -316,7 +363,7 @@ extern short sys_chan_open(short dev, const uint8_t * path, short mode);
  * chan = the number of the channel to close
  *
  * Returns:
- * nothing useful
+ * 0 on success, otherwise the first error from flushing the channel's buffer or closing the device
  */
 extern short sys_chan_close(short chan);
 
@@ -366,6 +413,34 @@ extern short sys_bdev_read(short dev, long lba, unsigned char * buffer, short si
 //
 extern short sys_bdev_write(short dev, long lba, const unsigned char * buffer, short size);
 
+//
+// Read a run of consecutive blocks from the device
+//
+// Inputs:
+//  dev = the number of the device
+//  lba = the logical block address of the first block to read (unsigned, so up to 2TB of blocks)
+//  buffer = the buffer into which to copy the block data (must hold count * 512 bytes)
+//  count = the number of blocks to read (at most 128)
+//
+// Returns:
+//  number of blocks read, any negative number is an error code
+//
+extern short sys_bdev_read_blocks(short dev, unsigned long lba, unsigned char * buffer, short count);
+
+//
+// Write a run of consecutive blocks to the device
+//
+// Inputs:
+//  dev = the number of the device
+//  lba = the logical block address of the first block to write (unsigned, so up to 2TB of blocks)
+//  buffer = the buffer containing the data to write (count * 512 bytes)
+//  count = the number of blocks to write (at most 128)
+//
+// Returns:
+//  number of blocks written, any negative number is an error code
+//
+extern short sys_bdev_write_blocks(short dev, unsigned long lba, const unsigned char * buffer, short count);
+
 //
 // Return the status of the block device
 //
@@ -486,6 +561,25 @@ extern short sys_fsys_closedir(short dir);
  */
 extern short sys_fsys_readdir(short dir, p_file_info file);
 
+/**
+ * Read a batch of entries from an open directory as compact records
+ *
+ * Records are packed one after the other: an unsigned short length, then a
+ * t_dir_record_attr (if FSYS_RECORD_ATTR), then the NUL terminated name
+ * (if FSYS_RECORD_NAME).
+ *
+ * Inputs:
+ * dir = the handle of the open directory
+ * buffer = the buffer to fill with the packed records
+ * size = the size of the buffer in bytes (at least FSYS_RECORD_MAX)
+ * max_entries = the maximum number of records to return
+ * fields = which fields to include (FSYS_RECORD_NAME, FSYS_RECORD_ATTR, or both)
+ *
+ * Returns:
+ * the number of records returned (0 at the end of the directory), negative number on failure
+ */
+extern short sys_fsys_readdir_batch(short dir, unsigned char * buffer, short size, short max_entries, short fields);
+
 /**
  * Open a directory given the path and search for the first file matching the pattern.
  *
@@ -529,6 +623,62 @@ extern short sys_fsys_get_label(const char * path, char * label);
  */
 extern short sys_fsys_set_label(short drive, const char * label);
 
+/*
+ * Get the free space on the drive holding the path
+ *
+ * The first call for a FAT volume scans the FAT once to build a map of the
+ * free clusters. After that, the answer comes from memory.
+ *
+ * Inputs:
+ * path = path to the drive
+ * free_kb = pointer to the long to fill with the free space in KB
+ * total_kb = pointer to the long to fill with the size of the volume in KB (may be 0)
+ *
+ * Returns:
+ * 0 on success, negative number on failure
+ */
+extern short sys_fsys_get_free(const char * path, unsigned long * free_kb, unsigned long * total_kb);
+
+/***
+ *** Additional channel system calls
+ ***/
+
+/*
+ * Create a pipe
+ *
+ * Bytes written to the writer channel can be read from the reader channel.
+ * Once the writer channel is closed and the pipe has drained, the reader
+ * channel reports end of file. Close both channels with sys_chan_close.
+ *
+ * Inputs:
+ * reader = pointer to the short to set to the channel number of the reader end
+ * writer = pointer to the short to set to the channel number of the writer end
+ * flags = PIPE_BLOCK or PIPE_NONBLOCK
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+extern short sys_chan_pipe(short * reader, short * writer, short flags);
+
+/*
+ * Wait until at least one of a set of channels is ready
+ *
+ * A channel is ready if its status has any of the requested event bits, or if
+ * it is at end of file or in error. While waiting, the CPU sleeps between
+ * interrupts instead of spinning.
+ *
+ * Inputs:
+ *  channel_set = array of channel numbers to watch (entries of -1 are ignored).
+ *                On return, the channels that are not ready are replaced by -1.
+ *  count = the number of entries in channel_set
+ *  events = the status bits to wait for (CDEV_STAT_READABLE, CDEV_STAT_WRITABLE)
+ *  timeout_jiffies = how long to wait: 0 to check once, negative to wait forever
+ *
+ * Returns:
+ *  the number of ready channels (0 on timeout), any negative number is an error code
+ */
+extern short sys_chan_poll(short * channel_set, short count, short events, long timeout_jiffies);
+
 /**
  * Create a directory
  *
@@ -656,6 +806,63 @@ extern void sys_rtc_get_time(p_time time);
  */
 extern unsigned short sys_kbd_scancode();
 
+/*
+ * Get the next key event from the keyboard
+ *
+ * Inputs:
+ * event = the record to fill in with the event
+ *
+ * Returns:
+ * 1 if an event was returned, 0 if there was none waiting
+ */
+extern short sys_kbd_event(p_key_event event);
+
+/*
+ * Get the record of which keys are held down right now
+ *
+ * The record is kept up to date by the keyboard driver, so a program can keep the
+ * pointer and test a key with KEY_IS_DOWN whenever it needs to, without a system call.
+ *
+ * Returns:
+ * pointer to the kernel's key state record
+ */
+extern const t_key_state * sys_kbd_keystate();
+
+/*
+ * Get the next event from the mouse
+ *
+ * Events are only queued while the MOUSE channel is open. A program must open it first
+ * (sys_chan_open(CDEV_MOUSE, 0, 0)) and keep it open while it reads events, or this
+ * always returns 0. sys_mouse_state works without the channel.
+ *
+ * Inputs:
+ * event = the record to fill in with the event
+ *
+ * Returns:
+ * 1 if an event was returned, 0 if there was none waiting
+ */
+extern short sys_mouse_event(p_mouse_event event);
+
+/*
+ * Get the record of the mouse pointer's position and buttons
+ *
+ * The record is kept up to date by the mouse driver, so a program can keep the pointer
+ * and read it whenever it needs to, without a system call.
+ *
+ * Returns:
+ * pointer to the kernel's mouse state record
+ */
+extern const t_mouse_state * sys_mouse_state();
+
+/*
+ * Move the mouse pointer (clamped to the screen)
+ *
+ * Inputs:
+ * x = the new column of the pointer, in pixels
+ * y = the new row of the pointer, in pixels
+ */
+extern void sys_mouse_set_position(short x, short y);
+
 /*
  * Return an error message given an error number
  */
@@ -36,6 +36,35 @@ typedef struct s_color4 {
     uint8_t alpha;
 } t_color4;
 
+//
+// A key going down (make) or coming back up (break), as queued by the keyboard driver
+//
+typedef struct s_key_event {
+    unsigned long time;         // Jiffy count when the key changed
+    uint8_t scan_code;          // The key's scan code (0x01 - 0x7F)
+    uint8_t modifiers;          // The modifier and lock keys after the change (same bits as in a scan code word)
+    uint8_t flags;              // KEY_EVENT_BREAK, KEY_EVENT_LOST, KEY_EVENT_REPEAT
+    uint8_t reserved;
+} t_key_event, *p_key_event;
+
+#define KEY_EVENT_BREAK     0x01    /* The key was released (otherwise it was pressed) */
+#define KEY_EVENT_LOST      0x02    /* Events were dropped before this one because the queue was full */
+#define KEY_EVENT_REPEAT    0x04    /* A make for a key that was already down (typematic repeat) */
+
+//
+// The keys held down right now, kept up to date by the keyboard driver
+//
+// A program may keep the pointer to this record and read it whenever it likes.
+//
+typedef struct s_key_state {
+    uint8_t keys[16];           // One bit per scan code: bit (code & 7) of keys[code >> 3] is set while the key is held
+    uint8_t modifiers;          // The modifier and lock keys (same bits as in a scan code word)
+    uint8_t reserved;
+    volatile uint16_t changes;  // Bumped on every key change, so a reader can tell when the state moved
+} t_key_state, *p_key_state;
+
+#define KEY_IS_DOWN(state, code)    (((state)->keys[((code) & 0x7f) >> 3] >> ((code) & 7)) & 1)
+
 /*
  * Function types
  */
@@ -49,5 +78,7 @@ typedef short (*FUNC_LBS_2_S)(long, unsigned char *, short);
 typedef short (*FUNC_LcBS_2_S)(long, const unsigned char *, short);
 typedef short (*FUNC_SBS_2_S)(short, unsigned char *, short);
 typedef short (*FUNC_LB_2_S)(long, short);
+typedef short (*FUNC_ULBS_2_S)(unsigned long, unsigned char *, short);
+typedef short (*FUNC_ULcBS_2_S)(unsigned long, const unsigned char *, short);
 
 #endif
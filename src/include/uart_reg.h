@@ -51,6 +51,18 @@
 #define IIR_LINE_STATUS         0x06        /* Line Status Interrupt */
 #define IIR_TIMEOUT             0x0C        /* Time-out Interrupt (16550 and later) */
 #define IIR_INTERRUPT_PENDING   0x01        /* Interrupt Pending Flag */
+#define IIR_ID_MASK             0x0E        /* Mask for the interrupt code bits */
+
+/* FIFO Control Register Codes */
+#define FCR_TRIGGER_1           0x00        /* Receive interrupt after 1 byte */
+#define FCR_TRIGGER_4           0x40        /* Receive interrupt after 4 bytes */
+#define FCR_TRIGGER_8           0x80        /* Receive interrupt after 8 bytes */
+#define FCR_TRIGGER_14          0xC0        /* Receive interrupt after 14 bytes */
+#define FCR_CLEAR_XMIT          0x04        /* Clear the transmit FIFO */
+#define FCR_CLEAR_RECV          0x02        /* Clear the receive FIFO */
+#define FCR_FIFO_ENABLE         0x01        /* Enable the FIFOs */
+
+#define UART_FIFO_SIZE          16          /* Number of bytes in the transmit FIFO */
 
 /* Line Control Register Codes */
 #define LCR_DLB                 0x80        /* Divisor Latch Access Bit */
@@ -70,6 +82,24 @@
 #define LCR_DATABITS_7          0x02        /* Data Bits: 7 */
 #define LCR_DATABITS_8          0x03        /* Data Bits: 8 */
 
+/* Modem Control Register Codes */
+#define MCR_LOOPBACK            0x10        /* Loopback mode */
+#define MCR_OUT2                0x08        /* OUT2 (gates the interrupt line) */
+#define MCR_OUT1                0x04        /* OUT1 */
+#define MCR_RTS                 0x02        /* Request To Send */
+#define MCR_DTR                 0x01        /* Data Terminal Ready */
+
+/* Modem Status Register Codes */
+#define MSR_DCD                 0x80        /* Data Carrier Detect */
+#define MSR_RI                  0x40        /* Ring Indicator */
+#define MSR_DSR                 0x20        /* Data Set Ready */
+#define MSR_CTS                 0x10        /* Clear To Send */
+#define MSR_DELTA_DCD           0x08        /* DCD has changed */
+#define MSR_TRAIL_RI            0x04        /* RI has gone inactive */
+#define MSR_DELTA_DSR           0x02        /* DSR has changed */
+#define MSR_DELTA_CTS           0x01        /* CTS has changed */
+
+/* Line Status Register Codes */
 #define LSR_ERR_RECIEVE         0x80        /* Error in Received FIFO */
 #define LSR_XMIT_DONE           0x40        /* All data has been transmitted */
 #define LSR_XMIT_EMPTY          0x20        /* Empty transmit holding register */
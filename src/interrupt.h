@@ -223,6 +223,13 @@ extern short int_disable_all();
  */
 extern void int_restore(short int_mask);
 
+/*
+ * Sleep until an interrupt has been handled
+ *
+ * NOTE: this is actually provided in the low level assembly (STOP on the 68000)
+ */
+extern void int_wait();
+
 /*
  * Disable an interrupt by masking it
  *
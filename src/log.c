@@ -9,14 +9,25 @@
 #include "log.h"
 #include "simpleio.h"
 #include "syscalls.h"
+#include "timers.h"
+#include "uart_reg.h"
+#include "dev/channel.h"
 #include "dev/text_screen_iii.h"
+#include "dev/uart.h"
+
+#define LOG_RECORD_MAX  128     /* Longest record queued for the serial sink (longer messages are cut short) */
 
 static short log_channel = 0;
 static short log_level = 999;
+static short log_sink = LOG_SINK_CHANNEL;
+static short log_sink_channel = -1;     /* The COM1 channel held open by the serial sink */
+static unsigned long log_dropped = 0;   /* Records dropped by the serial sink since it was turned on */
+static unsigned long log_unreported = 0;/* Dropped records not yet noted in the log */
 
 void log_init() {
     log_channel = 0;
     log_level = 999;
+    log_sink = LOG_SINK_CHANNEL;
 }
 
 unsigned short panic_number;        /* The number of the kernel panic */
@@ -60,7 +71,10 @@ const char * err_messages[] = {
     "file locked",
     "not enough core",
     "too many open files",
-    "file system invalid parameter"
+    "file system invalid parameter",
+    "operation would block",
+    "memory already in use",
+    "end of file"
 };
 
 /*
@@ -69,7 +83,7 @@ const char * err_messages[] = {
 const char * err_message(short err_number) {
     short index = 0 - err_number;
 
-    if (index < sizeof(err_messages)) {
+    if (index < sizeof(err_messages) / sizeof(err_messages[0])) {
         return err_messages[index];
     } else {
         return "unknown error";
@@ -207,6 +221,135 @@ void log_setlevel(short level) {
     log_level = level;
 }
 
+/*
+ * Choose where log messages go
+ *
+ * LOG_SINK_CHANNEL prints each message to the log channel before returning.
+ * LOG_SINK_COM1 queues each message as a timestamped record, which the COM1 transmit
+ * interrupt sends at 115200 bps. If the queue is full, the record is dropped and counted.
+ *
+ * Input:
+ * sink = LOG_SINK_CHANNEL or LOG_SINK_COM1
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+short log_setsink(short sink) {
+    uint8_t bps[2];
+    short channel;
+
+    if (sink == log_sink) {
+        return 0;
+    }
+
+    if (sink == LOG_SINK_COM1) {
+        channel = chan_open(CDEV_COM1, 0, 0);
+        if (channel < 0) {
+            return channel;
+        }
+
+        bps[0] = (UART_115200 >> 8) & 0xff;
+        bps[1] = UART_115200 & 0xff;
+        chan_ioctrl(channel, UART_IOCTRL_BPS, bps, 2);
+
+        log_sink_channel = channel;
+        log_dropped = 0;
+        log_unreported = 0;
+        log_sink = LOG_SINK_COM1;
+
+    } else {
+        log_sink = LOG_SINK_CHANNEL;
+        if (log_sink_channel >= 0) {
+            chan_close(log_sink_channel);
+            log_sink_channel = -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Return the current log sink (LOG_SINK_CHANNEL or LOG_SINK_COM1)
+ */
+short log_getsink() {
+    return log_sink;
+}
+
+/*
+ * Return the number of records the serial sink has dropped since it was turned on
+ */
+unsigned long log_dropped_count() {
+    return log_dropped;
+}
+
+/*
+ * Count a record the serial sink had to drop
+ *
+ * NOTE: messages may be logged from interrupt handlers, so the counts are updated with interrupts off.
+ */
+static void log_count_drop(unsigned long records) {
+    short mask = int_disable_all();
+    log_dropped += records;
+    log_unreported += records;
+    int_restore(mask);
+}
+
+/*
+ * Queue a record on the serial sink: a timestamp (in jiffies), the parts of the message, and a CR/LF
+ *
+ * Inputs:
+ * message1 = the first part of the message
+ * message2 = the second part of the message (or 0)
+ * message3 = the third part of the message (or 0)
+ */
+static void log_record(const char * message1, const char * message2, const char * message3) {
+    char record[LOG_RECORD_MAX];
+    const char * parts[3];
+    unsigned long unreported;
+    short length;
+    short mask;
+    short i;
+
+    mask = int_disable_all();
+    unreported = log_unreported;
+    log_unreported = 0;
+    int_restore(mask);
+
+    if (unreported > 0) {
+        /* Note the records lost since the last one that made it */
+        sprintf(record, "[%8ld] (%lu log records dropped)\r\n", timers_jiffies(), unreported);
+        if (!uart_put_record(0, (const uint8_t *)record, strlen(record))) {
+            /* Still no room: report them next time */
+            mask = int_disable_all();
+            log_unreported += unreported;
+            int_restore(mask);
+        }
+    }
+
+    parts[0] = message1;
+    parts[1] = message2;
+    parts[2] = message3;
+
+    sprintf(record, "[%8ld] ", timers_jiffies());
+    length = strlen(record);
+
+    for (i = 0; i < 3; i++) {
+        const char * c = parts[i];
+        if (c) {
+            while (*c && (length < LOG_RECORD_MAX - 2)) {
+                record[length++] = *c++;
+            }
+        }
+    }
+
+    record[length++] = '\r';
+    record[length++] = '\n';
+
+    if (!uart_put_record(0, (const uint8_t *)record, length)) {
+        log_count_drop(1);
+    }
+}
+
 /*
  * Log a message to the console
  *
@@ -216,8 +359,12 @@ void log_setlevel(short level) {
  */
 void log(short level, char * message) {
     if (level <= log_level) {
-        print(log_channel, message);
-        print_c(log_channel, '\n');
+        if (log_sink == LOG_SINK_COM1) {
+            log_record(message, 0, 0);
+        } else {
+            print(log_channel, message);
+            print_c(log_channel, '\n');
+        }
     }
 }
 
@@ -231,9 +378,13 @@ void log(short level, char * message) {
  */
 void log2(short level, char * message1, char * message2) {
     if (level <= log_level) {
-        print(log_channel, message1);
-        print(log_channel, message2);
-        print_c(log_channel, '\n');
+        if (log_sink == LOG_SINK_COM1) {
+            log_record(message1, message2, 0);
+        } else {
+            print(log_channel, message1);
+            print(log_channel, message2);
+            print_c(log_channel, '\n');
+        }
     }
 }
 
@@ -248,10 +399,14 @@ void log2(short level, char * message1, char * message2) {
  */
 void log3(short level, const char * message1, const char * message2, const char * message3) {
     if (level <= log_level) {
-        print(log_channel, message1);
-        print(log_channel, message2);
-        print(log_channel, message3);
-        print_c(log_channel, '\n');
+        if (log_sink == LOG_SINK_COM1) {
+            log_record(message1, message2, message3);
+        } else {
+            print(log_channel, message1);
+            print(log_channel, message2);
+            print(log_channel, message3);
+            print_c(log_channel, '\n');
+        }
     }
 }
 
@@ -265,17 +420,32 @@ void log3(short level, const char * message1, const char * message2, const char
  */
 void log_num(short level, char * message, int n) {
     if (level <= log_level) {
-        print(log_channel, message);
-        print_hex_32(log_channel, n);
-        print_c(log_channel, '\n');
+        if (log_sink == LOG_SINK_COM1) {
+            char number[10];
+            sprintf(number, "%08X", n);
+            log_record(message, number, 0);
+        } else {
+            print(log_channel, message);
+            print_hex_32(log_channel, n);
+            print_c(log_channel, '\n');
+        }
     }
 }
 
 /*
  * Send a single character to the debugging channel
+ *
+ * On the serial sink, the character goes out as a record of its own, like any other message.
  */
 void log_c(short level, char c) {
     if (log_level <= level) {
-        print_c(log_channel, c);
+        if (log_sink == LOG_SINK_COM1) {
+            char message[2];
+            message[0] = c;
+            message[1] = 0;
+            log_record(message, 0, 0);
+        } else {
+            print_c(log_channel, c);
+        }
     }
 }
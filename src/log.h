@@ -12,6 +12,9 @@
 #define LOG_TRACE   4   /* Log tracing information (like entry into a subroutine) */
 #define LOG_VERBOSE 5   /* Log a truly verbose message... the sort you almost never want to bother with */
 
+#define LOG_SINK_CHANNEL    0   /* Print messages to the log channel as they are logged */
+#define LOG_SINK_COM1       1   /* Queue timestamped records for the COM1 transmit interrupt to send */
+
 /*
  * Return human readable message for an error number
  */
@@ -44,6 +47,31 @@ extern void panic(void);
  */
 extern void log_setlevel(short level);
 
+/*
+ * Choose where log messages go
+ *
+ * LOG_SINK_CHANNEL prints each message to the log channel before returning.
+ * LOG_SINK_COM1 queues each message as a timestamped record, which the COM1 transmit
+ * interrupt sends at 115200 bps. If the queue is full, the record is dropped and counted.
+ *
+ * Input:
+ * sink = LOG_SINK_CHANNEL or LOG_SINK_COM1
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+extern short log_setsink(short sink);
+
+/*
+ * Return the current log sink (LOG_SINK_CHANNEL or LOG_SINK_COM1)
+ */
+extern short log_getsink();
+
+/*
+ * Return the number of records the serial sink has dropped since it was turned on
+ */
+extern unsigned long log_dropped_count();
+
 /*
  * Log a message to the console
  *
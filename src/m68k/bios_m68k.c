@@ -10,8 +10,10 @@
 #include "interrupt.h"
 #include "proc.h"
 #include "dev/channel.h"
+#include "dev/pipe.h"
 #include "dev/block.h"
 #include "dev/fsys.h"
+#include "dev/mouse.h"
 #include "dev/rtc.h"
 #include "sys_general.h"
 
@@ -112,6 +114,12 @@ unsigned long syscall_dispatch(int32_t function, int32_t param0, int32_t param1,
                     text_setsizes((short)param0);
                     return 0;
 
+                case KFN_CHAN_READV:
+                    return chan_readv((short)param0, (p_chan_iovec)param1, (short)param2);
+
+                case KFN_CHAN_WRITEV:
+                    return chan_writev((short)param0, (p_chan_iovec)param1, (short)param2);
+
                 default:
                     return ERR_GENERAL;
             }
@@ -138,6 +146,12 @@ unsigned long syscall_dispatch(int32_t function, int32_t param0, int32_t param1,
                 case KFN_BDEV_REGISTER:
                     return bdev_register((p_dev_block)param0);
 
+                case KFN_BDEV_GETBLOCKS:
+                    return bdev_read_blocks((short)param0, (unsigned long)param1, (unsigned char *)param2, (short)param3);
+
+                case KFN_BDEV_PUTBLOCKS:
+                    return bdev_write_blocks((short)param0, (unsigned long)param1, (unsigned char *)param2, (short)param3);
+
                 default:
                     return ERR_GENERAL;
             }
@@ -233,6 +247,30 @@ unsigned long syscall_dispatch(int32_t function, int32_t param0, int32_t param1,
                 case KFN_ERR_MESSAGE:
                     return (unsigned long)err_message((short)param0);
 
+                case KFN_KBD_EVENT:
+#if MODEL == MODEL_FOENIX_A2560K
+                    return kbdmo_get_event((p_key_event)param0);
+#else
+                    return kbd_get_event((p_key_event)param0);
+#endif
+
+                case KFN_KBD_KEYSTATE:
+#if MODEL == MODEL_FOENIX_A2560K
+                    return (unsigned long)kbdmo_key_state();
+#else
+                    return (unsigned long)kbd_key_state();
+#endif
+
+                case KFN_MOUSE_EVENT:
+                    return mouse_get_event((p_mouse_event)param0);
+
+                case KFN_MOUSE_STATE:
+                    return (unsigned long)mouse_state();
+
+                case KFN_MOUSE_SETXY:
+                    mouse_set_position((short)param0, (short)param1);
+                    return 0;
+
                 case KFN_KBD_LAYOUT:
 #if MODEL == MODEL_FOENIX_A2560K
                     return kbdmo_layout((const char *)param0);
@@ -244,6 +282,32 @@ unsigned long syscall_dispatch(int32_t function, int32_t param0, int32_t param1,
                     return ERR_GENERAL;
             }
 
+        case 0x60:
+            /* Additional file system functions */
+            switch (function) {
+                case KFN_READDIR_BATCH:
+                    return fsys_readdir_batch((short)param0, (unsigned char *)param1, (short)param2, (short)param3, (short)param4);
+
+                case KFN_GET_FREE:
+                    return fsys_get_free((const char *)param0, (unsigned long *)param1, (unsigned long *)param2);
+
+                default:
+                    return ERR_GENERAL;
+            }
+
+        case 0x70:
+            /* Additional channel functions */
+            switch (function) {
+                case KFN_CHAN_PIPE:
+                    return pipe_create((short *)param0, (short *)param1, (short)param2);
+
+                case KFN_CHAN_POLL:
+                    return chan_poll((short *)param0, (short)param1, (short)param2, (long)param3);
+
+                default:
+                    return ERR_GENERAL;
+            }
+
         default:
             break;
     }
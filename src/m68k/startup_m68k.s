@@ -9,6 +9,8 @@
             xdef _int_disable_all
             xdef _call_user
             xdef _restart_cli
+            xdef _mem_fill_long
+            xdef _int_wait
 
 ;
 ; Interrupt registers for A2560U and U+
@@ -86,11 +88,11 @@ PENDING_GRP2 = $00B00104
             dc.l interrupt_x10      ; 64 - Interrupt 0x10 - SuperIO - PS/2 Keyboard
             dc.l interrupt_x11      ; 65 - Interrupt 0x11 - A2560K Built-in Keyboard (Mo)
             dc.l interrupt_x12      ; 66 - Interrupt 0x12 - SuperIO - PS/2 Mouse
-            dc.l not_impl           ; 67 - Interrupt 0x13 - SuperIO - COM1
-            dc.l not_impl           ; 68 - Interrupt 0x14 - SuperIO - COM2
-            dc.l not_impl           ; 69 - Interrupt 0x15 - SuperIO - LPT1
+            dc.l interrupt_x13      ; 67 - Interrupt 0x13 - SuperIO - COM1
+            dc.l interrupt_x14      ; 68 - Interrupt 0x14 - SuperIO - COM2
+            dc.l interrupt_x15      ; 69 - Interrupt 0x15 - SuperIO - LPT1
             dc.l not_impl           ; 70 - Interrupt 0x16 - SuperIO - Floppy Disk Controller
-            dc.l not_impl           ; 71 - Interrupt 0x17 - SuperIO - MIDI
+            dc.l interrupt_x17      ; 71 - Interrupt 0x17 - SuperIO - MIDI
             dc.l not_impl           ; 72 - Interrupt 0x18 - Timer 0
             dc.l not_impl           ; 73 - Interrupt 0x19 - Timer 1
             dc.l not_impl           ; 74 - Interrupt 0x1A - Timer 2
@@ -207,6 +209,42 @@ interrupt_x12:
             move.w #($12<<2),d0             ; Get the offset to interrupt 0x11
             bra int_dispatch                ; And process the interrupt
 
+;
+; Interrupt Vector 0x13 -- SuperIO COM1
+;
+interrupt_x13:
+            move.w #$0008,(PENDING_GRP1)    ; Clear the flag for INT 13
+            movem.l d0-d7/a0-a6,-(a7)       ; Save affected registers
+            move.w #($13<<2),d0             ; Get the offset to interrupt 0x13
+            bra int_dispatch                ; And process the interrupt
+
+;
+; Interrupt Vector 0x14 -- SuperIO COM2
+;
+interrupt_x14:
+            move.w #$0010,(PENDING_GRP1)    ; Clear the flag for INT 14
+            movem.l d0-d7/a0-a6,-(a7)       ; Save affected registers
+            move.w #($14<<2),d0             ; Get the offset to interrupt 0x14
+            bra int_dispatch                ; And process the interrupt
+
+;
+; Interrupt Vector 0x15 -- SuperIO LPT1
+;
+interrupt_x15:
+            move.w #$0020,(PENDING_GRP1)    ; Clear the flag for INT 15
+            movem.l d0-d7/a0-a6,-(a7)       ; Save affected registers
+            move.w #($15<<2),d0             ; Get the offset to interrupt 0x15
+            bra int_dispatch                ; And process the interrupt
+
+;
+; Interrupt Vector 0x17 -- SuperIO MIDI
+;
+interrupt_x17:
+            move.w #$0080,(PENDING_GRP1)    ; Clear the flag for INT 17
+            movem.l d0-d7/a0-a6,-(a7)       ; Save affected registers
+            move.w #($17<<2),d0             ; Get the offset to interrupt 0x17
+            bra int_dispatch                ; And process the interrupt
+
 ;
 ; Interrupt Vector 0x1F -- RTC
 ;
@@ -265,6 +303,54 @@ _int_restore:       move.w (4,sp),d0    ; Get the priority into d0
 
                     rts
 
+;
+; Sleep until the next interrupt
+;
+; The CPU is stopped with all interrupt levels enabled. Once the interrupt
+; has been handled, the caller's interrupt mask is put back.
+;
+_int_wait:          move.w SR,d0        ; Save the current status register
+                    stop #$2000         ; Supervisor mode, level 0: wait for an interrupt
+                    move.w d0,SR        ; Put back the caller's level
+                    rts
+
+;
+; Fill a block of memory with a long word value
+;
+; void mem_fill_long(void * dest, unsigned long value, unsigned long count)
+;
+; dest must be word aligned, count is the number of bytes and should be a
+; multiple of 4 (any remainder is ignored). Like the BSS clear at boot, this
+; uses moves rather than clr.l, since the FPGA's bus logic does not support
+; read-modify-write cycles. The main loop does 32 bytes per iteration.
+;
+_mem_fill_long:     move.l (4,a7),a0    ; Get the destination
+                    move.l (8,a7),d1    ; Get the value to fill with
+                    move.l (12,a7),d0   ; Get the number of bytes
+                    lsr.l #5,d0         ; Convert to a count of 32 byte blocks
+                    beq.s mfl_tail
+
+mfl_block:          move.l d1,(a0)+
+                    move.l d1,(a0)+
+                    move.l d1,(a0)+
+                    move.l d1,(a0)+
+                    move.l d1,(a0)+
+                    move.l d1,(a0)+
+                    move.l d1,(a0)+
+                    move.l d1,(a0)+
+                    subq.l #1,d0
+                    bne.s mfl_block
+
+mfl_tail:           move.l (12,a7),d0   ; Get the bytes left after the blocks
+                    andi.l #$1c,d0
+                    beq.s mfl_done
+
+mfl_long:           move.l d1,(a0)+
+                    subq.l #4,d0
+                    bne.s mfl_long
+
+mfl_done:           rts
+
 ;
 ; Handlers for the various exceptions...
 ;
@@ -8,13 +8,22 @@
  * or memory can be reserved, in which case the program specifies which memory pages it is using.
  */
 
+#include "errors.h"
 #include "memory.h"
+#include "sys_general.h"
 
 #define MEM_PAGE_SIZE   4096                /* The size of a page in bytes */
-#define MEM_MAX_PAGES   0x40                /* The maximum number of pages of system RAM on this computer */
-#define MEM_OWN_KERNEL  1                   /* "PID" of the kernel */
-#define MEM_OWN_NULL    2                   /* "PID" of memory not in the system */
+#define MEM_MAX_PAGES   0x400               /* The maximum number of pages of system RAM on this computer */
 #define MEM_TAG_VECTORS 1                   /* Tag for the vector block */
+#define MEM_TAG_KERNEL  2                   /* Tag for the kernel's data, BSS, heap, and stack */
+
+/*
+ * The top of the kernel's RAM, from the linker script (___STACK = RAMSTART + RAMSIZE).
+ * Everything below it (the vectors, data, BSS, heap, and supervisor stack) belongs to the kernel.
+ */
+extern char __STACK[];
+
+static unsigned short mem_last_tag = MEM_TAG_LOAD_LAST;     /* The last tag handed out by mem_new_tag */
 
 /*
  * Structure to track who owns a page of memory
@@ -44,19 +53,26 @@ uint32_t mem_page_to_addr(short page) {
  * Initialize the memory management system
  */
 void mem_init() {
+    t_sys_info info;
     int page;
+    int ram_pages;
 
-    /* Initialize the page ownership for all pages to "unowned" */
+    /* Figure out how many pages of RAM this machine actually has */
+    sys_get_information(&info);
+    ram_pages = mem_addr_to_page(info.system_ram_size);
+    if (ram_pages > MEM_MAX_PAGES) {
+        ram_pages = MEM_MAX_PAGES;
+    }
+
+    /* Initialize the page ownership for all pages to "unowned", and any missing RAM to "null" */
     for (page = 0; page < MEM_MAX_PAGES; page++) {
-        mem_pages[page].pid = 0;
+        mem_pages[page].pid = (page < ram_pages) ? 0 : MEM_OWN_NULL;
         mem_pages[page].tag = 0;
     }
 
     /* The kernel should now claim the memory it needs to operate */
-    mem_reserve(MEM_OWN_KERNEL, MEM_TAG_VECTORS, 0, mem_page_to_addr(1));   /* Reserve the first page for system vectors */
-
-    /* TODO: scan the system for memory or set it based on the machine ID */
-    /* TODO: reserve the kernel's working memory */
+    mem_reserve(MEM_OWN_KERNEL, MEM_TAG_VECTORS, 0, mem_page_to_addr(1) - 1);   /* Reserve the first page for system vectors */
+    mem_reserve(MEM_OWN_KERNEL, MEM_TAG_KERNEL, mem_page_to_addr(1), (uint32_t)__STACK - 1);   /* Reserve the kernel's working memory */
 }
 
 /*
@@ -150,7 +166,7 @@ uint32_t mem_alloc(unsigned short pid, unsigned short tag, uint32_t bytes) {
                 /* We have found enough pages to hold the requested amount of memory... */
 
                 /* Allocate the memory to this process */
-                for (i = first_free; i < free_count + first_free - 1; i++) {
+                for (i = first_free; i < free_count + first_free; i++) {
                     mem_pages[i].pid = pid;
                     mem_pages[i].tag = tag;
                 }
@@ -165,6 +181,49 @@ uint32_t mem_alloc(unsigned short pid, unsigned short tag, uint32_t bytes) {
     return 0;
 }
 
+/*
+ * Allocate a block of memory for a program from the top of RAM.
+ *
+ * This keeps long lived blocks (such as a program's stack) out of the way of
+ * images loaded at fixed addresses near the bottom of RAM.
+ *
+ * Inputs:
+ * pid = the ID of the process that will own this memory
+ * tag = a number that must be unique per allocated block in a process
+ * bytes = the number of bytes to allocate
+ *
+ * Returns:
+ * the address of the first byte of the allocated block, 0 for failure
+ */
+uint32_t mem_alloc_top(unsigned short pid, unsigned short tag, uint32_t bytes) {
+    short page;
+    short i;
+    short free_count = 0;
+
+    for (page = MEM_MAX_PAGES - 1; page >= 0; page--) {
+        if (mem_pages[page].pid != 0) {
+            /* Page is not free (or not RAM)... start counting again */
+            free_count = 0;
+
+        } else {
+            free_count++;
+
+            if (free_count * MEM_PAGE_SIZE >= bytes) {
+                /* The run from this page up is big enough... give it to the process */
+                for (i = page; i < page + free_count; i++) {
+                    mem_pages[i].pid = pid;
+                    mem_pages[i].tag = tag;
+                }
+
+                return mem_page_to_addr(page);
+            }
+        }
+    }
+
+    /* We did not find a block big enough... return 0 */
+    return 0;
+}
+
 /*
  * Reserve a block of memory for a program.
  *
@@ -186,6 +245,11 @@ int mem_reserve(unsigned short pid, unsigned short tag, uint32_t start_addr, uin
     short start_page = mem_addr_to_page(start_addr);
     short end_page = mem_addr_to_page(end_addr);
 
+    if ((start_page > end_page) || (end_page >= MEM_MAX_PAGES)) {
+        /* Block is not in the memory we manage */
+        return -1;
+    }
+
     /* Check to see if all the pages are free */
     for (page = start_page; page <= end_page; page++) {
         if (mem_pages[page].pid != 0) {
@@ -197,13 +261,53 @@ int mem_reserve(unsigned short pid, unsigned short tag, uint32_t start_addr, uin
 
     /* Reserve the pages */
     for (page = start_page; page <= end_page; page++) {
-        mem_pages[page].pid = 0;
-        mem_pages[page].tag = 0;
+        mem_pages[page].pid = pid;
+        mem_pages[page].tag = tag;
     }  
 
     return 0;
 }
 
+/*
+ * Claim the pages holding a range of addresses for a block that may already have some of them.
+ *
+ * Unlike mem_reserve, pages already owned by the same process and tag are accepted, so a
+ * loader can claim the pages for each piece of an image as it writes them.
+ *
+ * Inputs:
+ * pid = the ID of the process that will own this memory
+ * tag = the tag of the block the pages belong to
+ * start_addr = the address of the first byte to claim
+ * end_addr = the address of the last byte to claim
+ *
+ * Returns:
+ * 0 on success, ERR_MEMORY_IN_USE if any of the pages belongs to something else
+ */
+short mem_claim(unsigned short pid, unsigned short tag, uint32_t start_addr, uint32_t end_addr) {
+    short page;
+    short start_page = mem_addr_to_page(start_addr);
+    short end_page = mem_addr_to_page(end_addr);
+
+    if ((start_addr > end_addr) || (end_addr >= mem_page_to_addr(MEM_MAX_PAGES))) {
+        /* Block is not in the memory we manage */
+        return ERR_MEMORY_IN_USE;
+    }
+
+    /* Check that every page is free or already ours */
+    for (page = start_page; page <= end_page; page++) {
+        if ((mem_pages[page].pid != 0) && ((mem_pages[page].pid != pid) || (mem_pages[page].tag != tag))) {
+            return ERR_MEMORY_IN_USE;
+        }
+    }
+
+    for (page = start_page; page <= end_page; page++) {
+        mem_pages[page].pid = pid;
+        mem_pages[page].tag = tag;
+    }
+
+    return 0;
+}
+
 /*
  * Return a block of memory to the kernel.
  *
@@ -215,17 +319,17 @@ void mem_free(unsigned short pid, uint32_t address) {
     short tag, p, start_page, end_page;
     short page = mem_addr_to_page(address);
 
-    if (mem_pages[page].pid == pid) {
+    if ((page < MEM_MAX_PAGES) && (mem_pages[page].pid == pid)) {
         /* If this page is owned by the calling process, get the tag for this block */
         tag = mem_pages[page].tag;
 
         /* Scan the previous pages until we find a page not in this block */
-        for (p = page; (mem_pages[p].pid == pid) && (mem_pages[p].tag == tag); p--) {
+        for (p = page; (p >= 0) && (mem_pages[p].pid == pid) && (mem_pages[p].tag == tag); p--) {
             start_page = p;
         }
 
         /* Scan the next pages until we find a page not in this block */
-        for (p = page; (mem_pages[p].pid == pid) && (mem_pages[p].tag == tag); p++) {
+        for (p = page; (p < MEM_MAX_PAGES) && (mem_pages[p].pid == pid) && (mem_pages[p].tag == tag); p++) {
             end_page = p;
         }
 
@@ -248,9 +352,62 @@ void mem_free_all(unsigned short pid) {
 
     /* Reset all pages owned by this PID to unowned */
     for (page = 0; page < MEM_MAX_PAGES; page++) {
-        if (mem_pages[page].pid = pid) {
+        if (mem_pages[page].pid == pid) {
             mem_pages[page].pid = 0;
             mem_pages[page].tag = 0;
         }
     }
 }
+
+/*
+ * Return all memory a process has under a given tag.
+ *
+ * Inputs:
+ * pid = the ID of the process that owns the memory
+ * tag = the tag of the pages to return
+ */
+void mem_free_tag(unsigned short pid, unsigned short tag) {
+    int page;
+
+    for (page = 0; page < MEM_MAX_PAGES; page++) {
+        if ((mem_pages[page].pid == pid) && (mem_pages[page].tag == tag)) {
+            mem_pages[page].pid = 0;
+            mem_pages[page].tag = 0;
+        }
+    }
+}
+
+/*
+ * Find a tag in the loaded image range that a process is not using.
+ *
+ * Tags are handed out round robin from MEM_TAG_LOAD_FIRST to MEM_TAG_LOAD_LAST,
+ * skipping any that still have pages.
+ *
+ * Inputs:
+ * pid = the ID of the process that will own the memory
+ *
+ * Returns:
+ * the tag, 0 if every tag in the range is in use
+ */
+unsigned short mem_new_tag(unsigned short pid) {
+    unsigned short tag = mem_last_tag;
+    unsigned short tries;
+    int page;
+
+    for (tries = 0; tries <= MEM_TAG_LOAD_LAST - MEM_TAG_LOAD_FIRST; tries++) {
+        tag = (tag >= MEM_TAG_LOAD_LAST) ? MEM_TAG_LOAD_FIRST : tag + 1;
+
+        for (page = 0; page < MEM_MAX_PAGES; page++) {
+            if ((mem_pages[page].pid == pid) && (mem_pages[page].tag == tag)) {
+                break;
+            }
+        }
+
+        if (page == MEM_MAX_PAGES) {
+            mem_last_tag = tag;
+            return tag;
+        }
+    }
+
+    return 0;
+}
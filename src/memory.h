@@ -13,6 +13,13 @@
 
 #include "types.h"
 
+#define MEM_OWN_KERNEL  1                   /* "PID" of the kernel */
+#define MEM_OWN_NULL    2                   /* "PID" of memory not in the system */
+#define MEM_OWN_USER    3                   /* "PID" of the current user program */
+
+#define MEM_TAG_LOAD_FIRST  0x0100          /* First tag handed out for loaded images (see mem_new_tag) */
+#define MEM_TAG_LOAD_LAST   0x0fff          /* Last tag handed out for loaded images */
+
 typedef struct s_memory_info {
     short total_pages;
     short allocated_pages;
@@ -46,6 +53,22 @@ extern void mem_statistics(p_memory_info info);
  */
 extern uint32_t mem_alloc(unsigned short pid, unsigned short tag, uint32_t bytes);
 
+/*
+ * Allocate a block of memory for a program from the top of RAM.
+ *
+ * Kernel buffers (MEM_OWN_KERNEL) should come from here too: programs load at fixed
+ * addresses near the bottom of RAM (0x10000 and up), and a buffer there would block them.
+ *
+ * Inputs:
+ * pid = the ID of the process that will own this memory
+ * tag = a number that must be unique per allocated block in a process
+ * bytes = the number of bytes to allocate
+ *
+ * Returns:
+ * the address of the first byte of the allocated block, 0 for failure
+ */
+extern uint32_t mem_alloc_top(unsigned short pid, unsigned short tag, uint32_t bytes);
+
 /*
  * Reserve a block of memory for a program.
  *
@@ -64,6 +87,23 @@ extern uint32_t mem_alloc(unsigned short pid, unsigned short tag, uint32_t bytes
  */
 extern int mem_reserve(unsigned short pid, unsigned short tag, uint32_t start_addr, uint32_t end_addr);
 
+/*
+ * Claim the pages holding a range of addresses for a block that may already have some of them.
+ *
+ * Pages already owned by the same process and tag are accepted, so a loader can
+ * claim the pages for each piece of an image as it writes them.
+ *
+ * Inputs:
+ * pid = the ID of the process that will own this memory
+ * tag = the tag of the block the pages belong to
+ * start_addr = the address of the first byte to claim
+ * end_addr = the address of the last byte to claim
+ *
+ * Returns:
+ * 0 on success, ERR_MEMORY_IN_USE if any of the pages belongs to something else
+ */
+extern short mem_claim(unsigned short pid, unsigned short tag, uint32_t start_addr, uint32_t end_addr);
+
 /*
  * Return a block of memory to the kernel.
  *
@@ -81,4 +121,35 @@ extern void mem_free(unsigned short pid, uint32_t address);
  */
 extern void mem_free_all(unsigned short pid);
 
+/*
+ * Return all memory a process has under a given tag.
+ *
+ * Inputs:
+ * pid = the ID of the process that owns the memory
+ * tag = the tag of the pages to return
+ */
+extern void mem_free_tag(unsigned short pid, unsigned short tag);
+
+/*
+ * Find a tag in the loaded image range (MEM_TAG_LOAD_FIRST to MEM_TAG_LOAD_LAST)
+ * that a process is not using.
+ *
+ * Inputs:
+ * pid = the ID of the process that will own the memory
+ *
+ * Returns:
+ * the tag, 0 if every tag in the range is in use
+ */
+extern unsigned short mem_new_tag(unsigned short pid);
+
+/*
+ * Fill a block of memory with a long word value, using long word writes.
+ *
+ * Inputs:
+ * dest = the address of the first byte to fill (must be word aligned)
+ * value = the 32-bit value to write
+ * count = the number of bytes to fill (a multiple of 4)
+ */
+extern void mem_fill_long(void * dest, unsigned long value, unsigned long count);
+
 #endif
\ No newline at end of file
@@ -8,10 +8,28 @@
 
 #include "errors.h"
 #include "log.h"
+#include "memory.h"
 #include "dev/fsys.h"
+#include "dev/pipe.h"
+
+#define PROC_STACK_SIZE 0x4000                      /* Size of the user mode stack */
 
-static const long k_default_stack = 0x00010000;     /* For now... we're just going to put the user stack under 0x00010000 */
 static int g_proc_result;
+static unsigned short g_proc_tag = 0;               /* Memory tag of the running program's image and stack (0 if none) */
+
+/*
+ * Return the memory of the last program run (its image, its stack, and anything it loaded)
+ * and close the pipes it created
+ *
+ * Memory under other tags, such as files kept resident by LOAD, is left alone.
+ */
+static void proc_release() {
+    if (g_proc_tag != 0) {
+        pipe_release(g_proc_tag);
+        mem_free_tag(MEM_OWN_USER, g_proc_tag);
+        g_proc_tag = 0;
+    }
+}
 
 /*
  * Assembly routine: reset the supervisor stack pointer and restart the CLI
@@ -50,6 +68,7 @@ void proc_exec(long start, long stack, int argc, char * argv[]) {
  */
 void proc_exit(int result) {
     g_proc_result = result;
+    proc_release();
     restart_cli();
 }
 
@@ -60,6 +79,13 @@ int proc_get_result() {
     return g_proc_result;
 }
 
+/*
+ * Return the memory tag of the running program (0 if no program is running)
+ */
+unsigned short proc_get_tag() {
+    return g_proc_tag;
+}
+
 /*
  * Find an executable binary matching the path, load it, and execute it
  *
@@ -77,19 +103,42 @@ short proc_run(const char * path, int argc, char * argv[]) {
 
     /* TODO: allow for commands without extensions */
     /* TODO: allow for a search PATH */
-    /* TODO: allocate stack more dynamically */
 
     long start = 0;
-    short result = fsys_load(path, 0, &start);
+    long stack = 0;
+    unsigned short tag;
+    short result;
+
+    /* We're single tasking: anything the last program had is free now */
+    proc_release();
+
+    /* The program's image and stack all go under one tag, so they can be returned together */
+    tag = mem_new_tag(MEM_OWN_USER);
+    if (tag == 0) {
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    result = fsys_load_as(path, 0, &start, tag);
     if (result == 0) {
         if (start != 0) {
-            proc_exec(start, k_default_stack, argc, argv);
+            /* Take the stack from the top of RAM, well away from images loaded at fixed addresses */
+            stack = mem_alloc_top(MEM_OWN_USER, tag, PROC_STACK_SIZE);
+            if (stack == 0) {
+                log(LOG_ERROR, "Couldn't allocate stack");
+                mem_free_tag(MEM_OWN_USER, tag);
+                return ERR_OUT_OF_MEMORY;
+            }
+
+            g_proc_tag = tag;
+            proc_exec(start, stack + PROC_STACK_SIZE, argc, argv);
         } else {
             log_num(LOG_ERROR, "Couldn't execute file: ", result);
+            mem_free_tag(MEM_OWN_USER, tag);
             return ERR_NOT_EXECUTABLE;
         }
     } else {
         log_num(LOG_ERROR, "Couldn't load file: ", result);
+        mem_free_tag(MEM_OWN_USER, tag);
         return result;
     }
 }
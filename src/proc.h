@@ -36,6 +36,14 @@ extern void proc_exit(int result);
  */
 extern int proc_get_result();
 
+/*
+ * Return the memory tag of the running program (0 if no program is running)
+ *
+ * The program's image, its stack, and anything it loads are all owned by
+ * MEM_OWN_USER under this tag, and are returned when it exits.
+ */
+extern unsigned short proc_get_tag();
+
 /*
  * Find an executable binary matching the path, load it, and execute it
  *
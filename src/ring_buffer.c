@@ -1,55 +1,326 @@
 /**
  * Definitions for the ring buffers
+ *
+ * The head and tail of each ring are free-running counts: the number of elements waiting
+ * is always (head - tail) in 16-bit arithmetic, and the slot for a count is (count & mask).
+ * Since the storage is a power of two long, this gives the right answer across the wrap
+ * of the counters, and lets every element of the storage be used.
  */
 
+#include <string.h>
+#include "errors.h"
 #include "ring_buffer.h"
 
+/*
+ * Round a ring size down to a power of two no larger than RB_SIZE_MAX
+ *
+ * Returns:
+ * the rounded size, 0 if size is less than RB_SIZE_MIN
+ */
+static unsigned short rb_round_size(unsigned short size) {
+    unsigned short rounded = RB_SIZE_MAX;
+
+    if (size < RB_SIZE_MIN) {
+        return 0;
+    }
+
+    while (rounded > size) {
+        rounded >>= 1;
+    }
+
+    return rounded;
+}
+
+/*
+ * Copy elements into a ring's storage, starting at slot, wrapping at the end of the storage
+ *
+ * Inputs:
+ * r = the ring buffer
+ * slot = the index of the first element to fill
+ * data = the elements to copy in
+ * count = the number of elements to copy
+ */
+static void rb_copy_in(p_ring r, unsigned short slot, const void * data, unsigned short count) {
+    unsigned long element = r->element;
+    unsigned short run = r->size - slot;
+
+    if (run > count) {
+        run = count;
+    }
+
+    memcpy((uint8_t *)r->buffer + slot * element, data, run * element);
+    if (count > run) {
+        memcpy(r->buffer, (const uint8_t *)data + run * element, (count - run) * element);
+    }
+}
+
+/*
+ * Copy elements out of a ring's storage, starting at slot, wrapping at the end of the storage
+ *
+ * Inputs:
+ * r = the ring buffer
+ * slot = the index of the first element to copy
+ * data = the place to copy the elements to
+ * count = the number of elements to copy
+ */
+static void rb_copy_out(p_ring r, unsigned short slot, void * data, unsigned short count) {
+    unsigned long element = r->element;
+    unsigned short run = r->size - slot;
+
+    if (run > count) {
+        run = count;
+    }
+
+    memcpy(data, (const uint8_t *)r->buffer + slot * element, run * element);
+    if (count > run) {
+        memcpy((uint8_t *)data + run * element, r->buffer, (count - run) * element);
+    }
+}
+
 //
-// Initialize the word ring buffer
+// Initialize a ring buffer over the given storage
 //
-void rb_word_init(p_word_ring r) {
+// Inputs:
+// r = the ring buffer
+// storage = the storage for the elements
+// element = the size of an element in bytes
+// size = the number of elements in storage (rounded down to a power of two)
+//
+// Returns:
+// 0 on success, DEV_BOUNDS_ERR if size is less than RB_SIZE_MIN
+//
+short rb_init(p_ring r, void * storage, unsigned short element, unsigned short size) {
+    r->buffer = storage;
+    r->element = element;
+    r->size = rb_round_size(size);
+    r->mask = r->size ? r->size - 1 : 0;
     r->head = 0;
     r->tail = 0;
+
+    return r->size ? 0 : DEV_BOUNDS_ERR;
+}
+
+//
+// Return the number of elements waiting in the ring buffer
+//
+unsigned short rb_count(p_ring r) {
+    return (unsigned short)(r->head - r->tail);
+}
+
+//
+// Return the number of elements that can still be put into the ring buffer
+//
+unsigned short rb_space(p_ring r) {
+    return r->size - (unsigned short)(r->head - r->tail);
 }
 
 //
 // Return true if the ring buffer is full
 //
-unsigned short rb_word_full(p_word_ring r) {
-    return(r->head + 1 == r->tail);
+unsigned short rb_full(p_ring r) {
+    return (unsigned short)(r->head - r->tail) == r->size;
 }
 
 //
 // Return true if the ring buffer is empty
 //
-unsigned short rb_word_empty(p_word_ring r) {
-    return(r->head == r->tail);
+unsigned short rb_empty(p_ring r) {
+    return r->head == r->tail;
+}
+
+//
+// Copy as many of the elements as will fit into the ring buffer
+//
+// Returns:
+// the number of elements stored
+//
+unsigned short rb_write(p_ring r, const void * data, unsigned short count) {
+    unsigned short head = r->head;
+    unsigned short space = r->size - (unsigned short)(head - r->tail);
+
+    if (count > space) {
+        count = space;
+    }
+
+    if (count > 0) {
+        rb_copy_in(r, head & r->mask, data, count);
+        r->head = head + count;
+    }
+
+    return count;
+}
+
+//
+// Take up to count elements out of the ring buffer
+//
+// Returns:
+// the number of elements copied into data
+//
+unsigned short rb_read(p_ring r, void * data, unsigned short count) {
+    count = rb_peek(r, data, count);
+    r->tail += count;
+    return count;
 }
 
 //
-// Add a word to the ring buffer... data is lost if buffer is full
+// Copy up to count elements out of the ring buffer, leaving them there
 //
-void rb_word_put(p_word_ring r, unsigned short data) {
-    if (!rb_word_full(r)) {
-        r->buffer[r->head++] = data;
-        if (r->head >= MAX_BUFFER_SIZE) {
-            r->head = 0;
-        }
+// Returns:
+// the number of elements copied into data
+//
+unsigned short rb_peek(p_ring r, void * data, unsigned short count) {
+    unsigned short tail = r->tail;
+    unsigned short waiting = (unsigned short)(r->head - tail);
+
+    if (count > waiting) {
+        count = waiting;
+    }
+
+    if (count > 0) {
+        rb_copy_out(r, tail & r->mask, data, count);
     }
+
+    return count;
+}
+
+//
+// Return the element most recently put into the ring buffer, if it has not been taken yet
+//
+// Returns:
+// pointer to the element, 0 if the ring buffer is empty
+//
+void * rb_newest(p_ring r) {
+    unsigned short head = r->head;
+
+    if (head == r->tail) {
+        return 0;
+    }
+
+    return (uint8_t *)r->buffer + ((head - 1) & r->mask) * (unsigned long)r->element;
+}
+
+/*
+ * Byte rings
+ */
+
+short rb_byte_init(p_byte_ring r, uint8_t * storage, unsigned short size) {
+    return rb_init(r, storage, sizeof(uint8_t), size);
+}
+
+//
+// Add a byte to the ring buffer
+//
+// Returns:
+// 1 if the byte was stored, 0 if the buffer was full
+//
+short rb_byte_put(p_byte_ring r, uint8_t data) {
+    unsigned short head = r->head;
+
+    if ((unsigned short)(head - r->tail) == r->size) {
+        return 0;
+    }
+
+    ((uint8_t *)r->buffer)[head & r->mask] = data;
+    r->head = head + 1;
+    return 1;
+}
+
+//
+// Get a byte from the ring buffer... returns 0 if the buffer is empty
+//
+uint8_t rb_byte_get(p_byte_ring r) {
+    unsigned short tail = r->tail;
+    uint8_t data;
+
+    if (tail == r->head) {
+        return 0;
+    }
+
+    data = ((uint8_t *)r->buffer)[tail & r->mask];
+    r->tail = tail + 1;
+    return data;
+}
+
+/*
+ * Word rings
+ */
+
+short rb_word_init(p_word_ring r, unsigned short * storage, unsigned short size) {
+    return rb_init(r, storage, sizeof(unsigned short), size);
+}
+
+//
+// Add a word to the ring buffer
+//
+// Returns:
+// 1 if the word was stored, 0 if the buffer was full
+//
+short rb_word_put(p_word_ring r, unsigned short data) {
+    unsigned short head = r->head;
+
+    if ((unsigned short)(head - r->tail) == r->size) {
+        return 0;
+    }
+
+    ((unsigned short *)r->buffer)[head & r->mask] = data;
+    r->head = head + 1;
+    return 1;
 }
 
 //
 // Get a word from the ring buffer... returns 0 if the buffer is empty
 //
 unsigned short rb_word_get(p_word_ring r) {
-    if (!rb_word_empty(r)) {
-        unsigned short data = r->buffer[r->tail++];
-        if (r->tail >= MAX_BUFFER_SIZE) {
-            r->tail = 0;
-        }
+    unsigned short tail = r->tail;
+    unsigned short data;
 
-        return data;
-    } else {
+    if (tail == r->head) {
         return 0;
     }
+
+    data = ((unsigned short *)r->buffer)[tail & r->mask];
+    r->tail = tail + 1;
+    return data;
+}
+
+/*
+ * Long word rings
+ */
+
+short rb_long_init(p_long_ring r, unsigned long * storage, unsigned short size) {
+    return rb_init(r, storage, sizeof(unsigned long), size);
+}
+
+//
+// Add a long word to the ring buffer
+//
+// Returns:
+// 1 if the long word was stored, 0 if the buffer was full
+//
+short rb_long_put(p_long_ring r, unsigned long data) {
+    unsigned short head = r->head;
+
+    if ((unsigned short)(head - r->tail) == r->size) {
+        return 0;
+    }
+
+    ((unsigned long *)r->buffer)[head & r->mask] = data;
+    r->head = head + 1;
+    return 1;
+}
+
+//
+// Get a long word from the ring buffer... returns 0 if the buffer is empty
+//
+unsigned long rb_long_get(p_long_ring r) {
+    unsigned short tail = r->tail;
+    unsigned long data;
+
+    if (tail == r->head) {
+        return 0;
+    }
+
+    data = ((unsigned long *)r->buffer)[tail & r->mask];
+    r->tail = tail + 1;
+    return data;
 }
@@ -1,5 +1,15 @@
 /**
  * Definitions of ring buffers
+ *
+ * These are single-producer/single-consumer rings over storage supplied by their owner.
+ * A ring holds a power of two number of fixed size elements (other sizes are rounded
+ * down), and every element of the storage is used. The head and tail run freely and are
+ * masked to find the slot, so one side may be an interrupt handler: the producer only
+ * moves the head (after the data is in place) and the consumer only moves the tail, and
+ * neither needs interrupts turned off.
+ *
+ * The core works on elements of any size. The byte, word, and long word rings are thin
+ * typed wrappers over the same structure.
  */
 
 #ifndef __RING_BUFFER_H
@@ -7,38 +17,170 @@
 
 #include "types.h"
 
-#define MAX_BUFFER_SIZE 128
+#define RB_SIZE_MIN     2           /* Smallest number of elements in a ring */
+#define RB_SIZE_MAX     0x8000      /* Largest number of elements in a ring */
 
-// A ring buffer of unsigned words
-typedef struct s_word_ring {
-    unsigned short buffer[MAX_BUFFER_SIZE];
-    unsigned short head;
-    unsigned short tail;
-} t_word_ring, *p_word_ring;
+// A ring buffer of fixed size elements
+typedef struct s_ring {
+    void * buffer;                      // The storage for the elements
+    unsigned short element;             // The size of an element in bytes
+    unsigned short size;                // The number of elements of storage (a power of two, 0 if unusable)
+    unsigned short mask;                // size - 1
+    volatile unsigned short head;       // Count of elements ever put (only the producer changes it)
+    volatile unsigned short tail;       // Count of elements ever taken (only the consumer changes it)
+} t_ring, *p_ring;
 
+// Rings of bytes, 16-bit words, and 32-bit long words
+typedef t_ring t_byte_ring, *p_byte_ring;
+typedef t_ring t_word_ring, *p_word_ring;
+typedef t_ring t_long_ring, *p_long_ring;
+
+//
+// Initialize a ring buffer over the given storage
+//
+// Inputs:
+// r = the ring buffer
+// storage = the storage for the elements
+// element = the size of an element in bytes
+// size = the number of elements in storage (rounded down to a power of two)
+//
+// Returns:
+// 0 on success, DEV_BOUNDS_ERR if size is less than RB_SIZE_MIN (the ring is then
+// always empty and always full)
+//
+extern short rb_init(p_ring r, void * storage, unsigned short element, unsigned short size);
+
+//
+// Return the number of elements waiting in the ring buffer
 //
-// Initialize the byte ring buffer
+extern unsigned short rb_count(p_ring r);
+
+//
+// Return the number of elements that can still be put into the ring buffer
 //
-extern void rb_word_init(p_word_ring r);
+extern unsigned short rb_space(p_ring r);
 
 //
 // Return true if the ring buffer is full
 //
-extern unsigned short rb_word_full(p_word_ring r);
+extern unsigned short rb_full(p_ring r);
 
 //
 // Return true if the ring buffer is empty
 //
-extern unsigned short rb_word_empty(p_word_ring r);
+extern unsigned short rb_empty(p_ring r);
 
 //
-// Add a byte to the ring buffer... data is lost if buffer is full
+// Copy as many of the elements as will fit into the ring buffer
+//
+// Returns:
+// the number of elements stored
+//
+extern unsigned short rb_write(p_ring r, const void * data, unsigned short count);
+
+//
+// Take up to count elements out of the ring buffer
+//
+// Returns:
+// the number of elements copied into data
 //
-extern void rb_word_put(p_word_ring r, unsigned short data);
+extern unsigned short rb_read(p_ring r, void * data, unsigned short count);
+
+//
+// Copy up to count elements out of the ring buffer, leaving them there
+//
+// Returns:
+// the number of elements copied into data
+//
+extern unsigned short rb_peek(p_ring r, void * data, unsigned short count);
+
+//
+// Return the element most recently put into the ring buffer, if it has not been taken yet
+//
+// This is for the producer only, to fold new data into an element still waiting.
+// The consumer must not be taking that element at the same time.
+//
+// Returns:
+// pointer to the element, 0 if the ring buffer is empty
+//
+extern void * rb_newest(p_ring r);
+
+//
+// Byte rings
+//
+
+extern short rb_byte_init(p_byte_ring r, uint8_t * storage, unsigned short size);
+#define rb_byte_count(r)            rb_count(r)
+#define rb_byte_space(r)            rb_space(r)
+#define rb_byte_full(r)             rb_full(r)
+#define rb_byte_empty(r)            rb_empty(r)
+#define rb_byte_write(r, d, n)      rb_write((r), (d), (n))
+#define rb_byte_read(r, d, n)       rb_read((r), (d), (n))
+#define rb_byte_peek(r, d, n)       rb_peek((r), (d), (n))
+
+//
+// Add a byte to the ring buffer
+//
+// Returns:
+// 1 if the byte was stored, 0 if the buffer was full
+//
+extern short rb_byte_put(p_byte_ring r, uint8_t data);
 
 //
 // Get a byte from the ring buffer... returns 0 if the buffer is empty
 //
+extern uint8_t rb_byte_get(p_byte_ring r);
+
+//
+// Word rings
+//
+
+extern short rb_word_init(p_word_ring r, unsigned short * storage, unsigned short size);
+#define rb_word_count(r)            rb_count(r)
+#define rb_word_space(r)            rb_space(r)
+#define rb_word_full(r)             rb_full(r)
+#define rb_word_empty(r)            rb_empty(r)
+#define rb_word_write(r, d, n)      rb_write((r), (d), (n))
+#define rb_word_read(r, d, n)       rb_read((r), (d), (n))
+#define rb_word_peek(r, d, n)       rb_peek((r), (d), (n))
+
+//
+// Add a word to the ring buffer
+//
+// Returns:
+// 1 if the word was stored, 0 if the buffer was full
+//
+extern short rb_word_put(p_word_ring r, unsigned short data);
+
+//
+// Get a word from the ring buffer... returns 0 if the buffer is empty
+//
 extern unsigned short rb_word_get(p_word_ring r);
 
+//
+// Long word rings
+//
+
+extern short rb_long_init(p_long_ring r, unsigned long * storage, unsigned short size);
+#define rb_long_count(r)            rb_count(r)
+#define rb_long_space(r)            rb_space(r)
+#define rb_long_full(r)             rb_full(r)
+#define rb_long_empty(r)            rb_empty(r)
+#define rb_long_write(r, d, n)      rb_write((r), (d), (n))
+#define rb_long_read(r, d, n)       rb_read((r), (d), (n))
+#define rb_long_peek(r, d, n)       rb_peek((r), (d), (n))
+
+//
+// Add a long word to the ring buffer
+//
+// Returns:
+// 1 if the long word was stored, 0 if the buffer was full
+//
+extern short rb_long_put(p_long_ring r, unsigned long data);
+
+//
+// Get a long word from the ring buffer... returns 0 if the buffer is empty
+//
+extern unsigned long rb_long_get(p_long_ring r);
+
 #endif
@@ -179,6 +179,36 @@ short sys_chan_write(short channel, const unsigned char * buffer, short size) {
     return syscall(KFN_CHAN_WRITE, channel, buffer, size);
 }
 
+/*
+ * Read bytes from the channel into several buffers
+ *
+ * Inputs:
+ *  channel = the number of the channel
+ *  iov = array of (buffer, size) pairs to fill, in order
+ *  count = the number of entries in iov
+ *
+ * Returns:
+ *  total number of bytes read, any negative number is an error code
+ */
+short sys_chan_readv(short channel, p_chan_iovec iov, short count) {
+    return syscall(KFN_CHAN_READV, channel, iov, count);
+}
+
+/*
+ * Write bytes to the channel from several buffers in one system call
+ *
+ * Inputs:
+ *  channel = the number of the channel
+ *  iov = array of (buffer, size) pairs to write, in order
+ *  count = the number of entries in iov
+ *
+ * Returns:
+ *  total number of bytes written, any negative number is an error code
+ */
+short sys_chan_writev(short channel, p_chan_iovec iov, short count) {
+    return syscall(KFN_CHAN_WRITEV, channel, iov, count);
+}
+
 /*
  * Return the status of the channel device
  *
@@ -258,7 +288,7 @@ short sys_chan_open(short dev, const uint8_t * path, short mode) {
  * chan = the number of the channel to close
  *
  * Returns:
- * nothing useful
+ * 0 on success, otherwise the first error from flushing the channel's buffer or closing the device
  */
 short sys_chan_close(short chan) {
     return syscall(KFN_CHAN_CLOSE, chan);
@@ -318,6 +348,38 @@ short sys_bdev_write(short dev, long lba, const unsigned char * buffer, short si
     return syscall(KFN_BDEV_PUTBLOCK, dev, lba, buffer, size);
 }
 
+//
+// Read a run of consecutive blocks from the device
+//
+// Inputs:
+//  dev = the number of the device
+//  lba = the logical block address of the first block to read (unsigned, so up to 2TB of blocks)
+//  buffer = the buffer into which to copy the block data (must hold count * 512 bytes)
+//  count = the number of blocks to read (at most 128)
+//
+// Returns:
+//  number of blocks read, any negative number is an error code
+//
+short sys_bdev_read_blocks(short dev, unsigned long lba, unsigned char * buffer, short count) {
+    return syscall(KFN_BDEV_GETBLOCKS, dev, lba, buffer, count);
+}
+
+//
+// Write a run of consecutive blocks to the device
+//
+// Inputs:
+//  dev = the number of the device
+//  lba = the logical block address of the first block to write (unsigned, so up to 2TB of blocks)
+//  buffer = the buffer containing the data to write (count * 512 bytes)
+//  count = the number of blocks to write (at most 128)
+//
+// Returns:
+//  number of blocks written, any negative number is an error code
+//
+short sys_bdev_write_blocks(short dev, unsigned long lba, const unsigned char * buffer, short count) {
+    return syscall(KFN_BDEV_PUTBLOCKS, dev, lba, buffer, count);
+}
+
 //
 // Return the status of the block device
 //
@@ -431,6 +493,23 @@ short sys_fsys_readdir(short dir, p_file_info file) {
     return (short)syscall(KFN_READDIR, dir, file);
 }
 
+/**
+ * Read a batch of entries from an open directory as compact records
+ *
+ * Inputs:
+ * dir = the handle of the open directory
+ * buffer = the buffer to fill with the packed records
+ * size = the size of the buffer in bytes (at least FSYS_RECORD_MAX)
+ * max_entries = the maximum number of records to return
+ * fields = which fields to include (FSYS_RECORD_NAME, FSYS_RECORD_ATTR, or both)
+ *
+ * Returns:
+ * the number of records returned (0 at the end of the directory), negative number on failure
+ */
+short sys_fsys_readdir_batch(short dir, unsigned char * buffer, short size, short max_entries, short fields) {
+    return (short)syscall(KFN_READDIR_BATCH, dir, buffer, size, max_entries, fields);
+}
+
 /**
  * Open a directory given the path and search for the first file matching the pattern.
  *
@@ -482,6 +561,68 @@ short sys_fsys_set_label(short drive, const char * label) {
     return (short)syscall(KFN_SET_LABEL, drive, label);
 }
 
+/*
+ * Get the free space on the drive holding the path
+ *
+ * The first call for a FAT volume scans the FAT once to build a map of the
+ * free clusters. After that, the answer comes from memory.
+ *
+ * Inputs:
+ * path = path to the drive
+ * free_kb = pointer to the long to fill with the free space in KB
+ * total_kb = pointer to the long to fill with the size of the volume in KB (may be 0)
+ *
+ * Returns:
+ * 0 on success, negative number on failure
+ */
+short sys_fsys_get_free(const char * path, unsigned long * free_kb, unsigned long * total_kb) {
+    return (short)syscall(KFN_GET_FREE, path, free_kb, total_kb);
+}
+
+/***
+ *** Additional channel system calls
+ ***/
+
+/*
+ * Create a pipe
+ *
+ * Bytes written to the writer channel can be read from the reader channel.
+ * Once the writer channel is closed and the pipe has drained, the reader
+ * channel reports end of file. Close both channels with sys_chan_close.
+ *
+ * Inputs:
+ * reader = pointer to the short to set to the channel number of the reader end
+ * writer = pointer to the short to set to the channel number of the writer end
+ * flags = PIPE_BLOCK or PIPE_NONBLOCK
+ *
+ * Returns:
+ * 0 on success, any negative number is an error code
+ */
+short sys_chan_pipe(short * reader, short * writer, short flags) {
+    return syscall(KFN_CHAN_PIPE, reader, writer, flags);
+}
+
+/*
+ * Wait until at least one of a set of channels is ready
+ *
+ * A channel is ready if its status has any of the requested event bits, or if
+ * it is at end of file or in error. While waiting, the CPU sleeps between
+ * interrupts instead of spinning.
+ *
+ * Inputs:
+ *  channel_set = array of channel numbers to watch (entries of -1 are ignored).
+ *                On return, the channels that are not ready are replaced by -1.
+ *  count = the number of entries in channel_set
+ *  events = the status bits to wait for (CDEV_STAT_READABLE, CDEV_STAT_WRITABLE)
+ *  timeout_jiffies = how long to wait: 0 to check once, negative to wait forever
+ *
+ * Returns:
+ *  the number of ready channels (0 on timeout), any negative number is an error code
+ */
+short sys_chan_poll(short * channel_set, short count, short events, long timeout_jiffies) {
+    return syscall(KFN_CHAN_POLL, channel_set, count, events, timeout_jiffies);
+}
+
 /**
  * Create a directory
  *
@@ -631,6 +772,59 @@ unsigned short sys_kbd_scancode() {
     return syscall(KFN_KBD_SCANCODE);
 }
 
+/*
+ * Get the next key event from the keyboard
+ *
+ * Inputs:
+ * event = the record to fill in with the event
+ *
+ * Returns:
+ * 1 if an event was returned, 0 if there was none waiting
+ */
+short sys_kbd_event(p_key_event event) {
+    return syscall(KFN_KBD_EVENT, event);
+}
+
+/*
+ * Get the record of which keys are held down right now
+ */
+const t_key_state * sys_kbd_keystate() {
+    return (const t_key_state *)syscall(KFN_KBD_KEYSTATE);
+}
+
+/*
+ * Get the next event from the mouse
+ *
+ * NOTE: the MOUSE channel must be open, or no events are queued (see syscalls.h).
+ *
+ * Inputs:
+ * event = the record to fill in with the event
+ *
+ * Returns:
+ * 1 if an event was returned, 0 if there was none waiting
+ */
+short sys_mouse_event(p_mouse_event event) {
+    return syscall(KFN_MOUSE_EVENT, event);
+}
+
+/*
+ * Get the record of the mouse pointer's position and buttons
+ */
+const t_mouse_state * sys_mouse_state() {
+    return (const t_mouse_state *)syscall(KFN_MOUSE_STATE);
+}
+
+/*
+ * Move the mouse pointer (clamped to the screen)
+ *
+ * Inputs:
+ * x = the new column of the pointer, in pixels
+ * y = the new row of the pointer, in pixels
+ */
+void sys_mouse_set_position(short x, short y) {
+    syscall(KFN_MOUSE_SETXY, x, y);
+}
+
 /*
  * Return an error message given an error number
  */
@@ -0,0 +1,448 @@
+/*
+ * Binary transfer protocol over a serial channel
+ */
+
+#include <string.h>
+#include "log.h"
+#include "errors.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "proc.h"
+#include "timers.h"
+#include "xfer.h"
+#include "dev/channel.h"
+#include "dev/fsys.h"
+#include "fatfs/ff.h"
+
+#define XFER_CRC_POLY       0xEDB88320  /* Reflected IEEE polynomial for the CRC32 */
+
+/*
+ * Where the last transfer into memory stopped, so it can be resumed
+ */
+typedef struct s_xfer_resume {
+    uint8_t * address;          /* Where the image was going */
+    unsigned long total;        /* The size of the image */
+    unsigned long received;     /* How many bytes of it were received */
+    unsigned short tag;         /* The memory tag the image's pages are claimed under */
+} t_xfer_resume;
+
+static unsigned long xfer_crc_table[256];
+static short xfer_crc_ready = 0;
+static t_xfer_resume xfer_resume = { 0, 0, 0, 0 };
+static uint8_t xfer_frame[XFER_HEADER_SIZE + XFER_BLOCK_SIZE + 4];
+
+/*
+ * Fill in the CRC32 lookup table
+ */
+static void xfer_crc_init() {
+    unsigned long c;
+    short i, j;
+
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (j = 0; j < 8; j++) {
+            c = (c & 1) ? (XFER_CRC_POLY ^ (c >> 1)) : (c >> 1);
+        }
+        xfer_crc_table[i] = c;
+    }
+
+    xfer_crc_ready = 1;
+}
+
+/*
+ * Update a CRC32 with more bytes
+ *
+ * Inputs:
+ * crc = the CRC32 of the bytes so far (0 to start)
+ * data = the next bytes
+ * count = the number of bytes
+ *
+ * Returns:
+ * the CRC32 including the new bytes
+ */
+unsigned long xfer_crc32(unsigned long crc, const uint8_t * data, unsigned long count) {
+    if (!xfer_crc_ready) {
+        xfer_crc_init();
+    }
+
+    crc = crc ^ 0xFFFFFFFF;
+    while (count-- > 0) {
+        crc = xfer_crc_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+static void xfer_put_long(uint8_t * p, unsigned long n) {
+    p[0] = (n >> 24) & 0xFF;
+    p[1] = (n >> 16) & 0xFF;
+    p[2] = (n >> 8) & 0xFF;
+    p[3] = n & 0xFF;
+}
+
+static unsigned long xfer_get_long(const uint8_t * p) {
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+}
+
+/*
+ * Read exactly count bytes from a non-blocking channel
+ *
+ * Returns:
+ * 0 on success, DEV_TIMEOUT if the deadline passed first, any other negative number is an error code
+ */
+static short xfer_read_bytes(short channel, uint8_t * buffer, short count, long deadline) {
+    short n;
+
+    while (count > 0) {
+        n = chan_read(channel, buffer, count);
+        if (n > 0) {
+            buffer += n;
+            count -= n;
+
+        } else if ((n == 0) || (n == DEV_WOULD_BLOCK)) {
+            if (timers_jiffies() > deadline) {
+                return DEV_TIMEOUT;
+            }
+            int_wait();
+
+        } else {
+            return n;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Read the next frame from the host into xfer_frame
+ *
+ * Returns:
+ * 1 if a good frame was read, 0 if a damaged frame was skipped,
+ * DEV_TIMEOUT if nothing arrived in time, any other negative number is an error code
+ */
+static short xfer_read_frame(short channel) {
+    long deadline = timers_jiffies() + XFER_TIMEOUT;
+    unsigned short length;
+    short result;
+
+    /* Hunt for the start of a frame */
+    do {
+        result = xfer_read_bytes(channel, xfer_frame, 1, deadline);
+        if (result) {
+            return result;
+        }
+    } while (xfer_frame[0] != XFER_MAGIC);
+
+    result = xfer_read_bytes(channel, &xfer_frame[1], XFER_HEADER_SIZE - 1, deadline);
+    if (result) {
+        return result;
+    }
+
+    length = ((unsigned short)xfer_frame[2] << 8) | xfer_frame[3];
+    if (length > XFER_BLOCK_SIZE) {
+        return 0;
+    }
+
+    result = xfer_read_bytes(channel, &xfer_frame[XFER_HEADER_SIZE], length + 4, deadline);
+    if (result) {
+        return result;
+    }
+
+    if (xfer_crc32(0, &xfer_frame[1], XFER_HEADER_SIZE - 1 + length) != xfer_get_long(&xfer_frame[XFER_HEADER_SIZE + length])) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Send a frame to the host
+ *
+ * Inputs:
+ * channel = the number of the channel to the host
+ * type = the XFER_* type of the frame
+ * offset = the offset to send
+ * with_crc = if non-zero, crc is sent as the frame's data
+ * crc = the CRC32 to send
+ */
+static void xfer_send(short channel, uint8_t type, unsigned long offset, short with_crc, unsigned long crc) {
+    uint8_t frame[XFER_HEADER_SIZE + 8];
+    short length = with_crc ? 4 : 0;
+
+    frame[0] = XFER_MAGIC;
+    frame[1] = type;
+    frame[2] = 0;
+    frame[3] = length;
+    xfer_put_long(&frame[4], offset);
+    if (with_crc) {
+        xfer_put_long(&frame[XFER_HEADER_SIZE], crc);
+    }
+    xfer_put_long(&frame[XFER_HEADER_SIZE + length], xfer_crc32(0, &frame[1], XFER_HEADER_SIZE - 1 + length));
+
+    chan_write(channel, frame, XFER_HEADER_SIZE + length + 4);
+}
+
+/*
+ * Claim the pages an image will fill in memory
+ *
+ * The pages go under the running program's tag (so they are freed when it exits), or
+ * under a tag of their own when the command line is receiving the image. A transfer
+ * picking up where one to the same address stopped uses the tag it claimed before.
+ *
+ * Inputs:
+ * address = where the image is going
+ * total = the size of the image
+ *
+ * Returns:
+ * 0 on success, ERR_MEMORY_IN_USE if the range is not free RAM, any other negative number is an error code
+ */
+static short xfer_claim(uint8_t * address, unsigned long total) {
+    unsigned short tag;
+    short result;
+
+    if (total == 0) {
+        return 0;
+    }
+
+    if ((unsigned long)address + total < (unsigned long)address) {
+        /* Range wraps around the end of the address space */
+        return ERR_MEMORY_IN_USE;
+    }
+
+    tag = proc_get_tag();
+    if (tag == 0) {
+        if ((xfer_resume.tag != 0) && (xfer_resume.address == address)) {
+            tag = xfer_resume.tag;
+        } else {
+            tag = mem_new_tag(MEM_OWN_USER);
+            if (tag == 0) {
+                return ERR_OUT_OF_MEMORY;
+            }
+        }
+    }
+
+    result = mem_claim(MEM_OWN_USER, tag, (uint32_t)address, (uint32_t)address + total - 1);
+    if (result != 0) {
+        if ((tag != xfer_resume.tag) && (tag != proc_get_tag())) {
+            mem_free_tag(MEM_OWN_USER, tag);
+        }
+        if (xfer_resume.address != address) {
+            /* The tag we remember is for an image somewhere else */
+            xfer_resume.tag = 0;
+        }
+        return result;
+    }
+
+    /* Only remember tags of our own: the running program's tag goes away when it exits */
+    xfer_resume.tag = (tag == proc_get_tag()) ? 0 : tag;
+    return 0;
+}
+
+/*
+ * Open the destination file, keeping what is already in it if it could be the start of the image
+ *
+ * Inputs:
+ * path = the path to the file
+ * total = the size of the image
+ * held = set to the number of bytes already in the file
+ * crc = set to the CRC32 of those bytes
+ *
+ * Returns:
+ * the channel of the open file (positioned at its end), any negative number is an error code
+ */
+static short xfer_open_file(const char * path, unsigned long total, unsigned long * held, unsigned long * crc) {
+    short fd;
+    short n;
+
+    *held = 0;
+    *crc = 0;
+
+    fd = fsys_open(path, FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
+    if (fd < 0) {
+        return fd;
+    }
+
+    while ((n = chan_read(fd, &xfer_frame[XFER_HEADER_SIZE], XFER_BLOCK_SIZE)) > 0) {
+        *crc = xfer_crc32(*crc, &xfer_frame[XFER_HEADER_SIZE], n);
+        *held += n;
+    }
+
+    if ((n < 0) || (*held > total)) {
+        /* Cannot be the start of this image: start over */
+        fsys_close(fd);
+        *held = 0;
+        *crc = 0;
+        return fsys_open(path, FA_WRITE | FA_CREATE_ALWAYS);
+    }
+
+    return fd;
+}
+
+/*
+ * Receive an image from the host over a channel
+ *
+ * Inputs:
+ * channel = the number of the channel to the host (usually COM1)
+ * path = the path of the file to write, or 0 to write to memory
+ * address = where to put the image in memory (when path is 0)
+ * received = set to the number of bytes of the image held when the transfer ended
+ *
+ * Returns:
+ * 0 on success, ERR_MEMORY_IN_USE if the image would not fit in free RAM at address,
+ * any other negative number is an error code
+ */
+short xfer_receive(short channel, const char * path, uint8_t * address, unsigned long * received) {
+    unsigned long total = 0;
+    unsigned long expected = 0;
+    unsigned long nak_offset = 0xFFFFFFFF;
+    unsigned long offset;
+    unsigned long crc;
+    unsigned short length;
+    short started = 0;
+    short fd = -1;
+    short result = 0;
+    short done = 0;
+    short n;
+
+    chan_ioctrl(channel, CHAN_IOCTRL_NONBLOCK_ON, 0, 0);
+
+    while (!done) {
+        n = xfer_read_frame(channel);
+        if (n < 0) {
+            result = n;
+            break;
+
+        } else if (n == 0) {
+            /* Damaged frame: ask for everything from the first byte we are missing (once) */
+            if (started && (nak_offset != expected)) {
+                xfer_send(channel, XFER_NAK, expected, 0, 0);
+                nak_offset = expected;
+            }
+            continue;
+        }
+
+        length = ((unsigned short)xfer_frame[2] << 8) | xfer_frame[3];
+        offset = xfer_get_long(&xfer_frame[4]);
+
+        switch (xfer_frame[1]) {
+            case XFER_HELLO:
+                total = offset;
+                if (fd >= 0) {
+                    fsys_close(fd);
+                    fd = -1;
+                }
+
+                if (path) {
+                    fd = xfer_open_file(path, total, &expected, &crc);
+                    if (fd < 0) {
+                        result = fd;
+                        done = 1;
+                        break;
+                    }
+
+                } else {
+                    result = xfer_claim(address, total);
+                    if (result) {
+                        xfer_send(channel, XFER_ABORT, 0, 0, 0);
+                        done = 1;
+                        break;
+                    }
+
+                    expected = 0;
+                    if ((xfer_resume.address == address) && (xfer_resume.total == total)) {
+                        expected = xfer_resume.received;
+                    }
+                    crc = xfer_crc32(0, address, expected);
+                }
+
+                started = 1;
+                nak_offset = 0xFFFFFFFF;
+                xfer_send(channel, XFER_ACK, expected, 1, crc);
+                break;
+
+            case XFER_RESTART:
+                if (!started) {
+                    break;
+                }
+
+                if (fd >= 0) {
+                    fsys_close(fd);
+                    fd = fsys_open(path, FA_WRITE | FA_CREATE_ALWAYS);
+                    if (fd < 0) {
+                        result = fd;
+                        done = 1;
+                        break;
+                    }
+                }
+
+                expected = 0;
+                nak_offset = 0xFFFFFFFF;
+                xfer_send(channel, XFER_ACK, expected, 1, 0);
+                break;
+
+            case XFER_DATA:
+                if (!started) {
+                    break;
+                }
+
+                if ((offset == expected) && (offset + length <= total)) {
+                    if (fd >= 0) {
+                        n = chan_write(fd, &xfer_frame[XFER_HEADER_SIZE], length);
+                        if (n != length) {
+                            result = (n < 0) ? n : DEV_CANNOT_WRITE;
+                            xfer_send(channel, XFER_ABORT, expected, 0, 0);
+                            done = 1;
+                            break;
+                        }
+                    } else {
+                        memcpy(address + offset, &xfer_frame[XFER_HEADER_SIZE], length);
+                    }
+
+                    expected += length;
+                    xfer_send(channel, XFER_ACK, expected, 0, 0);
+
+                } else if (offset < expected) {
+                    /* A block we already have: the host may have missed our acknowledgement */
+                    xfer_send(channel, XFER_ACK, expected, 0, 0);
+
+                } else if (nak_offset != expected) {
+                    /* An earlier block went missing */
+                    xfer_send(channel, XFER_NAK, expected, 0, 0);
+                    nak_offset = expected;
+                }
+                break;
+
+            case XFER_DONE:
+                if (started && (expected == total)) {
+                    xfer_send(channel, XFER_ACK, expected, 0, 0);
+                    done = 1;
+                } else {
+                    xfer_send(channel, XFER_NAK, expected, 0, 0);
+                }
+                break;
+
+            case XFER_ABORT:
+                result = ERR_GENERAL;
+                done = 1;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    chan_ioctrl(channel, CHAN_IOCTRL_NONBLOCK_OFF, 0, 0);
+
+    if (fd >= 0) {
+        fsys_close(fd);
+    }
+
+    if (!path) {
+        /* Remember how far we got, in case the host wants to pick up from there */
+        xfer_resume.address = address;
+        xfer_resume.total = total;
+        xfer_resume.received = (result == 0) ? 0 : expected;
+    }
+
+    *received = expected;
+    return result;
+}
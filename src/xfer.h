@@ -0,0 +1,77 @@
+/*
+ * Binary transfer protocol over a serial channel
+ *
+ * A host (see C256Mgr/c256mgr.py --xfer) pushes an image to the target in blocks, with a
+ * sliding window of blocks in flight and a CRC32 on every frame. The target acknowledges
+ * the next byte it expects, and asks for everything from that byte again when a frame is
+ * lost or damaged. An interrupted transfer can be picked up where it stopped.
+ *
+ * Every frame has the same layout (all numbers are big-endian):
+ *
+ *      magic (XFER_MAGIC), type, length (16 bits), offset (32 bits), data (length bytes), CRC32 (32 bits)
+ *
+ * The CRC32 is the usual IEEE one (as computed by zlib) and covers the type through the end of the data.
+ */
+
+#ifndef __XFER_H
+#define __XFER_H
+
+#include "types.h"
+
+#define XFER_MAGIC          0xA5    /* First byte of every frame */
+#define XFER_HEADER_SIZE    8       /* Number of bytes before the data in a frame */
+#define XFER_BLOCK_SIZE     1024    /* Most data bytes in one frame */
+#define XFER_WINDOW         8       /* Most blocks the host sends ahead of the last acknowledgement */
+#define XFER_TIMEOUT        600     /* Jiffies the target waits for a frame before giving up */
+
+/*
+ * Frame types sent by the host
+ */
+
+#define XFER_HELLO          'H'     /* Start a transfer: offset = total size of the image */
+#define XFER_RESTART        'R'     /* Throw away anything held and start from offset 0 */
+#define XFER_DATA           'D'     /* A block of the image: offset = position of the block in the image */
+#define XFER_DONE           'E'     /* Everything has been sent: offset = total size of the image */
+#define XFER_ABORT          'A'     /* Give up on the transfer (the target sends this too, if it cannot store a block) */
+
+/*
+ * Frame types sent by the target
+ */
+
+#define XFER_ACK            'K'     /* offset = next byte expected (the reply to HELLO carries the CRC32 of the bytes before it) */
+#define XFER_NAK            'N'     /* Send everything again starting at offset */
+
+/*
+ * Update a CRC32 with more bytes
+ *
+ * Inputs:
+ * crc = the CRC32 of the bytes so far (0 to start)
+ * data = the next bytes
+ * count = the number of bytes
+ *
+ * Returns:
+ * the CRC32 including the new bytes
+ */
+extern unsigned long xfer_crc32(unsigned long crc, const uint8_t * data, unsigned long count);
+
+/*
+ * Receive an image from the host over a channel
+ *
+ * The image goes either to a file or straight into memory. If the previous transfer to the
+ * same file (or the same address, with the same size) was cut short, the host is offered the
+ * bytes already received and only has to send the rest. The pages an image in memory
+ * fills are claimed before anything is written to them.
+ *
+ * Inputs:
+ * channel = the number of the channel to the host (usually COM1)
+ * path = the path of the file to write, or 0 to write to memory
+ * address = where to put the image in memory (when path is 0)
+ * received = set to the number of bytes of the image held when the transfer ended
+ *
+ * Returns:
+ * 0 on success, ERR_MEMORY_IN_USE if the image would not fit in free RAM at address,
+ * any other negative number is an error code
+ */
+extern short xfer_receive(short channel, const char * path, uint8_t * address, unsigned long * received);
+
+#endif
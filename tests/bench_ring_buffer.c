@@ -0,0 +1,69 @@
+/*
+ * Throughput benchmark for the ring buffers
+ *
+ * Moves data through a ring the way the drivers do: one element at a time (as an
+ * interrupt handler would) and in blocks (as a channel read or write would).
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "ring_buffer.h"
+
+#define BENCH_BYTES     (64UL * 1024 * 1024)    /* Bytes moved in each run */
+#define BENCH_RING      2048                    /* Size of the ring (like the UART's) */
+
+static uint8_t storage[BENCH_RING];
+static uint8_t block[BENCH_RING];
+
+static double seconds(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void report(const char * name, double elapsed) {
+    printf("%-28s %8.1f MB/s\n", name, BENCH_BYTES / elapsed / (1024.0 * 1024.0));
+}
+
+int main(int argc, char * argv[]) {
+    t_byte_ring r;
+    unsigned long moved, sum = 0;
+    unsigned short size;
+    clock_t start;
+
+    rb_byte_init(&r, storage, BENCH_RING);
+
+    /* One byte at a time each way */
+    start = clock();
+    for (moved = 0; moved < BENCH_BYTES; moved++) {
+        rb_byte_put(&r, (uint8_t)moved);
+        sum += rb_byte_get(&r);
+    }
+    report("put/get, 1 byte", seconds(start));
+
+    /* Bytes put singly, taken in blocks */
+    start = clock();
+    for (moved = 0; moved < BENCH_BYTES; ) {
+        while (rb_byte_put(&r, (uint8_t)moved)) {
+            moved++;
+        }
+        rb_byte_read(&r, block, BENCH_RING);
+        sum += block[0];
+    }
+    report("put singly, read in blocks", seconds(start));
+
+    /* Blocks of various sizes each way */
+    for (size = 16; size <= BENCH_RING; size <<= 2) {
+        char name[40];
+
+        start = clock();
+        for (moved = 0; moved < BENCH_BYTES; moved += size) {
+            rb_byte_write(&r, block, size);
+            rb_byte_read(&r, block, size);
+        }
+        sum += block[0];
+        sprintf(name, "write/read, %u bytes", size);
+        report(name, seconds(start));
+    }
+
+    /* Keep the compiler from dropping the work */
+    return sum == 0xffffffff;
+}
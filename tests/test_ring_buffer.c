@@ -0,0 +1,176 @@
+/*
+ * Unit tests for the ring buffers
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "errors.h"
+#include "ring_buffer.h"
+
+static int failures = 0;
+
+#define CHECK(c) do { if (!(c)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); failures++; } } while (0)
+
+/*
+ * Sizes are rounded down to a power of two, and sizes too small for a ring are refused
+ */
+static void test_sizes() {
+    t_byte_ring r;
+    uint8_t storage[100];
+
+    CHECK(rb_byte_init(&r, storage, 100) == 0);
+    CHECK(r.size == 64);
+    CHECK(r.mask == 63);
+
+    CHECK(rb_byte_init(&r, storage, 2) == 0);
+    CHECK(r.size == 2);
+
+    CHECK(rb_byte_init(&r, storage, 1) == DEV_BOUNDS_ERR);
+    CHECK(r.size == 0);
+    CHECK(rb_byte_put(&r, 1) == 0);
+    CHECK(rb_byte_empty(&r));
+    CHECK(rb_byte_full(&r));
+    CHECK(rb_byte_write(&r, storage, 10) == 0);
+
+    CHECK(rb_byte_init(&r, storage, 0) == DEV_BOUNDS_ERR);
+    CHECK(r.size == 0);
+    CHECK(r.mask == 0);
+    CHECK(rb_byte_get(&r) == 0);
+    CHECK(rb_byte_read(&r, storage, 10) == 0);
+}
+
+/*
+ * Every slot of the storage can be used
+ */
+static void test_full() {
+    t_word_ring r;
+    unsigned short storage[8];
+    unsigned short i;
+
+    rb_word_init(&r, storage, 8);
+    for (i = 0; i < 8; i++) {
+        CHECK(rb_word_put(&r, 1000 + i) == 1);
+    }
+    CHECK(rb_word_full(&r));
+    CHECK(rb_word_space(&r) == 0);
+    CHECK(rb_word_put(&r, 0) == 0);
+
+    for (i = 0; i < 8; i++) {
+        CHECK(rb_word_get(&r) == 1000 + i);
+    }
+    CHECK(rb_word_empty(&r));
+    CHECK(rb_word_get(&r) == 0);
+}
+
+/*
+ * The counts stay right when the head and tail wrap around 16 bits
+ */
+static void test_counter_wrap() {
+    t_long_ring r;
+    unsigned long storage[4];
+    unsigned long i;
+
+    rb_long_init(&r, storage, 4);
+    r.head = r.tail = 0xfffe;
+    for (i = 0; i < 4; i++) {
+        CHECK(rb_long_put(&r, 0x12345678 + i) == 1);
+    }
+    CHECK(rb_long_count(&r) == 4);
+    CHECK(rb_long_full(&r));
+    for (i = 0; i < 4; i++) {
+        CHECK(rb_long_get(&r) == 0x12345678 + i);
+    }
+    CHECK(rb_long_empty(&r));
+}
+
+/*
+ * Block transfers of structured elements wrap at the end of the storage
+ */
+static void test_elements() {
+    typedef struct { unsigned char a, b, c; } t_three;
+    t_ring r;
+    t_three storage[8];
+    t_three in[5], out[8];
+    t_three * newest;
+    int i;
+
+    CHECK(rb_init(&r, storage, sizeof(t_three), 8) == 0);
+    CHECK(rb_newest(&r) == 0);
+
+    for (i = 0; i < 5; i++) {
+        in[i].a = i; in[i].b = i * 2; in[i].c = i * 3;
+    }
+
+    CHECK(rb_write(&r, in, 5) == 5);
+    CHECK(rb_read(&r, out, 3) == 3);
+    CHECK(memcmp(in, out, 3 * sizeof(t_three)) == 0);
+
+    /* This write wraps at the end of the storage */
+    CHECK(rb_write(&r, in, 5) == 5);
+    CHECK(rb_count(&r) == 7);
+    CHECK(rb_write(&r, in, 5) == 1);
+    CHECK(rb_full(&r));
+
+    newest = (t_three *)rb_newest(&r);
+    CHECK(newest != 0 && newest->a == 0);
+    newest->a = 99;
+
+    CHECK(rb_peek(&r, out, 8) == 8);
+    CHECK(rb_read(&r, out, 8) == 8);
+    CHECK(memcmp(&out[0], &in[3], 2 * sizeof(t_three)) == 0);
+    CHECK(memcmp(&out[2], &in[0], 5 * sizeof(t_three)) == 0);
+    CHECK(out[7].a == 99);
+    CHECK(rb_empty(&r));
+}
+
+/*
+ * Random mixes of single and block transfers match a simple model
+ */
+static void test_random() {
+    t_byte_ring r;
+    uint8_t storage[32];
+    uint8_t model[4096], chunk[64];
+    unsigned long produced = 0, consumed = 0;
+    int i, j;
+
+    srand(1);
+    rb_byte_init(&r, storage, 32);
+    for (i = 0; i < 100000; i++) {
+        unsigned short n = rand() % 40;
+        if (rand() & 1) {
+            for (j = 0; j < n; j++) {
+                chunk[j] = (uint8_t)(produced + j);
+            }
+            n = (rand() & 1) ? rb_byte_write(&r, chunk, n) : rb_byte_put(&r, chunk[0]);
+            for (j = 0; j < n; j++) {
+                model[(produced + j) % sizeof(model)] = chunk[j];
+            }
+            produced += n;
+        } else {
+            n = (rand() & 1) ? rb_byte_read(&r, chunk, n) : (rb_byte_empty(&r) ? 0 : (chunk[0] = rb_byte_get(&r), 1));
+            for (j = 0; j < n; j++) {
+                CHECK(chunk[j] == model[(consumed + j) % sizeof(model)]);
+            }
+            consumed += n;
+        }
+        CHECK(rb_byte_count(&r) == produced - consumed);
+        CHECK(rb_byte_count(&r) <= 32);
+    }
+}
+
+int main(int argc, char * argv[]) {
+    test_sizes();
+    test_full();
+    test_counter_wrap();
+    test_elements();
+    test_random();
+
+    if (failures) {
+        printf("test_ring_buffer: %d failures\n", failures);
+        return 1;
+    }
+
+    printf("test_ring_buffer: ok\n");
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * Host build of the RECEIVE side of the transfer protocol (src/xfer.c)
+ *
+ * The channel, file, and timer calls xfer.c makes are stubbed out here on top of the host:
+ * the serial channel is a terminal (the pty C256Mgr/xfer_pty_test.py sets up), and files
+ * are host files. Memory uses the kernel's own page allocator (src/memory.c) over a block
+ * of host memory mapped at the user RAMSTART (0x10000), with the kernel owning every page
+ * below it (the Makefile puts ___STACK there).
+ *
+ * xfer_host <tty> <path>                       receive an image into a file
+ * xfer_host <tty> @<ram size> <dump path>      receive an image at RAMSTART and dump it to a file
+ *
+ * In the second form, <ram size> is the RAM above RAMSTART. Before the transfer, a kernel
+ * buffer is taken the way opening COM1 takes one, as RECEIVE opens COM1 before the image
+ * claims its pages.
+ *
+ * Prints "result <code> received <bytes>" when the transfer ends.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "errors.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "proc.h"
+#include "sys_general.h"
+#include "timers.h"
+#include "xfer.h"
+#include "dev/channel.h"
+#include "dev/fsys.h"
+#include "fatfs/ff.h"
+
+#define HOST_RAMSTART   0x10000         /* Where user programs load, and where the block of "RAM" goes */
+#define HOST_UART_TAG   0x7b00          /* The tag the UART driver gives its ring page (src/dev/uart.c) */
+#define HOST_UART_SIZE  0x1000          /* The size of that page */
+
+static uint8_t * host_ram = 0;          /* The block standing in for the RAM above RAMSTART */
+static unsigned long host_ram_size = 0; /* Its size in bytes */
+
+/*
+ * Channels: the channel number is the host file descriptor
+ */
+
+short chan_read(short channel, uint8_t * buffer, short size) {
+    ssize_t n = read(channel, buffer, size);
+
+    if (n < 0) {
+        return (errno == EAGAIN) ? DEV_WOULD_BLOCK : DEV_CANNOT_READ;
+    }
+
+    return (short)n;
+}
+
+short chan_write(short channel, const uint8_t * buffer, short size) {
+    short written = 0;
+    ssize_t n;
+
+    while (written < size) {
+        n = write(channel, buffer + written, size - written);
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                usleep(1000);
+                continue;
+            }
+            return DEV_CANNOT_WRITE;
+        }
+        written += n;
+    }
+
+    return written;
+}
+
+short chan_ioctrl(short channel, short command, uint8_t * buffer, short size) {
+    int flags = fcntl(channel, F_GETFL);
+
+    switch (command) {
+        case CHAN_IOCTRL_NONBLOCK_ON:
+            fcntl(channel, F_SETFL, flags | O_NONBLOCK);
+            break;
+
+        case CHAN_IOCTRL_NONBLOCK_OFF:
+            fcntl(channel, F_SETFL, flags & ~O_NONBLOCK);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+short fsys_open(const char * path, short mode) {
+    int flags = ((mode & FA_READ) && (mode & FA_WRITE)) ? O_RDWR : ((mode & FA_WRITE) ? O_WRONLY : O_RDONLY);
+    int fd;
+
+    if (mode & FA_CREATE_ALWAYS) {
+        flags |= O_CREAT | O_TRUNC;
+    } else if (mode & FA_OPEN_ALWAYS) {
+        flags |= O_CREAT;
+    }
+
+    fd = open(path, flags, 0644);
+    return (fd < 0) ? FSYS_ERR_NO_FILE : fd;
+}
+
+short fsys_close(short fd) {
+    close(fd);
+    return 0;
+}
+
+/*
+ * Memory: the RAM ends at the top of the host_ram block, and no program is running
+ */
+
+void sys_get_information(p_sys_info info) {
+    memset(info, 0, sizeof(t_sys_info));
+    info->system_ram_size = HOST_RAMSTART + host_ram_size;
+}
+
+unsigned short proc_get_tag() {
+    return 0;
+}
+
+/*
+ * Time
+ */
+
+long timers_jiffies() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)now.tv_sec * 60 + now.tv_nsec / (1000000000 / 60);
+}
+
+void int_wait() {
+    usleep(1000);
+}
+
+int main(int argc, char * argv[]) {
+    unsigned long received = 0;
+    short channel;
+    short result;
+    FILE * dump;
+
+    if ((argc < 3) || ((argv[2][0] == '@') && (argc < 4))) {
+        fprintf(stderr, "USAGE: xfer_host <tty> <path> | @<ram size> <dump path>\n");
+        return 2;
+    }
+
+    channel = open(argv[1], O_RDWR | O_NOCTTY);
+    if (channel < 0) {
+        perror(argv[1]);
+        return 2;
+    }
+
+    if (argv[2][0] == '@') {
+        host_ram_size = strtoul(&argv[2][1], 0, 0);
+        host_ram = (uint8_t *)mmap((void *)HOST_RAMSTART, host_ram_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if ((host_ram == MAP_FAILED) || (host_ram != (uint8_t *)HOST_RAMSTART)) {
+            fprintf(stderr, "xfer_host: cannot map the RAM block at 0x%X\n", HOST_RAMSTART);
+            return 2;
+        }
+
+        mem_init();
+        if (mem_alloc_top(MEM_OWN_KERNEL, HOST_UART_TAG, HOST_UART_SIZE) == 0) {
+            fprintf(stderr, "xfer_host: no room for the COM1 buffer\n");
+            return 2;
+        }
+
+        result = xfer_receive(channel, 0, host_ram, &received);
+
+        dump = fopen(argv[3], "wb");
+        if (dump) {
+            fwrite(host_ram, 1, (received < host_ram_size) ? received : host_ram_size, dump);
+            fclose(dump);
+        }
+
+    } else {
+        result = xfer_receive(channel, argv[2], 0, &received);
+    }
+
+    printf("result %d received %lu\n", result, received);
+    close(channel);
+    return 0;
+}
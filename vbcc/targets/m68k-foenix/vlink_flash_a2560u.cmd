@@ -1,7 +1,7 @@
 FLASHSTART = 0x00E10000;
 FLASHLEN = 0x00200000;
 RAMSTART = 0x00001000;
-RAMSIZE  = 0x00010000;
+RAMSIZE  = 0x0000F000;
 STACKLEN = 0x400;
 VECTORSIZE = 0x400;
 BINFILESTART = 0x00000000;